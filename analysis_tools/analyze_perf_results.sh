@@ -109,6 +109,13 @@ if [ -f "$RESULT_DIR/perf_report.txt" ]; then
     fi
 fi
 
+echo ""
+echo "--- 结果库中当前内核的记录 ---"
+STORE_TOOL="$(dirname "$0")/bench_store.sh"
+if ! "$STORE_TOOL" list "kernel=$(uname -r)" 2>/dev/null; then
+    echo "  无记录（compare_realistic_stable.sh / compare_rstat_vs_atomic.sh 会自动写入）"
+fi
+
 echo ""
 echo "=== 分析完成 ==="
 echo ""
@@ -0,0 +1,291 @@
+#!/bin/bash
+# Append-only store of benchmark results, with regression detection across kernels.
+#
+# Every run is one line in $BENCH_STORE/records.tsv (the index) plus its raw
+# samples in $BENCH_STORE/samples/<id>.txt. Nothing is ever rewritten; records
+# are only appended (under flock), so results of every kernel candidate stay
+# comparable later.
+#
+# Usage:
+#   bench_store.sh record [-t tool] [-a access] [-f fields] [-u unit] [-l label]
+#                         [-k kernel] [-m mode] [FILE]
+#       Store the samples in FILE (or stdin), one number per line, lower is better.
+#       kernel (uname -r), build (uname -v), counter mode (/boot/config) and CPU
+#       model are filled in automatically.
+#   bench_store.sh list [SELECTOR]
+#   bench_store.sh compare -b SELECTOR [-c SELECTOR] [-A alpha] [-p min_pct]
+#       Pool the samples of the matching records per (tool, access, fields, unit,
+#       cpu) and run Welch's t-test, candidate (-c, default: current kernel)
+#       against baseline (-b). A group is a REGRESSION if the candidate mean is
+#       higher with p < alpha (default 0.01) and by more than min_pct (default 2%).
+#       Exits 1 if any group regressed.
+#
+# SELECTOR is COLUMN=VALUE[,COLUMN=VALUE...] on records.tsv columns (id, kernel,
+# build, mode, cpu, tool, access, fields, unit, label, ...); a bare VALUE means
+# kernel=VALUE.
+#
+# Examples:
+#   ./readstats_realistic 10 10 | awk '/Average time per read/ {print $5}' |
+#       ../analysis_tools/bench_store.sh record -t readstats_realistic -a cat -u us
+#   ./bench_store.sh list mode=ATOMIC
+#   ./bench_store.sh compare -b 6.8.0-rstat-base -c 6.8.0-rstat-rc2
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+STORE="${BENCH_STORE:-${SCRIPT_DIR}/../bench_store}"
+RECORDS="${STORE}/records.tsv"
+COLUMNS="id\ttime\thost\tkernel\tbuild\tmode\tcpu\ttool\taccess\tfields\tunit\tlabel\tn\tmean\tstddev\tp50\tp90\tp99\tmax"
+
+usage() {
+  sed -n '4,27p' "${BASH_SOURCE[0]}" | sed 's/^# \{0,1\}//' >&2
+  exit 2
+}
+
+init_store() {
+  mkdir -p "${STORE}/samples"
+  if [[ ! -s "${RECORDS}" ]]; then
+    echo -e "${COLUMNS}" > "${RECORDS}"
+  fi
+}
+
+counter_mode() {
+  if grep -q "CONFIG_MEMCG_RSTAT_COUNTER=y" /boot/config-$(uname -r) 2>/dev/null; then
+    echo "RSTAT"
+  elif grep -q "CONFIG_MEMCG_ATOMIC_COUNTER=y" /boot/config-$(uname -r) 2>/dev/null; then
+    echo "ATOMIC"
+  else
+    echo "UNKNOWN"
+  fi
+}
+
+cpu_model() {
+  awk -F': *' '/^model name/ { print $2; exit }' /proc/cpuinfo 2>/dev/null | tr -s ' \t' ' ' || true
+}
+
+# Selector matching, shared by list and compare (awk function text).
+AWK_SELECT='
+function parse_sel(sel, keys, vals,    n, i, parts, kv) {
+  n = split(sel, parts, ",")
+  for (i = 1; i <= n; i++) {
+    if (index(parts[i], "=")) {
+      keys[i] = substr(parts[i], 1, index(parts[i], "=") - 1)
+      vals[i] = substr(parts[i], index(parts[i], "=") + 1)
+    } else {
+      keys[i] = "kernel"; vals[i] = parts[i]
+    }
+  }
+  return n
+}
+function match_sel(n, keys, vals,    i) {
+  for (i = 1; i <= n; i++) {
+    if (!(keys[i] in col)) { print "unknown column " keys[i] > "/dev/stderr"; sel_error = 1; exit 2 }
+    if ($(col[keys[i]]) != vals[i]) return 0
+  }
+  return 1
+}'
+
+cmd_record() {
+  local tool="unknown" access="unknown" fields="all" unit="us" label="" kernel mode opt
+  kernel="$(uname -r)"
+  mode="$(counter_mode)"
+  OPTIND=1
+  while getopts "t:a:f:u:l:k:m:" opt; do
+    case "${opt}" in
+      t) tool="${OPTARG}" ;;
+      a) access="${OPTARG}" ;;
+      f) fields="${OPTARG}" ;;
+      u) unit="${OPTARG}" ;;
+      l) label="${OPTARG}" ;;
+      k) kernel="${OPTARG}" ;;
+      m) mode="${OPTARG}" ;;
+      *) usage ;;
+    esac
+  done
+  shift $((OPTIND - 1))
+  local input="${1:--}"
+
+  init_store
+  local tmp
+  tmp="$(mktemp "${STORE}/samples/.new.XXXXXX")"
+  # keep numeric lines only, so raw tool output can be piped through a filter
+  awk '$1 ~ /^[-+]?[0-9]*\.?[0-9]+([eE][-+]?[0-9]+)?$/ { print $1 }' "${input}" > "${tmp}"
+  if [[ ! -s "${tmp}" ]]; then
+    rm -f "${tmp}"
+    echo "record: no samples on input" >&2
+    exit 1
+  fi
+
+  local stats
+  stats="$(sort -g "${tmp}" | awk '
+    { v[NR] = $1; s += $1; ss += $1 * $1 }
+    function pct(p,    i) { i = int(p * NR + 0.5); if (i < 1) i = 1; if (i > NR) i = NR; return v[i] }
+    END {
+      m = s / NR; var = NR > 1 ? (ss - NR * m * m) / (NR - 1) : 0
+      if (var < 0) var = 0
+      printf "%d\t%.6g\t%.6g\t%.6g\t%.6g\t%.6g\t%.6g\n", NR, m, sqrt(var), pct(0.5), pct(0.9), pct(0.99), v[NR]
+    }')"
+
+  # tabs would break the index; fold every field to one line without tabs
+  clean() { printf '%s' "$1" | tr '\t\n' '  '; }
+  local build cpu host
+  build="$(clean "$(uname -v)")"
+  cpu="$(clean "$(cpu_model)")"
+  host="$(clean "$(hostname 2>/dev/null || echo unknown)")"
+
+  local id
+  {
+    flock 9
+    id="$(awk 'END { printf "r%06d", NR }' "${RECORDS}")"
+    mv "${tmp}" "${STORE}/samples/${id}.txt"
+    printf '%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n' \
+      "${id}" "$(date +%Y-%m-%dT%H:%M:%S)" "${host}" "$(clean "${kernel}")" "${build}" \
+      "$(clean "${mode}")" "${cpu:-unknown}" "$(clean "${tool}")" "$(clean "${access}")" \
+      "$(clean "${fields}")" "$(clean "${unit}")" "$(clean "${label:--}")" "${stats}" >> "${RECORDS}"
+  } 9>> "${STORE}/.lock"
+  echo "${id}: ${tool}/${access}/${fields} on ${kernel} (${mode}): n=$(cut -f1 <<< "${stats}") mean=$(cut -f2 <<< "${stats}") ${unit}"
+}
+
+cmd_list() {
+  local sel="${1:-}"
+  [[ -s "${RECORDS}" ]] || { echo "empty store: ${STORE}" >&2; exit 1; }
+  awk -F'\t' -v sel="${sel}" "${AWK_SELECT}"'
+    NR == 1 { for (i = 1; i <= NF; i++) col[$i] = i; ns = sel == "" ? 0 : parse_sel(sel, k, v)
+              printf "%-8s %-19s %-24s %-7s %-20s %-8s %-6s %-12s %5s %10s %10s %10s %s\n", "id", "time",
+                     "kernel", "mode", "tool", "access", "fields", "label", "n", "mean", "p50", "p99", "unit"
+              next }
+    match_sel(ns, k, v) {
+      printf "%-8s %-19s %-24s %-7s %-20s %-8s %-6s %-12s %5d %10.4g %10.4g %10.4g %s\n",
+             $col["id"], $col["time"], $col["kernel"], $col["mode"], $col["tool"], $col["access"],
+             $col["fields"], $col["label"], $col["n"], $col["mean"], $col["p50"], $col["p99"], $col["unit"]
+    }' "${RECORDS}"
+}
+
+cmd_compare() {
+  local base="" cand alpha="0.01" min_pct="2" opt
+  cand="kernel=$(uname -r)"
+  OPTIND=1
+  while getopts "b:c:A:p:" opt; do
+    case "${opt}" in
+      b) base="${OPTARG}" ;;
+      c) cand="${OPTARG}" ;;
+      A) alpha="${OPTARG}" ;;
+      p) min_pct="${OPTARG}" ;;
+      *) usage ;;
+    esac
+  done
+  [[ -n "${base}" ]] || usage
+  [[ -s "${RECORDS}" ]] || { echo "empty store: ${STORE}" >&2; exit 1; }
+
+  awk -F'\t' -v sel_b="${base}" -v sel_c="${cand}" -v alpha="${alpha}" -v min_pct="${min_pct}" \
+      -v samples="${STORE}/samples" "${AWK_SELECT}"'
+    # log Gamma (Lanczos, g = 7)
+    function lgam(x,    a, t, i, lz) {
+      split("676.5203681218851 -1259.1392167224028 771.32342877765313 -176.61502916214059 " \
+            "12.507343278686905 -0.13857109526572012 9.9843695780195716e-6 1.5056327351493116e-7", lz, " ")
+      x -= 1; a = 0.99999999999980993; t = x + 7.5
+      for (i = 1; i <= 8; i++) a += lz[i] / (x + i)
+      return 0.91893853320467274 + (x + 0.5) * log(t) - t + log(a)
+    }
+    # continued fraction for the incomplete beta function
+    function betacf(a, b, x,    m, m2, aa, c, d, del, h, qab, qap, qam) {
+      qab = a + b; qap = a + 1; qam = a - 1; c = 1; d = 1 - qab * x / qap
+      if (d * d < 1e-300) d = 1e-300
+      d = 1 / d; h = d
+      for (m = 1; m <= 300; m++) {
+        m2 = 2 * m
+        aa = m * (b - m) * x / ((qam + m2) * (a + m2))
+        d = 1 + aa * d; if (d * d < 1e-300) d = 1e-300
+        c = 1 + aa / c; if (c * c < 1e-300) c = 1e-300
+        d = 1 / d; h *= d * c
+        aa = -(a + m) * (qab + m) * x / ((a + m2) * (qap + m2))
+        d = 1 + aa * d; if (d * d < 1e-300) d = 1e-300
+        c = 1 + aa / c; if (c * c < 1e-300) c = 1e-300
+        d = 1 / d; del = d * c; h *= del
+        if ((del - 1) * (del - 1) < 1e-20) break
+      }
+      return h
+    }
+    function betai(a, b, x,    bt) {
+      if (x <= 0) return 0
+      if (x >= 1) return 1
+      bt = exp(lgam(a + b) - lgam(a) - lgam(b) + a * log(x) + b * log(1 - x))
+      if (x < (a + 1) / (a + b + 2)) return bt * betacf(a, b, x) / a
+      return 1 - bt * betacf(b, a, 1 - x) / b
+    }
+    # two-sided p-value of Student t with df degrees of freedom
+    function t_pvalue(t, df) { return betai(df / 2, 0.5, df / (df + t * t)) }
+
+    function add_samples(g, side, id,    f, x) {
+      f = samples "/" id ".txt"
+      while ((getline x < f) > 0) { n[g, side]++; s[g, side] += x; ss[g, side] += x * x }
+      close(f)
+      nrec[g, side]++
+    }
+
+    NR == 1 {
+      for (i = 1; i <= NF; i++) col[$i] = i
+      nb = parse_sel(sel_b, kb, vb); nc = parse_sel(sel_c, kc, vc)
+      next
+    }
+    {
+      g = $col["tool"] SUBSEP $col["access"] SUBSEP $col["fields"] SUBSEP $col["unit"] SUBSEP $col["cpu"]
+      inb = match_sel(nb, kb, vb); inc = match_sel(nc, kc, vc)
+      if (inb && inc) next
+      if (inb) { add_samples(g, "b", $col["id"]); seen[g] = 1 }
+      if (inc) { add_samples(g, "c", $col["id"]); seen[g] = 1 }
+    }
+    END {
+      if (sel_error) exit 2
+      printf "baseline:  %s\ncandidate: %s\nWelch t-test, alpha %s, min change %s%%\n\n", sel_b, sel_c, alpha, min_pct
+      printf "%-22s %-8s %-6s %-5s %7s %12s %12s %8s %8s %10s  %s\n", "tool", "access", "fields", "unit",
+             "n b/c", "base mean", "cand mean", "delta%", "t", "p", "verdict"
+      regress = 0; groups = 0
+      for (g in seen) {
+        split(g, k, SUBSEP)
+        nbs = n[g, "b"] + 0; ncs = n[g, "c"] + 0
+        if (!nbs || !ncs) {
+          printf "%-22s %-8s %-6s %-5s %3d/%-3d %12s %12s %8s %8s %10s  %s\n", k[1], k[2], k[3], k[4],
+                 nbs, ncs, "-", "-", "-", "-", "-", nbs ? "no candidate" : "no baseline"
+          continue
+        }
+        groups++
+        mb = s[g, "b"] / nbs; mc = s[g, "c"] / ncs
+        vb_ = nbs > 1 ? (ss[g, "b"] - nbs * mb * mb) / (nbs - 1) : 0
+        vc_ = ncs > 1 ? (ss[g, "c"] - ncs * mc * mc) / (ncs - 1) : 0
+        if (vb_ < 0) vb_ = 0
+        if (vc_ < 0) vc_ = 0
+        delta = mb ? (mc - mb) * 100 / mb : 0
+        if (nbs < 2 || ncs < 2) {
+          t = 0; p = 1; tt = "-"; verdict = "too few samples"
+        } else {
+          se2 = vb_ / nbs + vc_ / ncs
+          if (se2 <= 0) {
+            t = 0; p = mb == mc ? 1 : 0
+          } else {
+            t = (mc - mb) / sqrt(se2)
+            df = se2 * se2 / ((vb_ / nbs) ^ 2 / (nbs - 1) + (vc_ / ncs) ^ 2 / (ncs - 1))
+            p = t_pvalue(t, df)
+          }
+          tt = sprintf("%.2f", t)
+          if (p < alpha && delta > min_pct) { verdict = "REGRESSION"; regress++ }
+          else if (p < alpha && delta < -min_pct) verdict = "improved"
+          else verdict = "same"
+        }
+        printf "%-22s %-8s %-6s %-5s %3d/%-3d %12.4g %12.4g %+8.2f %8s %10.3g  %s\n", k[1], k[2], k[3], k[4],
+               nbs, ncs, mb, mc, delta, tt, p, verdict
+      }
+      printf "\n%d groups compared, %d regressions\n", groups, regress
+      exit regress ? 1 : 0
+    }' "${RECORDS}"
+}
+
+[[ $# -ge 1 ]] || usage
+cmd="$1"
+shift
+case "${cmd}" in
+  record)  cmd_record "$@" ;;
+  list)    cmd_list "$@" ;;
+  compare) cmd_compare "$@" ;;
+  *)       usage ;;
+esac
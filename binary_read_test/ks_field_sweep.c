@@ -0,0 +1,340 @@
+/*
+ * Per-field cost of memory.stat.ks filters, measured in one process.
+ *
+ * For N = 1, step, 2*step, ... max fields it writes a filter of N random
+ * vmstats.state[i] fields (with and without "flush") to memory.stat.ks and
+ * memory.numa_stat.ks, reopens both, and times lseek(0) + read() of the
+ * pair. Each N is measured with several random subsets so the fit is not
+ * tied to particular fields. Legacy memory.stat + memory.numa_stat is
+ * measured the same way before and after the sweep.
+ *
+ * Then, per flush mode, it fits   cost(N) = fixed + N * per_field
+ * by least squares and reports the crossover N where .ks stops being
+ * cheaper than the legacy files.
+ *
+ * Compile: gcc -O2 -o ks_field_sweep ks_field_sweep.c
+ * Run:     CGPATH=/sys/fs/cgroup/bench ./ks_field_sweep [-s step] [-m max]
+ *              [-p pool] [-n reads] [-r reps] [-S seed] [-o out.csv]
+ * The filter is left at the last subset measured.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BUF_SIZE	65536
+#define POOL_MAX	1024
+#define FILTER_MAX	(POOL_MAX * 24)
+#define DEFAULT_CGPATH	"/sys/fs/cgroup"
+
+static char buf[BUF_SIZE];
+static const char *cgpath;
+
+struct point {
+	int fields;
+	int flush;
+	double ns;		/* mean per read of both files */
+};
+
+struct fit {
+	double fixed, per_field, r2;
+	int n;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t rng_state;
+
+static uint32_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (uint32_t)(rng_state >> 32);
+}
+
+static int open_pair(const char *stat, const char *numa, int fd[2])
+{
+	char path[512];
+
+	snprintf(path, sizeof(path), "%s/%s", cgpath, stat);
+	fd[0] = open(path, O_RDONLY);
+	if (fd[0] < 0) {
+		perror(path);
+		return -1;
+	}
+	snprintf(path, sizeof(path), "%s/%s", cgpath, numa);
+	fd[1] = open(path, O_RDONLY);
+	if (fd[1] < 0) {
+		perror(path);
+		close(fd[0]);
+		return -1;
+	}
+	return 0;
+}
+
+/* Mean ns of one lseek(0) + read() of both files, after a short warm-up. */
+static double time_pair(const int fd[2], int reads)
+{
+	uint64_t t0 = 0;
+	int i, f;
+
+	for (i = -reads / 10 - 1; i < reads; i++) {
+		if (i == 0)
+			t0 = now_ns();
+		for (f = 0; f < 2; f++) {
+			if (lseek(fd[f], 0, SEEK_SET) < 0 ||
+			    read(fd[f], buf, sizeof(buf)) < 0) {
+				perror("read");
+				exit(1);
+			}
+		}
+	}
+	return (double)(now_ns() - t0) / reads;
+}
+
+static double measure_legacy(int reads)
+{
+	int fd[2];
+	double ns;
+
+	if (open_pair("memory.stat", "memory.numa_stat", fd) < 0)
+		exit(1);
+	ns = time_pair(fd, reads);
+	close(fd[0]);
+	close(fd[1]);
+	return ns;
+}
+
+static int write_filter(const char *name, const char *filter)
+{
+	char path[512];
+	size_t len = strlen(filter);
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", cgpath, name);
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	if (write(fd, filter, len) != (ssize_t)len) {
+		fprintf(stderr, "%s: writing filter: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+/* Random subset of nfields distinct vmstats.state[] indices below pool. */
+static void build_filter(char *out, size_t cap, int nfields, int pool,
+			 int flush)
+{
+	static int idx[POOL_MAX];
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < pool; i++)
+		idx[i] = i;
+	for (i = 0; i < nfields; i++) {
+		int j = i + (int)(rng() % (uint32_t)(pool - i)), t = idx[i];
+
+		idx[i] = idx[j];
+		idx[j] = t;
+	}
+	out[0] = '\0';
+	if (flush)
+		len += (size_t)snprintf(out + len, cap - len, "flush");
+	for (i = 0; i < nfields && len < cap; i++)
+		len += (size_t)snprintf(out + len, cap - len, "%svmstats.state[%d]",
+					len ? "," : "", idx[i]);
+}
+
+static struct fit fit_line(const struct point *p, int np, int flush)
+{
+	double sx = 0, sy = 0, sxx = 0, sxy = 0, ss_tot = 0, ss_res = 0, my;
+	struct fit f = { 0 };
+	int i;
+
+	for (i = 0; i < np; i++) {
+		if (p[i].flush != flush)
+			continue;
+		sx += p[i].fields;
+		sy += p[i].ns;
+		sxx += (double)p[i].fields * p[i].fields;
+		sxy += p[i].fields * p[i].ns;
+		f.n++;
+	}
+	if (f.n < 2 || f.n * sxx == sx * sx)
+		return f;
+	f.per_field = (f.n * sxy - sx * sy) / (f.n * sxx - sx * sx);
+	f.fixed = (sy - f.per_field * sx) / f.n;
+	my = sy / f.n;
+	for (i = 0; i < np; i++) {
+		double e;
+
+		if (p[i].flush != flush)
+			continue;
+		e = p[i].ns - (f.fixed + f.per_field * p[i].fields);
+		ss_res += e * e;
+		ss_tot += (p[i].ns - my) * (p[i].ns - my);
+	}
+	f.r2 = ss_tot > 0 ? 1 - ss_res / ss_tot : 1;
+	return f;
+}
+
+static void report_fit(const char *label, struct fit f, double legacy,
+		       int max_fields)
+{
+	double cross;
+
+	if (f.n < 2) {
+		printf("%-9s not enough points to fit\n", label);
+		return;
+	}
+	printf("%-9s fixed %8.1f ns + %6.2f ns/field  (R^2 %.3f, %d points)\n",
+	       label, f.fixed, f.per_field, f.r2, f.n);
+	if (f.per_field <= 0) {
+		printf("%-9s no per-field cost measured; %s than legacy at any N\n",
+		       "", f.fixed < legacy ? "cheaper" : "dearer");
+		return;
+	}
+	cross = (legacy - f.fixed) / f.per_field;
+	if (cross < 1)
+		printf("%-9s dearer than legacy even with 1 field\n", "");
+	else if (cross > max_fields)
+		printf("%-9s cheaper than legacy up to %d fields (crossover ~%.0f, extrapolated)\n",
+		       "", max_fields, cross);
+	else
+		printf("%-9s cheaper than legacy below ~%.0f fields\n", "", cross);
+}
+
+int main(int argc, char *argv[])
+{
+	static char filter[FILTER_MAX];
+	struct point *points;
+	int step = 8, max_fields = 128, pool = 128, reads = 20000, reps = 3;
+	const char *csv = NULL;
+	double legacy_before, legacy_after, legacy;
+	int np = 0, nsizes = 0, opt, nf, flush, rep, fd[2];
+	FILE *out = NULL;
+
+	rng_state = 0x9e3779b97f4a7c15ull;
+	while ((opt = getopt(argc, argv, "s:m:p:n:r:S:o:")) != -1) {
+		switch (opt) {
+		case 's':
+			step = atoi(optarg);
+			break;
+		case 'm':
+			max_fields = atoi(optarg);
+			break;
+		case 'p':
+			pool = atoi(optarg);
+			break;
+		case 'n':
+			reads = atoi(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		case 'S':
+			rng_state = strtoull(optarg, NULL, 0) | 1;
+			break;
+		case 'o':
+			csv = optarg;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc || step <= 0 || max_fields <= 0 || reads <= 0 ||
+	    reps <= 0 || pool <= 0 || pool > POOL_MAX || max_fields > pool)
+		goto usage;
+
+	/* one point per (N, flush, rep) */
+	for (nf = 1; nf <= max_fields; nf = nf == 1 && step > 1 ? step : nf + step)
+		nsizes++;
+	points = malloc((size_t)nsizes * 2 * reps * sizeof(*points));
+	if (!points) {
+		perror("malloc");
+		return 1;
+	}
+
+	cgpath = getenv("CGPATH");
+	if (!cgpath)
+		cgpath = DEFAULT_CGPATH;
+	if (csv) {
+		out = fopen(csv, "w");
+		if (!out) {
+			perror(csv);
+			return 1;
+		}
+		fprintf(out, "fields,flush,rep,ns_per_read\n");
+	}
+
+	legacy_before = measure_legacy(reads);
+	printf("=== .ks per-field sweep on %s: %d reads/point, %d subsets/N ===\n",
+	       cgpath, reads, reps);
+	printf("legacy memory.stat + memory.numa_stat: %.1f ns/read\n\n",
+	       legacy_before);
+	printf("%7s %6s %12s\n", "fields", "flush", "ns/read");
+
+	for (nf = 1; nf <= max_fields; nf = nf == 1 && step > 1 ? step : nf + step) {
+		for (flush = 0; flush <= 1; flush++) {
+			double sum = 0;
+
+			for (rep = 0; rep < reps; rep++) {
+				double ns;
+
+				build_filter(filter, sizeof(filter), nf, pool, flush);
+				if (write_filter("memory.stat.ks", filter) < 0 ||
+				    write_filter("memory.numa_stat.ks", filter) < 0)
+					return 1;
+				if (open_pair("memory.stat.ks", "memory.numa_stat.ks", fd) < 0)
+					return 1;
+				ns = time_pair(fd, reads);
+				close(fd[0]);
+				close(fd[1]);
+				points[np].fields = nf;
+				points[np].flush = flush;
+				points[np].ns = ns;
+				np++;
+				sum += ns;
+				if (out)
+					fprintf(out, "%d,%d,%d,%.1f\n", nf, flush, rep, ns);
+			}
+			printf("%7d %6s %12.1f\n", nf, flush ? "yes" : "no", sum / reps);
+		}
+	}
+
+	legacy_after = measure_legacy(reads);
+	legacy = (legacy_before + legacy_after) / 2;
+	printf("\nlegacy after sweep: %.1f ns/read (drift %+.1f%%)\n", legacy_after,
+	       (legacy_after - legacy_before) * 100 / legacy_before);
+	printf("\n=== Fit: ns/read = fixed + fields * per_field ===\n");
+	report_fit("flush", fit_line(points, np, 1), legacy, max_fields);
+	report_fit("no-flush", fit_line(points, np, 0), legacy, max_fields);
+	if (out)
+		fclose(out);
+	free(points);
+	return 0;
+
+usage:
+	fprintf(stderr, "USAGE: CGPATH=... %s [-s step] [-m max_fields] [-p pool] "
+		"[-n reads] [-r reps] [-S seed] [-o out.csv]\n", argv[0]);
+	fprintf(stderr, "  fields are vmstats.state[0 .. pool-1]; max_fields <= pool <= %d\n",
+		POOL_MAX);
+	return 1;
+}
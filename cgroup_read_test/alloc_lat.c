@@ -0,0 +1,150 @@
+/*
+ * alloc-style worker that measures its own page-fault latency.
+ * It maps SIZE bytes of anonymous memory, first-touches every 4 KiB page with
+ * the store timed individually (fault + memcg charge), unmaps (uncharge) and
+ * starts over, for SECONDS. Latencies go into a log-linear histogram
+ * (16 sub-buckets per power of two, <= 6.25% error), so long runs do not keep
+ * every sample.
+ * At exit it prints one key=value line (percentiles are bucket upper bounds);
+ * HIST_FILE gets "lo_ns hi_ns count" per non-empty bucket so several workers
+ * can be merged exactly (writer_interference.sh does that).*/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PAGE      4096
+#define NBUCKETS  1024
+
+static uint64_t hist[NBUCKETS];
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static size_t parse_size(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || v <= 0) return 0;
+    if (*end == 'g' || *end == 'G') return (size_t)(v * 1024 * 1024 * 1024);
+    if (*end == 'm' || *end == 'M') return (size_t)(v * 1024 * 1024);
+    if (*end == 'k' || *end == 'K') return (size_t)(v * 1024);
+    return (size_t)v; // bytes
+}
+
+// v < 32: one bucket per ns; above, 16 buckets per power of two
+static int bucket(uint64_t v) {
+    if (v < 32) return (int)v;
+    int shift = 63 - __builtin_clzll(v) - 4;
+    int idx = shift * 16 + (int)(v >> shift);
+    return idx < NBUCKETS ? idx : NBUCKETS - 1;
+}
+
+static uint64_t bucket_lo(int idx) {
+    if (idx < 32) return (uint64_t)idx;
+    return (uint64_t)(idx % 16 + 16) << (idx / 16 - 1);
+}
+
+static uint64_t bucket_hi(int idx) {
+    if (idx < 32) return (uint64_t)idx;
+    return ((uint64_t)(idx % 16 + 17) << (idx / 16 - 1)) - 1;
+}
+
+static uint64_t percentile(uint64_t total, double p) {
+    uint64_t want = (uint64_t)(total * p), seen = 0;
+    for (int i = 0; i < NBUCKETS; i++) {
+        seen += hist[i];
+        if (seen > want) return bucket_hi(i);
+    }
+    return 0;
+}
+
+// Cost of the now_ns() pair around each store, to read the fault numbers against.
+static uint64_t clock_overhead(void) {
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 1000; i++) {
+        uint64_t t0 = now_ns(), t1 = now_ns();
+        if (t1 - t0 < best) best = t1 - t0;
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "USAGE: %s SIZE SECONDS [HIST_FILE]\n", argv[0]);
+        return 1;
+    }
+    size_t sz = parse_size(argv[1]) / PAGE * PAGE;
+    int secs = atoi(argv[2]);
+    if (sz == 0 || secs <= 0) {
+        fprintf(stderr, "need SIZE >= 4K and SECONDS > 0\n");
+        return 1;
+    }
+
+    uint64_t start = now_ns(), end = start + (uint64_t)secs * 1000000000ull;
+    uint64_t faults = 0, sum = 0, max = 0, passes = 0, unmap_ns = 0, unmap_max = 0;
+
+    while (now_ns() < end) {
+        char *p = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "mmap(%zu) failed: %s\n", sz, strerror(errno));
+            return 1;
+        }
+        // 4 KiB faults only: one charge per page, as most workloads see it
+        madvise(p, sz, MADV_NOHUGEPAGE);
+
+        for (size_t off = 0; off < sz; off += PAGE) {
+            uint64_t t0 = now_ns();
+            *(volatile char *)(p + off) = 1;
+            uint64_t dt = now_ns() - t0;
+            hist[bucket(dt)]++;
+            sum += dt;
+            if (dt > max) max = dt;
+        }
+        faults += sz / PAGE;
+
+        uint64_t t0 = now_ns();
+        munmap(p, sz);
+        uint64_t dt = now_ns() - t0;
+        unmap_ns += dt;
+        if (dt > unmap_max) unmap_max = dt;
+        passes++;
+    }
+    double wall_s = (now_ns() - start) / 1e9;
+
+    if (argc == 4) {
+        FILE *fp = fopen(argv[3], "w");
+        if (!fp) {
+            perror(argv[3]);
+            return 1;
+        }
+        for (int i = 0; i < NBUCKETS; i++)
+            if (hist[i])
+                fprintf(fp, "%llu %llu %llu\n", (unsigned long long)bucket_lo(i),
+                        (unsigned long long)bucket_hi(i), (unsigned long long)hist[i]);
+        fclose(fp);
+    }
+
+    // One line, key=value, for writer_interference.sh
+    printf("alloc_lat pid=%d size=%zu wall_s=%.2f passes=%llu faults=%llu faults_per_s=%.0f "
+           "mean_ns=%.0f p50_ns=%llu p90_ns=%llu p99_ns=%llu p999_ns=%llu max_ns=%llu "
+           "unmap_mean_us=%.1f unmap_max_us=%.1f clock_ns=%llu\n",
+           (int)getpid(), sz, wall_s, (unsigned long long)passes,
+           (unsigned long long)faults, faults / wall_s,
+           faults ? (double)sum / faults : 0.0,
+           (unsigned long long)percentile(faults, 0.50),
+           (unsigned long long)percentile(faults, 0.90),
+           (unsigned long long)percentile(faults, 0.99),
+           (unsigned long long)percentile(faults, 0.999),
+           (unsigned long long)max,
+           passes ? unmap_ns / 1e3 / passes : 0.0, unmap_max / 1e3,
+           (unsigned long long)clock_overhead());
+    return 0;
+}
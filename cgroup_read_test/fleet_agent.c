@@ -0,0 +1,187 @@
+/*
+ * One simulated per-container monitoring agent.
+ * It reads memory.stat + memory.numa_stat of its own cgroup (from /proc/self/cgroup,
+ * or CGROUP_PATH) every INTERVAL_MS +/- JITTER_PCT (0 = back to back), in one of
+ * three access modes:
+ *   cat   open + read + close per file per tick (what a shell sidecar does)
+ *   once  files opened once, lseek(0) + read() per tick
+ *   light files opened once, 32-byte pread() per tick (readstats_light style)
+ * At exit it prints one summary line (latency per tick and its own user/sys CPU),
+ * which launch_fleet.sh and writer_interference.sh aggregate across agents.
+ * Latency statistics cover the first MAX_TICKS ticks, reported as sampled=.*/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BUF_SIZE  65536
+#define MAX_TICKS 1000000
+
+enum mode { MODE_CAT, MODE_ONCE, MODE_LIGHT };
+
+static char buf[BUF_SIZE];
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// "0::/a/b/c/3" -> "/sys/fs/cgroup/a/b/c/3"
+static int own_cgroup(char *out, size_t len) {
+    char line[480];
+    FILE *fp = fopen("/proc/self/cgroup", "r");
+    int ok = -1;
+
+    if (!fp) return -1;
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(out, len, "/sys/fs/cgroup%s", line + 3);
+            ok = 0;
+            break;
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+static int read_all(int fd) {
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        ;
+    return n < 0 ? -1 : 0;
+}
+
+static int one_tick(enum mode m, const char *paths[2], int fds[2]) {
+    int f, ret = 0;
+
+    for (f = 0; f < 2; f++) {
+        if (m == MODE_CAT) {
+            int fd = open(paths[f], O_RDONLY);
+            if (fd < 0) return -1;
+            ret |= read_all(fd);
+            close(fd);
+        } else if (m == MODE_ONCE) {
+            if (lseek(fds[f], 0, SEEK_SET) < 0) return -1;
+            ret |= read_all(fds[f]);
+        } else {
+            ret |= pread(fds[f], buf, 32, 0) < 0 ? -1 : 0;
+        }
+    }
+    return ret;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double tv_ms(struct timeval tv) {
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 5 || argc > 6) {
+        fprintf(stderr, "USAGE: %s cat|once|light INTERVAL_MS JITTER_PCT SECONDS [CGROUP_PATH]\n",
+                argv[0]);
+        return 1;
+    }
+    enum mode m;
+    if (strcmp(argv[1], "cat") == 0) m = MODE_CAT;
+    else if (strcmp(argv[1], "once") == 0) m = MODE_ONCE;
+    else if (strcmp(argv[1], "light") == 0) m = MODE_LIGHT;
+    else {
+        fprintf(stderr, "unknown mode %s (cat, once, light)\n", argv[1]);
+        return 1;
+    }
+    long interval_ms = atol(argv[2]);
+    double jitter = atof(argv[3]) / 100.0;
+    long secs = atol(argv[4]);
+    if (interval_ms < 0 || jitter < 0 || jitter >= 1 || secs <= 0) {
+        fprintf(stderr, "need INTERVAL_MS >= 0, 0 <= JITTER_PCT < 100, SECONDS > 0\n");
+        return 1;
+    }
+
+    char cg[512];
+    if (argc == 6) snprintf(cg, sizeof(cg), "%s", argv[5]);
+    else if (own_cgroup(cg, sizeof(cg)) < 0) {
+        fprintf(stderr, "cannot find own cgroup in /proc/self/cgroup\n");
+        return 1;
+    }
+
+    char p_stat[600], p_numa[600];
+    snprintf(p_stat, sizeof(p_stat), "%s/memory.stat", cg);
+    snprintf(p_numa, sizeof(p_numa), "%s/memory.numa_stat", cg);
+    const char *paths[2] = { p_stat, p_numa };
+    int fds[2] = { -1, -1 };
+    if (m != MODE_CAT) {
+        fds[0] = open(p_stat, O_RDONLY);
+        fds[1] = open(p_numa, O_RDONLY);
+        if (fds[0] < 0 || fds[1] < 0) {
+            perror(cg);
+            return 1;
+        }
+    }
+
+    uint64_t max_ticks = MAX_TICKS;
+    if (interval_ms && (uint64_t)secs * 1000 / interval_ms * 2 + 16 < max_ticks)
+        max_ticks = (uint64_t)secs * 1000 / interval_ms * 2 + 16;
+    uint64_t *lat = malloc(max_ticks * sizeof(uint64_t));
+    if (!lat) {
+        perror("malloc");
+        return 1;
+    }
+
+    // Per-agent seed so agents started together do not tick in lockstep.
+    srand48(getpid() ^ (long)now_ns());
+    uint64_t start = now_ns(), end = start + (uint64_t)secs * 1000000000ull;
+    uint64_t next = start + (uint64_t)(drand48() * interval_ms * 1e6);  // random phase
+    uint64_t n = 0, ticks = 0, errors = 0;
+
+    for (;;) {
+        if (interval_ms) {
+            struct timespec ts = { (time_t)(next / 1000000000ull), (long)(next % 1000000000ull) };
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+                ;
+        }
+        if (now_ns() >= end) break;
+
+        uint64_t t0 = now_ns();
+        if (one_tick(m, paths, fds) < 0) errors++;
+        if (n < max_ticks) lat[n++] = now_ns() - t0;
+        ticks++;
+
+        // next deadline: interval scaled by a uniform factor in [1 - jitter, 1 + jitter]
+        double f = 1.0 + jitter * (2.0 * drand48() - 1.0);
+        next += (uint64_t)(interval_ms * 1e6 * f);
+    }
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    double wall_s = (now_ns() - start) / 1e9;
+
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n; i++) sum += lat[i];
+    qsort(lat, n, sizeof(lat[0]), cmp_u64);
+
+    // One line, key=value, for launch_fleet.sh
+    printf("agent pid=%d cgroup=%s mode=%s interval_ms=%ld jitter_pct=%.0f wall_s=%.2f "
+           "ticks=%llu sampled=%llu errors=%llu mean_us=%.2f p50_us=%.2f p99_us=%.2f max_us=%.2f "
+           "user_ms=%.2f sys_ms=%.2f\n",
+           (int)getpid(), cg, argv[1], interval_ms, jitter * 100, wall_s,
+           (unsigned long long)ticks, (unsigned long long)n, (unsigned long long)errors,
+           n ? sum / 1e3 / n : 0.0,
+           n ? lat[n / 2] / 1e3 : 0.0,
+           n ? lat[n * 99 / 100] / 1e3 : 0.0,
+           n ? lat[n - 1] / 1e3 : 0.0,
+           tv_ms(ru.ru_utime), tv_ms(ru.ru_stime));
+    free(lat);
+    return 0;
+}
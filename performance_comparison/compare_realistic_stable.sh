@@ -122,6 +122,13 @@ echo "Analyzing results..."
 
 } > "$OUTPUT_DIR/summary.txt"
 
+# 记录到结果库（BENCH_STORE_RECORD=0 关闭），之后用 bench_store.sh compare 对比内核
+if [[ "${BENCH_STORE_RECORD:-1}" == 1 ]]; then
+    cat "$OUTPUT_DIR"/avg_time_*.txt | \
+        ../analysis_tools/bench_store.sh record -t readstats_realistic -a lseek_read -f all -u us \
+            -m "$CURRENT_MODE" -l "$OUTPUT_DIR" || echo "Warning: bench_store record failed"
+fi
+
 echo ""
 echo "=== Test Completed ==="
 echo "Results saved in: $OUTPUT_DIR"
@@ -102,6 +102,13 @@ echo "分析结果..."
     cat "$OUTPUT_DIR/cache_stats.txt"
 } > "$OUTPUT_DIR/full_report.txt"
 
+# 记录到结果库（BENCH_STORE_RECORD=0 关闭），每次迭代的 real 时间为一个样本
+if [[ "${BENCH_STORE_RECORD:-1}" == 1 ]]; then
+    awk '{print $1}' "$OUTPUT_DIR"/time_*.txt | \
+        ../analysis_tools/bench_store.sh record -t "readstats_$TEST_PARAM" -a lseek_read -f all -u s \
+            -m "$CURRENT_MODE" -l "$OUTPUT_DIR" || echo "警告: bench_store record 失败"
+fi
+
 echo ""
 echo "=== 对比完成 ==="
 echo "Results saved in: $OUTPUT_DIR"
@@ -115,6 +122,7 @@ echo ""
 echo "Tip: For complete comparison:"
 echo "  1. 编译 RSTAT 版本内核，运行此脚本，保存结果"
 echo "  2. 编译 Atomic Counter 版本内核，运行此脚本，保存结果"
-echo "  3. 对比两个结果目录的 summary.txt"
+echo "  3. 对比两个结果目录的 summary.txt，或直接对比结果库："
+echo "     ../analysis_tools/bench_store.sh compare -b mode=RSTAT -c mode=ATOMIC"
 
 
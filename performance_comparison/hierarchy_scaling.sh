@@ -0,0 +1,189 @@
+#!/bin/bash
+# Read cost vs. cgroup hierarchy shape: builds trees of every DEPTH x FANOUT,
+# charges memory in LEAVES leaves, then measures memory.stat + memory.numa_stat
+# read cost at the tree root, at mid depth and at a populated leaf.
+# Flush and atomic-walk cost (memcg_atomic_walk / memcg_atomic_visit_batch)
+# depend on subtree size and depth, so the result is a matrix per position.
+#
+# Needs root, cgroup v2, ../cgroup_read_test/alloc and ../stat_agent/read_cost:
+#   (cd ../cgroup_read_test && make) && (cd ../stat_agent && make)
+#   sudo DEPTHS="1 2 4 6" FANOUTS="2 4 8" LEAVES=32 ./hierarchy_scaling.sh
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+cd "$SCRIPT_DIR"
+
+DEPTHS="${DEPTHS:-1 2 3 4}"          # levels below CG_ROOT
+FANOUTS="${FANOUTS:-2 4 8}"          # children per inner node
+LEAVES="${LEAVES:-16}"               # populated leaves per tree (spread evenly)
+SIZE="${SIZE:-16M}"                  # memory charged per populated leaf
+READS="${READS:-20000}"              # timed reads per position
+SETTLE="${SETTLE:-2}"                # seconds to wait after charging
+MAX_CGROUPS="${MAX_CGROUPS:-5000}"   # skip shapes larger than this
+CG_ROOT="${CG_ROOT:-/sys/fs/cgroup/scale_bench}"
+ALLOC="${ALLOC_BIN:-../cgroup_read_test/alloc}"
+READ_COST="${READ_COST_BIN:-../stat_agent/read_cost}"
+OUTPUT_DIR="hierarchy_scaling_$(date +%Y%m%d_%H%M%S)"
+
+for bin in "$ALLOC" "$READ_COST"; do
+  if [[ ! -x "$bin" ]]; then
+    echo "Error: $bin not found or not executable (run make first)" >&2
+    exit 1
+  fi
+done
+if ! [[ "$LEAVES" =~ ^[0-9]+$ ]] || (( LEAVES < 1 )); then
+  echo "Error: LEAVES must be at least 1 (the leaf position is a populated leaf)" >&2
+  exit 1
+fi
+if ! mount | grep -q "cgroup2 on /sys/fs/cgroup"; then
+  echo "cgroup v2 not mounted at /sys/fs/cgroup" >&2
+  exit 1
+fi
+if [[ -e "$CG_ROOT" ]]; then
+  echo "Error: $CG_ROOT already exists; remove it or set CG_ROOT" >&2
+  exit 1
+fi
+
+if grep -q "CONFIG_MEMCG_RSTAT_COUNTER=y" /boot/config-$(uname -r) 2>/dev/null; then
+  CURRENT_MODE="RSTAT"
+elif grep -q "CONFIG_MEMCG_ATOMIC_COUNTER=y" /boot/config-$(uname -r) 2>/dev/null; then
+  CURRENT_MODE="ATOMIC"
+else
+  CURRENT_MODE="UNKNOWN"
+fi
+
+mkdir -p "$OUTPUT_DIR"
+RESULTS="$OUTPUT_DIR/results.tsv"
+echo -e "depth\tfanout\tcgroups\tpopulated\tposition\tlevel\tmean_ns\tp50_ns\tp99_ns" > "$RESULTS"
+
+pids=()
+
+teardown() {
+  local p
+  for p in "${pids[@]}"; do
+    kill "$p" 2>/dev/null || true
+  done
+  for p in "${pids[@]}"; do
+    wait "$p" 2>/dev/null || true
+  done
+  pids=()
+  if [[ -d "$CG_ROOT" ]]; then
+    # deepest first; a cgroup can only be removed once it has no children
+    find "$CG_ROOT" -depth -type d -exec rmdir {} \; 2>/dev/null || true
+  fi
+}
+trap teardown EXIT
+
+# Builds CG_ROOT/n<i>/n<j>/... and leaves the leaf paths in LEAF_LIST
+build_tree() {
+  local depth="$1" fanout="$2" l k p
+  local -a level next
+  mkdir "$CG_ROOT"
+  echo "+memory" > /sys/fs/cgroup/cgroup.subtree_control 2>/dev/null || true
+  level=("$CG_ROOT")
+  for ((l = 1; l <= depth; l++)); do
+    next=()
+    for p in "${level[@]}"; do
+      echo "+memory" > "$p/cgroup.subtree_control"
+      for ((k = 0; k < fanout; k++)); do
+        mkdir "$p/n$k"
+        next+=("$p/n$k")
+      done
+    done
+    level=("${next[@]}")
+  done
+  LEAF_LIST=("${level[@]}")
+}
+
+tree_size() {
+  local depth="$1" fanout="$2" l total=0 n=1
+  for ((l = 1; l <= depth; l++)); do
+    n=$((n * fanout))
+    total=$((total + n))
+  done
+  echo "$total"
+}
+
+measure() {
+  local depth="$1" fanout="$2" cgroups="$3" populated="$4" pos="$5" level="$6" path="$7"
+  local out
+  out=$("$READ_COST" -q -n "$READS" "$path")
+  echo -e "${depth}\t${fanout}\t${cgroups}\t${populated}\t${pos}\t${level}\t${out// /\\t}" >> "$RESULTS"
+  printf "  %-5s (level %d): mean %s ns\n" "$pos" "$level" "${out%% *}"
+}
+
+echo "=== Hierarchy scaling: depth x fan-out ==="
+echo "Depths: $DEPTHS | Fan-outs: $FANOUTS | Populated leaves: $LEAVES x $SIZE"
+echo "Kernel mode: $CURRENT_MODE | Reads per position: $READS"
+echo "Results directory: $OUTPUT_DIR"
+echo ""
+
+for depth in $DEPTHS; do
+  for fanout in $FANOUTS; do
+    cgroups=$(tree_size "$depth" "$fanout")
+    if [[ $cgroups -gt $MAX_CGROUPS ]]; then
+      echo "depth=$depth fanout=$fanout: $cgroups cgroups > MAX_CGROUPS, skipped"
+      continue
+    fi
+    echo "depth=$depth fanout=$fanout: $cgroups cgroups"
+    build_tree "$depth" "$fanout"
+
+    nleaves=${#LEAF_LIST[@]}
+    populated=$((LEAVES < nleaves ? LEAVES : nleaves))
+    step=$((nleaves / populated))
+    for ((i = 0; i < populated; i++)); do
+      leaf="${LEAF_LIST[$((i * step))]}"
+      ( echo "$BASHPID" > "$leaf/cgroup.procs" && exec "$ALLOC" "$SIZE" 3600 ) &
+      pids+=("$!")
+    done
+    sleep "$SETTLE"
+
+    # mid level: halfway down the path to the first populated leaf
+    mid_level=$((depth / 2))
+    mid="$CG_ROOT"
+    for ((l = 0; l < mid_level; l++)); do
+      mid="$mid/n0"
+    done
+    measure "$depth" "$fanout" "$cgroups" "$populated" root 0 "$CG_ROOT"
+    measure "$depth" "$fanout" "$cgroups" "$populated" mid "$mid_level" "$mid"
+    measure "$depth" "$fanout" "$cgroups" "$populated" leaf "$depth" "${LEAF_LIST[0]}"
+
+    teardown
+  done
+done
+
+# Matrix of mean read cost per position: rows = depth, columns = fan-out
+{
+  echo "Kernel mode: $CURRENT_MODE, populated leaves: $LEAVES x $SIZE"
+  for pos in root mid leaf; do
+    echo ""
+    echo "=== $pos: mean ns per read (memory.stat + memory.numa_stat) ==="
+    awk -F'\t' -v pos="$pos" -v fanouts="$FANOUTS" '
+      NR > 1 && $5 == pos { v[$1 "," $2] = $7; d[$1] = 1 }
+      END {
+        nf = split(fanouts, f, " ")
+        printf "%-8s", "depth"
+        for (j = 1; j <= nf; j++) printf " %12s", "fanout=" f[j]
+        printf "\n"
+        n = 0
+        for (k in d) ds[++n] = k + 0
+        for (i = 1; i <= n; i++)
+          for (j = i + 1; j <= n; j++)
+            if (ds[j] < ds[i]) { t = ds[i]; ds[i] = ds[j]; ds[j] = t }
+        for (i = 1; i <= n; i++) {
+          printf "%-8d", ds[i]
+          for (j = 1; j <= nf; j++) {
+            key = ds[i] "," f[j]
+            printf " %12s", (key in v) ? v[key] : "-"
+          }
+          printf "\n"
+        }
+      }' "$RESULTS"
+  done
+} > "$OUTPUT_DIR/matrix.txt"
+
+echo ""
+cat "$OUTPUT_DIR/matrix.txt"
+echo ""
+echo "Raw results: $RESULTS"
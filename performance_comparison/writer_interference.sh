@@ -0,0 +1,174 @@
+#!/bin/bash
+# Writer-side interference: how much stat readers slow the allocating workload.
+# WORKERS alloc_lat workers, one per leaf a/b/c/<i>, fault in SIZE over and over
+# and histogram the latency of every first touch (page fault + memcg charge).
+# Meanwhile 0, 1, ... N fleet_agent readers read memory.stat + memory.numa_stat
+# of READ_TARGET in READ_MODE every READ_INTERVAL_MS (0 = back to back).
+# The worker histograms of each run are merged, and the table shows the fault
+# latency percentiles per reader count and the p99 inflation against the
+# first entry of READERS (normally 0 readers).
+#
+# Needs root, cgroup v2 and the leaves from setup_mem.sh, plus
+# ../cgroup_read_test/alloc_lat and ../cgroup_read_test/fleet_agent:
+#   (cd ../cgroup_read_test && make && sudo N=8 ./setup_mem.sh)
+#   sudo WORKERS=8 READERS="0 1 4 16" READ_MODE=once ./writer_interference.sh
+#   sudo READERS="0 8" READ_MODE=cat READ_INTERVAL_MS=10 ./writer_interference.sh
+
+set -euo pipefail
+shopt -s nullglob
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+cd "$SCRIPT_DIR"
+
+WORKERS="${WORKERS:-4}"                  # alloc_lat workers, leaves a/b/c/0..WORKERS-1
+SIZE="${SIZE:-32M}"                      # per worker, keep below the leaf memory.high
+SECS="${SECS:-20}"                       # per run
+READERS="${READERS:-0 1 4}"              # reader counts, one run each
+READ_MODE="${READ_MODE:-once}"           # cat | once | light (see fleet_agent.c)
+READ_INTERVAL_MS="${READ_INTERVAL_MS:-0}"  # per reader, 0 = back to back
+READ_TARGET="${READ_TARGET:-/sys/fs/cgroup/a}"  # cgroup the readers read
+CG_TOP="${CG_TOP:-/sys/fs/cgroup/a}"
+ALLOC_LAT="${ALLOC_LAT_BIN:-../cgroup_read_test/alloc_lat}"
+READER="${READER_BIN:-../cgroup_read_test/fleet_agent}"
+OUTPUT_DIR="writer_interference_$(date +%Y%m%d_%H%M%S)"
+
+for bin in "$ALLOC_LAT" "$READER"; do
+  if [[ ! -x "$bin" ]]; then
+    echo "Error: $bin not found or not executable (make -C ../cgroup_read_test)" >&2
+    exit 1
+  fi
+done
+case "$READ_MODE" in
+  cat|once|light) ;;
+  *) echo "Unknown READ_MODE $READ_MODE (cat, once, light)" >&2; exit 1 ;;
+esac
+for ((i = 0; i < WORKERS; i++)); do
+  if [[ ! -d "$CG_TOP/b/c/$i" ]]; then
+    echo "Missing leaf $CG_TOP/b/c/$i; create them with: N=$WORKERS ../cgroup_read_test/setup_mem.sh" >&2
+    exit 1
+  fi
+done
+if [[ ! -r "$READ_TARGET/memory.stat" ]]; then
+  echo "Error: $READ_TARGET/memory.stat not readable" >&2
+  exit 1
+fi
+
+if grep -q "CONFIG_MEMCG_RSTAT_COUNTER=y" /boot/config-$(uname -r) 2>/dev/null; then
+  CURRENT_MODE="RSTAT"
+elif grep -q "CONFIG_MEMCG_ATOMIC_COUNTER=y" /boot/config-$(uname -r) 2>/dev/null; then
+  CURRENT_MODE="ATOMIC"
+else
+  CURRENT_MODE="UNKNOWN"
+fi
+
+mkdir -p "$OUTPUT_DIR"
+RESULTS="$OUTPUT_DIR/results.tsv"
+echo -e "readers\treads_per_s\treader_cpu_pct\tfaults_per_s\tmean_ns\tp50_ns\tp90_ns\tp99_ns\tp999_ns\tmax_ns\tunmap_mean_us" > "$RESULTS"
+
+pids=()
+teardown() {
+  local p
+  for p in "${pids[@]}"; do
+    kill "$p" 2>/dev/null || true
+  done
+  for p in "${pids[@]}"; do
+    wait "$p" 2>/dev/null || true
+  done
+  pids=()
+}
+trap teardown EXIT
+
+# Merge the "lo hi count" histograms of one run; print p50 p90 p99 p999 max (bucket upper bounds)
+merge_hist() {
+  cat "$@" | awk '
+    { c[$1] += $3; hi[$1] = $2; total += $3 }
+    END {
+      n = 0
+      for (k in c) lo[++n] = k + 0
+      for (i = 2; i <= n; i++) {
+        x = lo[i]
+        for (j = i - 1; j > 0 && lo[j] > x; j--) lo[j + 1] = lo[j]
+        lo[j + 1] = x
+      }
+      split("0.50 0.90 0.99 0.999", q, " ")
+      seen = 0; qi = 1
+      for (i = 1; i <= n && qi <= 4; i++) {
+        seen += c[lo[i]]
+        while (qi <= 4 && seen > int(total * q[qi])) { out[qi++] = hi[lo[i]] }
+      }
+      printf "%s %s %s %s %s\n", out[1], out[2], out[3], out[4], hi[lo[n]]
+    }'
+}
+
+echo "=== Writer interference: $WORKERS workers x $SIZE, ${SECS}s per run ==="
+echo "Readers: $READERS | mode $READ_MODE every ${READ_INTERVAL_MS} ms on $READ_TARGET"
+echo "Kernel mode: $CURRENT_MODE | Results directory: $OUTPUT_DIR"
+echo ""
+
+for nr in $READERS; do
+  run="$OUTPUT_DIR/r$nr"
+  mkdir -p "$run"
+  echo "readers=$nr ..."
+
+  readers=()
+  for ((j = 0; j < nr; j++)); do
+    # a little longer than the workers, so they are never measured without readers
+    "$READER" "$READ_MODE" "$READ_INTERVAL_MS" 10 "$((SECS + 2))" "$READ_TARGET" > "$run/reader_$j.txt" &
+    readers+=("$!")
+    pids+=("$!")
+  done
+  sleep 1
+
+  workers=()
+  for ((i = 0; i < WORKERS; i++)); do
+    leaf="$CG_TOP/b/c/$i"
+    ( echo "$BASHPID" > "$leaf/cgroup.procs" && exec "$ALLOC_LAT" "$SIZE" "$SECS" "$run/hist_$i.txt" ) \
+      > "$run/worker_$i.txt" &
+    workers+=("$!")
+    pids+=("$!")
+  done
+  for p in "${workers[@]}"; do
+    wait "$p"
+  done
+  for p in "${readers[@]}"; do
+    wait "$p" || true
+  done
+  pids=()
+
+  read -r p50 p90 p99 p999 max < <(merge_hist "$run"/hist_*.txt)
+  # exact mean and totals from the worker lines; reader rate and CPU from theirs
+  read -r faults_s mean unmap < <(cat "$run"/worker_*.txt | awk '
+    { for (i = 2; i <= NF; i++) { split($i, kv, "="); v[kv[1]] = kv[2] }
+      f += v["faults"]; fs += v["faults_per_s"]; m += v["mean_ns"] * v["faults"]; u += v["unmap_mean_us"]; n++ }
+    END { printf "%.0f %.0f %.1f\n", fs, f ? m / f : 0, n ? u / n : 0 }')
+  read -r reads_s cpu_pct < <(cat /dev/null "$run"/reader_*.txt | awk '
+    { for (i = 2; i <= NF; i++) { split($i, kv, "="); v[kv[1]] = kv[2] }
+      r += v["ticks"] / v["wall_s"]; c += (v["user_ms"] + v["sys_ms"]) / (v["wall_s"] * 10) }
+    END { printf "%.0f %.1f\n", r, c }')
+  echo -e "${nr}\t${reads_s}\t${cpu_pct}\t${faults_s}\t${mean}\t${p50}\t${p90}\t${p99}\t${p999}\t${max}\t${unmap}" >> "$RESULTS"
+  printf "  faults/s %s, fault p50 %s ns, p99 %s ns, p99.9 %s ns (readers: %s reads/s, %s%% CPU)\n" \
+    "$faults_s" "$p50" "$p99" "$p999" "$reads_s" "$cpu_pct"
+done
+
+{
+  echo "Kernel mode: $CURRENT_MODE, $WORKERS workers x $SIZE, readers $READ_MODE every ${READ_INTERVAL_MS} ms on $READ_TARGET"
+  echo "Fault latency = first touch of a 4 KiB page (fault + memcg charge); percentiles are histogram bucket upper bounds (<= 6.25%)"
+  echo ""
+  awk -F'\t' '
+    NR == 1 { next }
+    NR == 2 { b99 = $8; bf = $4 }
+    {
+      if (NR == 2)
+        printf "%-8s %10s %8s %10s %9s %9s %9s %9s %10s %9s %9s\n", "readers", "reads/s", "rd_cpu%",
+               "faults/s", "mean_ns", "p50_ns", "p99_ns", "p999_ns", "max_ns", "p99_x", "thru_x"
+      printf "%-8s %10s %8s %10s %9s %9s %9s %9s %10s %8.2fx %8.2fx\n", $1, $2, $3, $4, $5, $6, $8, $9, $10,
+             b99 ? $8 / b99 : 0, bf ? $4 / bf : 0
+    }' "$RESULTS"
+  echo ""
+  echo "p99_x: p99 fault latency against the first run; thru_x: faults/s against the first run"
+} > "$OUTPUT_DIR/summary.txt"
+
+echo ""
+cat "$OUTPUT_DIR/summary.txt"
+echo ""
+echo "Raw results: $RESULTS"
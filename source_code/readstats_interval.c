@@ -3,7 +3,8 @@
  *   readstats_interval N [interval_ms]
  *   N > 0: run N iterations
  *   N = 0: run continuously until interrupted (Ctrl-C)
- *   interval_ms > 0 (default 1000 ms)
+ *   interval_ms > 0 (default 1000 ms); iterations start on absolute deadlines
+ *   (start + i * interval_ms), so read time does not accumulate as drift
  */
 #define _POSIX_C_SOURCE 200809L
 #include <fcntl.h>
@@ -52,17 +53,23 @@ static int parse_positive_int(const char *s, int *out) {
     return 0;
 }
 
-static void sleep_ms(int interval_ms) {
-    if (interval_ms <= 0) return;
-    struct timespec ts;
-    ts.tv_sec = interval_ms / 1000;
-    ts.tv_nsec = (long)(interval_ms % 1000) * 1000000L;
-
-    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+// Sleep until an absolute CLOCK_MONOTONIC deadline, so the time spent
+// reading does not add up to drift as a relative sleep would.
+static void sleep_until(const struct timespec *deadline) {
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR) {
         if (g_stop) break; // interrupted by signal; exit early if stopping
     }
 }
 
+static void add_ms(struct timespec *ts, int ms) {
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
 int main(int argc, char *argv[])
 {
     if (argc < 2 || argc > 3) {
@@ -99,6 +106,10 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    // Iteration i starts at start + i * interval_ms
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
     // One iteration body
     // Note: printing only the first snapshot; follow-up iterations can be made compact.
     // Uncomment below printf to show periodic memory.current.
@@ -120,7 +131,8 @@ int main(int argc, char *argv[])
 
         // Sleep between iterations (skip after last when finite)
         if ((n == 0 || i != n - 1) && !g_stop) {
-            sleep_ms(interval_ms);
+            add_ms(&deadline, interval_ms);
+            sleep_until(&deadline);
         }
     }
 
@@ -3,20 +3,158 @@
  * without actual delays between reads for fast performance comparison.
  *
  * Usage:
- *   readstats_realistic <duration_seconds> <reads_per_second>
+ *   readstats_realistic <duration_seconds> <reads_per_second> [sample_every]
  *
  * Example: readstats_realistic 10 1
  *   - Simulates 10 seconds of monitoring with 1 read per second (10 reads total)
  *   - But executes all reads consecutively for fast performance testing
+ *
+ * Example: readstats_realistic 60 1000 10
+ *   - Every 10th read is decomposed: wall time, thread CPU time
+ *     (CLOCK_THREAD_CPUTIME_ID), user/sys split (RUSAGE_THREAD), runqueue
+ *     wait (/proc/thread-self/schedstat run_delay) and context switches.
+ *   - Tail reads (>= p99 of the sampled reads) are classified by cause:
+ *     cpu (kernel work, incl. spinning on the rstat lock), runqueue
+ *     (preempted), blocked (slept, e.g. on a mutex) or other.
+ *
+ * Example: readstats_realistic 10 1 0 evict
+ *   - After the back-to-back run, time every read individually twice:
+ *     hot (back to back) and cold, and print both side by side.
+ *   - Cold pacing "sleep" really waits 1/reads_per_second between reads
+ *     (absolute deadlines, so the run takes duration_seconds); "evict"
+ *     instead streams a buffer larger than the LLC (EVICT_MB, default
+ *     2x L3 or at least 64 MiB, 4 KiB pages so the TLB is flushed too)
+ *     on the same CPU before each read; keep reads_per_second * duration
+ *     small, every eviction costs a pass over that buffer.
  */
+#define _GNU_SOURCE
+#include <errno.h>
 #include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/time.h>
 
+// 每次采样读取的分解结果（单位 ns）
+struct read_sample {
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    uint64_t user_ns;
+    uint64_t sys_ns;
+    uint64_t run_delay_ns;
+    long nvcsw;
+    long nivcsw;
+};
+
+enum read_cause { CAUSE_CPU, CAUSE_RUNQUEUE, CAUSE_BLOCKED, CAUSE_OTHER, CAUSE_NR };
+
+static const char *const cause_names[CAUSE_NR] = {
+    "cpu", "runqueue", "blocked", "other",
+};
+
+struct thread_counters {
+    uint64_t cpu_ns;
+    uint64_t user_ns;
+    uint64_t sys_ns;
+    uint64_t run_delay_ns;
+    long nvcsw;
+    long nivcsw;
+};
+
+static uint64_t clock_ns(clockid_t clk) {
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t tv_ns(const struct timeval *tv) {
+    return (uint64_t)tv->tv_sec * 1000000000ull + (uint64_t)tv->tv_usec * 1000ull;
+}
+
+// /proc/thread-self/schedstat: "<on-cpu ns> <runqueue wait ns> <timeslices>"
+static uint64_t read_run_delay(int f_sched) {
+    char buf[128];
+    ssize_t n = pread(f_sched, buf, sizeof(buf) - 1, 0);
+    unsigned long long on_cpu = 0, run_delay = 0;
+
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+    sscanf(buf, "%llu %llu", &on_cpu, &run_delay);
+    return run_delay;
+}
+
+/*
+ * The thread CPU clock is read closest to the timed read on both sides
+ * (last before, first after) so pread()/getrusage() do not count as CPU.
+ */
+static void read_counters(int f_sched, struct thread_counters *c, int after) {
+    struct rusage ru;
+
+    if (after)
+        c->cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    c->run_delay_ns = f_sched >= 0 ? read_run_delay(f_sched) : 0;
+    getrusage(RUSAGE_THREAD, &ru);
+    c->user_ns = tv_ns(&ru.ru_utime);
+    c->sys_ns = tv_ns(&ru.ru_stime);
+    c->nvcsw = ru.ru_nvcsw;
+    c->nivcsw = ru.ru_nivcsw;
+    if (!after)
+        c->cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+/*
+ * off = wall - cpu is time the thread was not running during the read.
+ * Mostly on CPU -> cpu; off-CPU mostly runqueue wait -> runqueue;
+ * a voluntary switch -> blocked; anything else (irq, steal) -> other.
+ */
+static enum read_cause classify(const struct read_sample *s) {
+    uint64_t off = s->wall_ns > s->cpu_ns ? s->wall_ns - s->cpu_ns : 0;
+
+    if (off * 5 <= s->wall_ns)
+        return CAUSE_CPU;
+    if (s->run_delay_ns * 2 >= off)
+        return CAUSE_RUNQUEUE;
+    if (s->nvcsw > 0)
+        return CAUSE_BLOCKED;
+    return CAUSE_OTHER;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 冷读取的节奏：hot 为连续读取（默认），sleep 真实等待，evict 读前冲刷缓存
+enum pacing { PACE_HOT, PACE_SLEEP, PACE_EVICT };
+
+static const char *const pacing_names[] = { "hot", "sleep", "evict" };
+
+static size_t evict_bytes(void) {
+    const char *env = getenv("EVICT_MB");
+    long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    size_t len = 64ul << 20;
+
+    if (env && atol(env) > 0)
+        return (size_t)atol(env) << 20;
+    if (l3 > 0 && (size_t)l3 * 2 > len)
+        len = (size_t)l3 * 2;
+    return len;
+}
+
+// 每个 cache line 读改写一次：挤掉 L1/L2/LLC 中的内核数据和读缓冲区，
+// 每个 4 KiB 页一次 TLB 查找，buffer 页数远大于 TLB 项数
+static void evict_caches(volatile unsigned char *buf, size_t len) {
+    for (size_t i = 0; i < len; i += 64)
+        buf[i]++;
+}
+
 static void read_stats(int f_memst, int f_memnuma, int read_num) {
     char buf[8192];
     ssize_t n;
@@ -52,20 +190,233 @@ static void read_stats(int f_memst, int f_memnuma, int read_num) {
     if (dummy < 0) printf("Dummy: %d\n", dummy);
 }
 
+// 计时并分解一次读取：计数器快照放在墙钟计时区间之外
+static void sampled_read(int f_memst, int f_memnuma, int f_sched, int read_num,
+                         struct read_sample *s) {
+    struct thread_counters before, after;
+
+    read_counters(f_sched, &before, 0);
+    uint64_t t0 = clock_ns(CLOCK_MONOTONIC);
+    read_stats(f_memst, f_memnuma, read_num);
+    uint64_t t1 = clock_ns(CLOCK_MONOTONIC);
+    read_counters(f_sched, &after, 1);
+
+    s->wall_ns = t1 - t0;
+    s->cpu_ns = after.cpu_ns - before.cpu_ns;
+    s->user_ns = after.user_ns - before.user_ns;
+    s->sys_ns = after.sys_ns - before.sys_ns;
+    s->run_delay_ns = after.run_delay_ns - before.run_delay_ns;
+    s->nvcsw = after.nvcsw - before.nvcsw;
+    s->nivcsw = after.nivcsw - before.nivcsw;
+}
+
+static void report_samples(const struct read_sample *samples, int nsamples,
+                           int sample_every, int have_schedstat) {
+    uint64_t *walls = malloc((size_t)nsamples * sizeof(uint64_t));
+    if (!walls) {
+        perror("malloc");
+        return;
+    }
+    for (int i = 0; i < nsamples; i++)
+        walls[i] = samples[i].wall_ns;
+    qsort(walls, (size_t)nsamples, sizeof(uint64_t), cmp_u64);
+    uint64_t p50 = walls[nsamples / 2];
+    uint64_t p90 = walls[(size_t)nsamples * 90 / 100];
+    uint64_t p99 = walls[(size_t)nsamples * 99 / 100];
+    uint64_t max = walls[nsamples - 1];
+    free(walls);
+
+    printf("\n=== Read decomposition (1 in %d reads, %d sampled) ===\n",
+           sample_every, nsamples);
+    printf("Wall p50/p90/p99/max: %.2f / %.2f / %.2f / %.2f us\n",
+           p50 / 1e3, p90 / 1e3, p99 / 1e3, max / 1e3);
+    printf("Note: cpu_us includes one CLOCK_THREAD_CPUTIME_ID call (a syscall)\n");
+    if (!have_schedstat)
+        printf("Note: /proc/thread-self/schedstat unavailable, run_delay is 0\n");
+
+    // 全部采样 vs 尾部（>= p99）读取的平均构成
+    struct {
+        const char *name;
+        int n;
+        double wall, cpu, user, sys, run_delay, off, nvcsw, nivcsw;
+        int causes[CAUSE_NR];
+    } groups[2] = { { .name = "all" }, { .name = "tail (>= p99)" } };
+
+    for (int i = 0; i < nsamples; i++) {
+        const struct read_sample *s = &samples[i];
+        int ng = s->wall_ns >= p99 ? 2 : 1;
+
+        for (int g = 0; g < ng; g++) {
+            groups[g].n++;
+            groups[g].wall += s->wall_ns;
+            groups[g].cpu += s->cpu_ns;
+            groups[g].user += s->user_ns;
+            groups[g].sys += s->sys_ns;
+            groups[g].run_delay += s->run_delay_ns;
+            groups[g].off += s->wall_ns > s->cpu_ns ? s->wall_ns - s->cpu_ns : 0;
+            groups[g].nvcsw += s->nvcsw;
+            groups[g].nivcsw += s->nivcsw;
+            groups[g].causes[classify(s)]++;
+        }
+    }
+
+    printf("%-14s %6s %10s %10s %10s %10s %8s %8s\n", "reads", "n",
+           "wall_us", "cpu_us", "off_us", "rq_us", "vcsw", "ivcsw");
+    for (int g = 0; g < 2; g++) {
+        double n = groups[g].n ? groups[g].n : 1;
+        printf("%-14s %6d %10.2f %10.2f %10.2f %10.2f %8.3f %8.3f\n",
+               groups[g].name, groups[g].n, groups[g].wall / n / 1e3,
+               groups[g].cpu / n / 1e3, groups[g].off / n / 1e3,
+               groups[g].run_delay / n / 1e3, groups[g].nvcsw / n,
+               groups[g].nivcsw / n);
+    }
+    // RUSAGE_THREAD 的 user/sys 按时钟节拍采样，只看累计比例
+    for (int g = 0; g < 2; g++) {
+        double us = groups[g].user + groups[g].sys;
+        if (us > 0)
+            printf("%-14s user/sys split: %.0f%% / %.0f%% (tick-sampled)\n",
+                   groups[g].name, groups[g].user * 100 / us,
+                   groups[g].sys * 100 / us);
+    }
+
+    printf("Tail reads by cause:");
+    for (int c = 0; c < CAUSE_NR; c++)
+        printf(" %s=%d", cause_names[c], groups[1].causes[c]);
+    printf("\n");
+    int top = 0;
+    for (int c = 1; c < CAUSE_NR; c++)
+        if (groups[1].causes[c] > groups[1].causes[top])
+            top = c;
+    printf("Dominant tail cause: %s (%.0f%% of tail reads)\n", cause_names[top],
+           groups[1].n ? groups[1].causes[top] * 100.0 / groups[1].n : 0.0);
+}
+
+// 逐次计时 n 次读取；sleep/evict 在每次读取前等待或冲刷缓存（不计入读取时间）
+static void timed_reads(int f_memst, int f_memnuma, int n, enum pacing pace,
+                        int reads_per_second, unsigned char *ebuf, size_t elen,
+                        uint64_t *lat) {
+    uint64_t next = clock_ns(CLOCK_MONOTONIC);
+
+    for (int i = 0; i < n; i++) {
+        if (pace == PACE_SLEEP) {
+            next += 1000000000ull / (uint64_t)reads_per_second;
+            struct timespec ts = { (time_t)(next / 1000000000ull),
+                                   (long)(next % 1000000000ull) };
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+                ;
+        } else if (pace == PACE_EVICT) {
+            evict_caches(ebuf, elen);
+        }
+        uint64_t t0 = clock_ns(CLOCK_MONOTONIC);
+        read_stats(f_memst, f_memnuma, i + 1);
+        lat[i] = clock_ns(CLOCK_MONOTONIC) - t0;
+    }
+}
+
+static void lat_summary(uint64_t *lat, int n, double out[5]) {
+    double sum = 0;
+
+    for (int i = 0; i < n; i++)
+        sum += lat[i];
+    qsort(lat, (size_t)n, sizeof(uint64_t), cmp_u64);
+    out[0] = sum / n / 1e3;
+    out[1] = lat[n / 2] / 1e3;
+    out[2] = lat[(size_t)n * 90 / 100] / 1e3;
+    out[3] = lat[(size_t)n * 99 / 100] / 1e3;
+    out[4] = lat[n - 1] / 1e3;
+}
+
+// 同一进程内先热后冷各读 n 次，并排输出
+static int hot_vs_cold(int f_memst, int f_memnuma, int n, enum pacing pace,
+                       int reads_per_second) {
+    uint64_t *lat = malloc((size_t)n * sizeof(uint64_t));
+    unsigned char *ebuf = NULL;
+    size_t elen = 0;
+    double hot[5], cold[5];
+    int cpu = sched_getcpu();
+
+    if (!lat) {
+        perror("malloc");
+        return -1;
+    }
+    // 固定在当前 CPU：冲刷与读取共享同一套 L1/L2 和 TLB
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) < 0)
+            perror("sched_setaffinity");
+    }
+    if (pace == PACE_EVICT) {
+        elen = evict_bytes();
+        ebuf = mmap(NULL, elen, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ebuf == MAP_FAILED) {
+            perror("mmap");
+            free(lat);
+            return -1;
+        }
+        // 先禁用大页再首次触摸：页面以 4 KiB 分配，冲刷时才会换掉 TLB
+        madvise(ebuf, elen, MADV_NOHUGEPAGE);
+        for (size_t off = 0; off < elen; off += 4096)
+            ebuf[off] = 1;
+    }
+
+    timed_reads(f_memst, f_memnuma, n, PACE_HOT, reads_per_second, NULL, 0, lat);
+    lat_summary(lat, n, hot);
+    timed_reads(f_memst, f_memnuma, n, pace, reads_per_second, ebuf, elen, lat);
+    lat_summary(lat, n, cold);
+
+    printf("\n=== Hot vs cold reads (%d each, CPU %d) ===\n", n, cpu);
+    if (pace == PACE_SLEEP)
+        printf("Cold: sleep %.3f ms before each read\n", 1e3 / reads_per_second);
+    else
+        printf("Cold: stream %zu MiB (4 KiB pages) on the same CPU before each read\n",
+               elen >> 20);
+    printf("%-14s %10s %10s %10s %10s %10s\n", "reads (us)", "mean", "p50", "p90",
+           "p99", "max");
+    printf("%-14s %10.2f %10.2f %10.2f %10.2f %10.2f\n", "hot", hot[0], hot[1],
+           hot[2], hot[3], hot[4]);
+    printf("%-14s %10.2f %10.2f %10.2f %10.2f %10.2f\n", pacing_names[pace],
+           cold[0], cold[1], cold[2], cold[3], cold[4]);
+    printf("%-14s %9.2fx %9.2fx %9.2fx %9.2fx %9.2fx\n", "cold / hot",
+           cold[0] / hot[0], cold[1] / hot[1], cold[2] / hot[2], cold[3] / hot[3],
+           cold[4] / hot[4]);
+
+    if (ebuf)
+        munmap(ebuf, elen);
+    free(lat);
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        printf("USAGE: %s <duration_seconds> <reads_per_second>\n", argv[0]);
+    if (argc < 3 || argc > 5) {
+        printf("USAGE: %s <duration_seconds> <reads_per_second> [sample_every] [hot|sleep|evict]\n", argv[0]);
         printf("Example: %s 10 1  # Simulate 10 seconds with 1 read/second (10 total reads)\n", argv[0]);
+        printf("Example: %s 60 1000 10  # Also decompose every 10th read (wall/CPU/runqueue)\n", argv[0]);
+        printf("Example: %s 60 1 0 evict  # Also time each read hot and cache-cold, side by side\n", argv[0]);
         return 1;
     }
 
     int duration_seconds = atoi(argv[1]);
     int reads_per_second = atoi(argv[2]);
+    int sample_every = argc >= 4 ? atoi(argv[3]) : 0;
+    enum pacing pace = PACE_HOT;
 
-    if (duration_seconds <= 0 || reads_per_second <= 0) {
+    if (duration_seconds <= 0 || reads_per_second <= 0 || sample_every < 0) {
         printf("Error: duration and reads_per_second must be positive\n");
         return 1;
     }
+    if (argc == 5) {
+        if (strcmp(argv[4], "sleep") == 0)
+            pace = PACE_SLEEP;
+        else if (strcmp(argv[4], "evict") == 0)
+            pace = PACE_EVICT;
+        else if (strcmp(argv[4], "hot") != 0) {
+            printf("Error: pacing must be hot, sleep or evict\n");
+            return 1;
+        }
+    }
 
     int total_reads = duration_seconds * reads_per_second;
     printf("Simulating %d seconds with %d reads/second = %d total reads\n",
@@ -79,13 +430,28 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // 采样模式：预先分配，避免计时循环中分配内存
+    struct read_sample *samples = NULL;
+    int nsamples = 0, f_sched = -1;
+    if (sample_every > 0) {
+        samples = calloc((size_t)total_reads / sample_every + 1, sizeof(*samples));
+        if (!samples) {
+            perror("calloc");
+            return 1;
+        }
+        f_sched = open("/proc/thread-self/schedstat", O_RDONLY);
+    }
+
     // Record start time
     struct timeval start_time, end_time;
     gettimeofday(&start_time, NULL);
 
     // Perform all reads consecutively (no delays for performance testing)
     for (int i = 0; i < total_reads; i++) {
-        read_stats(f_memst, f_memnuma, i + 1);
+        if (sample_every > 0 && i % sample_every == 0)
+            sampled_read(f_memst, f_memnuma, f_sched, i + 1, &samples[nsamples++]);
+        else
+            read_stats(f_memst, f_memnuma, i + 1);
     }
 
     // Record end time
@@ -100,6 +466,16 @@ int main(int argc, char *argv[]) {
            (elapsed_seconds * 1000000.0) / total_reads);
     printf("Effective rate: %.2f reads/second\n", total_reads / elapsed_seconds);
 
+    if (nsamples > 0) {
+        report_samples(samples, nsamples, sample_every, f_sched >= 0);
+        free(samples);
+    }
+    if (pace != PACE_HOT &&
+        hot_vs_cold(f_memst, f_memnuma, total_reads, pace, reads_per_second) < 0)
+        return 1;
+    if (f_sched >= 0)
+        close(f_sched);
+
     close(f_memst);
     close(f_memnuma);
     return 0;
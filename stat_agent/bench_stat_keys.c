@@ -0,0 +1,181 @@
+/*
+ * Key-name lookup cost: stat_keys perfect hash vs. a strcmp chain over the
+ * same names, plus unit classification vs. the strstr() heuristic used by
+ * source_code/readstat_bin.c.
+ *
+ * The key stream is the names of a memory.stat (or numa_stat) file, one
+ * pass per sample, or every name in stat_keys.def when no file is given.
+ *
+ * Usage:
+ *   bench_stat_keys [-r rounds] [memory.stat]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stat_keys.h"
+#include "util.h"
+
+#define MAX_NAMES	1024
+#define NAME_MAX_LEN	64
+
+static char names[MAX_NAMES][NAME_MAX_LEN];
+static size_t lens[MAX_NAMES];
+static int nnames;
+
+static uint32_t strcmp_chain(const char *name)
+{
+	uint32_t k;
+
+	for (k = 0; k < STAT_KEY_NR; k++)
+		if (strcmp(name, stat_key_name(k)) == 0)
+			return k;
+	return STAT_KEY_UNKNOWN;
+}
+
+static int is_bytes_stat(const char *name)
+{
+	return strstr(name, "anon") || strstr(name, "file") ||
+	       strstr(name, "kernel") || strstr(name, "slab") ||
+	       strstr(name, "shmem") || strstr(name, "vmalloc") ||
+	       strstr(name, "percpu") || strstr(name, "sock") ||
+	       strstr(name, "zswap") || strstr(name, "hugetlb");
+}
+
+static void add_name(const char *s, size_t len)
+{
+	if (nnames == MAX_NAMES || len == 0 || len >= NAME_MAX_LEN)
+		return;
+	memcpy(names[nnames], s, len);
+	names[nnames][len] = '\0';
+	lens[nnames++] = len;
+}
+
+static int load_file(const char *path)
+{
+	char line[4096];
+	FILE *f = fopen(path, "r");
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f))
+		add_name(line, strcspn(line, " \n"));
+	fclose(f);
+	return 0;
+}
+
+/* Every known key must map to itself and unknown names to the fallback. */
+static int self_check(void)
+{
+	static const char *const unknown[] = {
+		"anon2", "fil", "workingset_refault", "pgscan_", "nr_descendants",
+		"a_very_long_key_name_that_no_kernel_prints_at_all",
+	};
+	uint32_t k;
+	size_t i;
+
+	for (k = 0; k < STAT_KEY_NR; k++) {
+		const char *n = stat_key_name(k);
+
+		if (stat_key_lookup(n, strlen(n)) != k) {
+			fprintf(stderr, "lookup(%s) != %u\n", n, k);
+			return -1;
+		}
+	}
+	for (i = 0; i < sizeof(unknown) / sizeof(unknown[0]); i++) {
+		if (stat_key_lookup(unknown[i], strlen(unknown[i])) !=
+		    STAT_KEY_UNKNOWN) {
+			fprintf(stderr, "lookup(%s) is not unknown\n", unknown[i]);
+			return -1;
+		}
+	}
+	for (i = 0; i < (size_t)nnames; i++) {
+		if (stat_key_lookup(names[i], lens[i]) != strcmp_chain(names[i])) {
+			fprintf(stderr, "lookup(%s) disagrees with strcmp\n",
+				names[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	long rounds = 20000, r;
+	volatile uint32_t sink = 0;
+	uint64_t t0, t_hash, t_strcmp, t_unit, t_strstr;
+	uint64_t lookups;
+	int opt, i, known = 0;
+
+	while ((opt = getopt(argc, argv, "r:")) != -1) {
+		switch (opt) {
+		case 'r':
+			rounds = atol(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (rounds <= 0 || argc - optind > 1)
+		goto usage;
+	if (optind < argc) {
+		if (load_file(argv[optind]) < 0)
+			return 1;
+	} else {
+		for (i = 0; i < STAT_KEY_NR; i++)
+			add_name(stat_key_name(i), strlen(stat_key_name(i)));
+	}
+	if (!nnames) {
+		fprintf(stderr, "no key names\n");
+		return 1;
+	}
+	if (self_check() < 0)
+		return 1;
+	for (i = 0; i < nnames; i++)
+		known += stat_key_lookup(names[i], lens[i]) != STAT_KEY_UNKNOWN;
+
+	t0 = now_ns();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < nnames; i++)
+			sink += stat_key_lookup(names[i], lens[i]);
+	t_hash = now_ns() - t0;
+
+	t0 = now_ns();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < nnames; i++)
+			sink += strcmp_chain(names[i]);
+	t_strcmp = now_ns() - t0;
+
+	t0 = now_ns();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < nnames; i++)
+			sink += stat_key_unit(stat_key_lookup(names[i], lens[i]));
+	t_unit = now_ns() - t0;
+
+	t0 = now_ns();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < nnames; i++)
+			sink += is_bytes_stat(names[i]);
+	t_strstr = now_ns() - t0;
+
+	lookups = (uint64_t)rounds * (uint64_t)nnames;
+	printf("=== key lookup: %d names (%d known), %ld rounds ===\n",
+	       nnames, known, rounds);
+	printf("perfect hash:       %.2f ns/key\n", (double)t_hash / lookups);
+	printf("strcmp chain:       %.2f ns/key (%.1fx)\n",
+	       (double)t_strcmp / lookups, (double)t_strcmp / t_hash);
+	printf("unit via hash:      %.2f ns/key\n", (double)t_unit / lookups);
+	printf("is_bytes_stat():    %.2f ns/key (%.1fx)\n",
+	       (double)t_strstr / lookups, (double)t_strstr / t_unit);
+	printf("per sample:         %.0f ns hash, %.0f ns strcmp\n",
+	       (double)t_hash / rounds, (double)t_strcmp / rounds);
+	return 0;
+
+usage:
+	fprintf(stderr, "USAGE: %s [-r rounds] [memory.stat]\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,350 @@
+/*
+ * Benchmark the tsenc block codec on captured memory.stat / memory.numa_stat
+ * snapshots: bytes per counter sample and encode/decode ns per sample.
+ *
+ * Input is the text produced by capture_memstat.sh:
+ *   @ <timestamp_ns> <cgroup path>
+ *   anon 123456
+ *   anon N0=1234 N1=5678          (numa_stat: one series per node)
+ *
+ * Usage:
+ *   bench_tsenc [-b block_samples] [-r rounds] capture.txt
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "tsenc.h"
+#include "util.h"
+
+#define MAX_CGROUPS	4096
+#define HASH_BITS	10
+
+struct series_cg {
+	char *path;
+	uint32_t nser, ser_cap;
+	char **names;
+	int32_t hash[1 << HASH_BITS];
+	size_t nsamp, samp_cap;
+	uint64_t *ts;
+	uint64_t **cols;
+};
+
+static struct series_cg *cgs[MAX_CGROUPS];
+static int ncgs;
+
+static uint32_t str_hash(const char *s)
+{
+	uint32_t h = 2166136261u;
+
+	while (*s)
+		h = (h ^ (uint8_t)*s++) * 16777619u;
+	return h;
+}
+
+static void *xrealloc(void *p, size_t n)
+{
+	p = realloc(p, n);
+	if (!p) {
+		perror("realloc");
+		exit(1);
+	}
+	return p;
+}
+
+static struct series_cg *find_cg(const char *path)
+{
+	struct series_cg *cg;
+	int i;
+
+	for (i = 0; i < ncgs; i++)
+		if (strcmp(cgs[i]->path, path) == 0)
+			return cgs[i];
+	if (ncgs == MAX_CGROUPS) {
+		fprintf(stderr, "too many cgroups (max %d)\n", MAX_CGROUPS);
+		exit(1);
+	}
+	cg = calloc(1, sizeof(*cg));
+	if (!cg) {
+		perror("calloc");
+		exit(1);
+	}
+	cg->path = strdup(path);
+	memset(cg->hash, -1, sizeof(cg->hash));
+	cgs[ncgs++] = cg;
+	return cg;
+}
+
+static uint32_t find_series(struct series_cg *cg, const char *name)
+{
+	uint32_t mask = (1u << HASH_BITS) - 1;
+	uint32_t h = str_hash(name) & mask;
+	size_t i;
+
+	while (cg->hash[h] >= 0) {
+		if (strcmp(cg->names[cg->hash[h]], name) == 0)
+			return (uint32_t)cg->hash[h];
+		h = (h + 1) & mask;
+	}
+	if (cg->nser + 1 >= (1u << HASH_BITS) / 2) {
+		fprintf(stderr, "too many series in %s\n", cg->path);
+		exit(1);
+	}
+	if (cg->nser == cg->ser_cap) {
+		cg->ser_cap = cg->ser_cap ? cg->ser_cap * 2 : 64;
+		cg->names = xrealloc(cg->names, cg->ser_cap * sizeof(char *));
+		cg->cols = xrealloc(cg->cols, cg->ser_cap * sizeof(uint64_t *));
+	}
+	cg->names[cg->nser] = strdup(name);
+	cg->cols[cg->nser] = xrealloc(NULL, cg->samp_cap * sizeof(uint64_t));
+	for (i = 0; i < cg->samp_cap; i++)
+		cg->cols[cg->nser][i] = 0;
+	cg->hash[h] = (int32_t)cg->nser;
+	return cg->nser++;
+}
+
+static void new_sample(struct series_cg *cg, uint64_t ts)
+{
+	size_t i;
+	uint32_t s;
+
+	if (cg->nsamp == cg->samp_cap) {
+		size_t cap = cg->samp_cap ? cg->samp_cap * 2 : 1024;
+
+		cg->ts = xrealloc(cg->ts, cap * sizeof(uint64_t));
+		for (s = 0; s < cg->nser; s++) {
+			cg->cols[s] = xrealloc(cg->cols[s], cap * sizeof(uint64_t));
+			for (i = cg->samp_cap; i < cap; i++)
+				cg->cols[s][i] = 0;
+		}
+		cg->samp_cap = cap;
+	}
+	cg->ts[cg->nsamp] = ts;
+	/* carry values forward so series missing from a snapshot stay flat */
+	if (cg->nsamp > 0)
+		for (s = 0; s < cg->nser; s++)
+			cg->cols[s][cg->nsamp] = cg->cols[s][cg->nsamp - 1];
+	cg->nsamp++;
+}
+
+static void set_value(struct series_cg *cg, const char *name, uint64_t v)
+{
+	uint32_t s = find_series(cg, name);
+
+	cg->cols[s][cg->nsamp - 1] = v;
+}
+
+static void load_capture(const char *file)
+{
+	struct series_cg *cg = NULL;
+	char *line = NULL, *save, *key, *tok;
+	char name[256];
+	size_t cap = 0;
+	ssize_t len;
+	FILE *fp;
+
+	fp = fopen(file, "r");
+	if (!fp) {
+		perror(file);
+		exit(1);
+	}
+	while ((len = getline(&line, &cap, fp)) > 0) {
+		if (line[len - 1] == '\n')
+			line[len - 1] = '\0';
+		if (line[0] == '@') {
+			unsigned long long ts;
+			char path[512];
+
+			if (sscanf(line, "@ %llu %511s", &ts, path) != 2) {
+				fprintf(stderr, "bad snapshot header: %s\n", line);
+				exit(1);
+			}
+			cg = find_cg(path);
+			new_sample(cg, ts);
+			continue;
+		}
+		if (!cg || !line[0])
+			continue;
+		key = strtok_r(line, " ", &save);
+		while ((tok = strtok_r(NULL, " ", &save)) != NULL) {
+			char *eq = strchr(tok, '=');
+
+			if (eq) {
+				*eq = '\0';
+				snprintf(name, sizeof(name), "%s:%s", key, tok);
+				set_value(cg, name, strtoull(eq + 1, NULL, 10));
+			} else {
+				set_value(cg, key, strtoull(tok, NULL, 10));
+			}
+		}
+	}
+	free(line);
+	fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t block = 256;
+	int rounds = 5, opt, i, r;
+	uint64_t enc_best = UINT64_MAX, dec_best = UINT64_MAX;
+	size_t enc_bytes = 0, counter_samples = 0, rows = 0, max_ser = 0;
+	size_t nblocks = 0, bound;
+	uint8_t **blobs;
+	size_t *blob_len;
+	uint64_t *scratch, *ts_out, *val_out;
+
+	while ((opt = getopt(argc, argv, "b:r:")) != -1) {
+		switch (opt) {
+		case 'b':
+			block = (uint32_t)atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || block < 2 || block > TSENC_BLOCK_MAX ||
+	    rounds <= 0)
+		goto usage;
+
+	load_capture(argv[optind]);
+	if (ncgs == 0) {
+		fprintf(stderr, "no snapshots in %s\n", argv[optind]);
+		return 1;
+	}
+	for (i = 0; i < ncgs; i++) {
+		nblocks += (cgs[i]->nsamp + block - 1) / block;
+		rows += cgs[i]->nsamp;
+		counter_samples += cgs[i]->nsamp * cgs[i]->nser;
+		if (cgs[i]->nser > max_ser)
+			max_ser = cgs[i]->nser;
+	}
+	bound = tsenc_block_bound(block, (uint32_t)max_ser);
+	blobs = calloc(nblocks, sizeof(*blobs));
+	blob_len = calloc(nblocks, sizeof(*blob_len));
+	scratch = malloc(max_ser * block * sizeof(uint64_t) + 8);
+	val_out = malloc(max_ser * block * sizeof(uint64_t) + 8);
+	ts_out = malloc(block * sizeof(uint64_t));
+	if (!blobs || !blob_len || !scratch || !val_out || !ts_out) {
+		perror("malloc");
+		return 1;
+	}
+	for (i = 0; i < (int)nblocks; i++) {
+		blobs[i] = malloc(bound);
+		if (!blobs[i]) {
+			perror("malloc");
+			return 1;
+		}
+	}
+
+	/* Encode: copy each block into a column-major scratch, time the codec only */
+	for (r = 0; r < rounds; r++) {
+		uint64_t total = 0;
+		size_t b = 0;
+
+		enc_bytes = 0;
+		for (i = 0; i < ncgs; i++) {
+			struct series_cg *cg = cgs[i];
+			size_t off;
+
+			for (off = 0; off < cg->nsamp; off += block, b++) {
+				uint32_t n = (uint32_t)(cg->nsamp - off < block ?
+						cg->nsamp - off : block);
+				uint64_t t0;
+				uint32_t s;
+
+				for (s = 0; s < cg->nser; s++)
+					memcpy(scratch + (size_t)s * block,
+					       cg->cols[s] + off, n * sizeof(uint64_t));
+				t0 = now_ns();
+				blob_len[b] = tsenc_encode_block(cg->ts + off, scratch,
+						n, cg->nser, block, blobs[b]);
+				total += now_ns() - t0;
+				enc_bytes += blob_len[b];
+			}
+		}
+		if (total < enc_best)
+			enc_best = total;
+	}
+
+	/* Decode, verifying the round trip on the first pass */
+	for (r = 0; r < rounds; r++) {
+		uint64_t total = 0;
+		size_t b = 0;
+
+		for (i = 0; i < ncgs; i++) {
+			struct series_cg *cg = cgs[i];
+			size_t off;
+
+			for (off = 0; off < cg->nsamp; off += block, b++) {
+				uint32_t n = (uint32_t)(cg->nsamp - off < block ?
+						cg->nsamp - off : block);
+				uint64_t t0 = now_ns();
+				uint32_t s;
+
+				if (tsenc_decode_block(blobs[b], blob_len[b], ts_out,
+						       val_out, block) < 0) {
+					fprintf(stderr, "decode failed: %s block %zu\n",
+						cg->path, off / block);
+					return 1;
+				}
+				total += now_ns() - t0;
+				if (r)
+					continue;
+				if (memcmp(ts_out, cg->ts + off, n * sizeof(uint64_t))) {
+					fprintf(stderr, "timestamp mismatch: %s\n", cg->path);
+					return 1;
+				}
+				for (s = 0; s < cg->nser; s++)
+					if (memcmp(val_out + (size_t)s * block,
+						   cg->cols[s] + off, n * sizeof(uint64_t))) {
+						fprintf(stderr, "value mismatch: %s %s\n",
+							cg->path, cg->names[s]);
+						return 1;
+					}
+			}
+		}
+		if (total < dec_best)
+			dec_best = total;
+	}
+
+	printf("=== tsenc on %s ===\n", argv[optind]);
+	printf("cgroups:            %d\n", ncgs);
+	printf("snapshots:          %zu\n", rows);
+	printf("counter samples:    %zu\n", counter_samples);
+	printf("block samples:      %u (%zu blocks)\n", block, nblocks);
+	printf("raw bytes:          %zu (8 B/value + 8 B/timestamp)\n",
+	       counter_samples * 8 + rows * 8);
+	printf("encoded bytes:      %zu\n", enc_bytes);
+	printf("bytes/sample:       %.3f (%.2f bits)\n",
+	       (double)enc_bytes / counter_samples,
+	       (double)enc_bytes * 8 / counter_samples);
+	printf("compression ratio:  %.1fx\n",
+	       (double)(counter_samples * 8 + rows * 8) / enc_bytes);
+	printf("encode:             %.2f ns/sample (best of %d)\n",
+	       (double)enc_best / counter_samples, rounds);
+	printf("decode:             %.2f ns/sample (best of %d)\n",
+	       (double)dec_best / counter_samples, rounds);
+	printf("1 Hz week per cgroup: %.2f MiB\n",
+	       (double)enc_bytes / rows * 86400 * 7 / (1024 * 1024));
+
+	for (i = 0; i < (int)nblocks; i++)
+		free(blobs[i]);
+	free(blobs);
+	free(blob_len);
+	free(scratch);
+	free(val_out);
+	free(ts_out);
+	return 0;
+
+usage:
+	fprintf(stderr, "USAGE: %s [-b block_samples] [-r rounds] capture.txt\n",
+		argv[0]);
+	fprintf(stderr, "  block_samples: 2..%d (default 256)\n", TSENC_BLOCK_MAX);
+	return 1;
+}
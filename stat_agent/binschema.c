@@ -0,0 +1,533 @@
+/*
+ * stat_bin schema discovery and checks. See binschema.h.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include "binschema.h"
+
+#define NT_GNU_BUILD_ID		3
+
+static const char *const state_names[] = {
+	[BINSCHEMA_UNKNOWN]  = "unknown",
+	[BINSCHEMA_ORDER]    = "order",
+	[BINSCHEMA_VERIFIED] = "verified",
+};
+
+static inline uint32_t bin_section(uint32_t key)
+{
+	return (key >> 16) & 0x7fff;
+}
+
+static inline uint32_t bin_idx(uint32_t key)
+{
+	return key & 0xffff;
+}
+
+static inline int bin_mapped_key(uint32_t key)
+{
+	return STATPARSE_IS_BIN_KEY(key) && bin_section(key) < BINSCHEMA_SECTIONS &&
+	       bin_idx(key) < BINSCHEMA_MAX_IDX;
+}
+
+int binschema_build_id(char *out, size_t len)
+{
+	uint8_t notes[4096];
+	struct utsname u;
+	uint32_t h = 2166136261u;
+	ssize_t n = -1;
+	size_t off = 0, i;
+	int fd;
+
+	fd = open("/sys/kernel/notes", O_RDONLY);
+	if (fd >= 0) {
+		n = read(fd, notes, sizeof(notes));
+		close(fd);
+	}
+	/* Elf_Nhdr: namesz, descsz, type; name and desc padded to 4 bytes */
+	while (n > 0 && off + 12 <= (size_t)n) {
+		uint32_t namesz, descsz, type;
+		size_t name_off = off + 12, desc_off;
+
+		memcpy(&namesz, notes + off, 4);
+		memcpy(&descsz, notes + off + 4, 4);
+		memcpy(&type, notes + off + 8, 4);
+		desc_off = name_off + ((namesz + 3) & ~3u);
+		if (desc_off + descsz > (size_t)n)
+			break;
+		if (type == NT_GNU_BUILD_ID && namesz == 4 &&
+		    memcmp(notes + name_off, "GNU", 4) == 0 &&
+		    descsz * 2 < len) {
+			for (i = 0; i < descsz; i++)
+				snprintf(out + i * 2, 3, "%02x", notes[desc_off + i]);
+			return 0;
+		}
+		off = desc_off + ((descsz + 3) & ~3u);
+	}
+
+	if (uname(&u) < 0)
+		return -1;
+	for (i = 0; u.release[i]; i++)
+		h = (h ^ (uint8_t)u.release[i]) * 16777619u;
+	for (i = 0; u.version[i]; i++)
+		h = (h ^ (uint8_t)u.version[i]) * 16777619u;
+	snprintf(out, len, "uts-%08x", h);
+	return 0;
+}
+
+void binschema_init(struct binschema *s, const char *build_id)
+{
+	uint32_t sec, i;
+
+	memset(s, 0, sizeof(*s));
+	snprintf(s->build_id, sizeof(s->build_id), "%s", build_id);
+	for (sec = 0; sec < BINSCHEMA_SECTIONS; sec++)
+		for (i = 0; i < BINSCHEMA_MAX_IDX; i++)
+			s->e[sec][i].key = BINSCHEMA_NO_KEY;
+}
+
+int binschema_disc_init(struct binschema_disc *d)
+{
+	memset(d, 0, sizeof(*d));
+	return 0;
+}
+
+void binschema_disc_destroy(struct binschema_disc *d)
+{
+	free(d->bkey);
+	free(d->tkey);
+	free(d->hit);
+	free(d->nonzero);
+	free(d->tval);
+	memset(d, 0, sizeof(*d));
+}
+
+/* Fix the bin and text key lists from the first round. */
+static int disc_setup(struct binschema_disc *d, const struct stat_sample *text,
+		      const struct stat_sample *bin)
+{
+	uint32_t i;
+
+	d->bkey = malloc(bin->n * sizeof(*d->bkey) + 1);
+	d->tkey = malloc(text->n * sizeof(*d->tkey) + 1);
+	if (!d->bkey || !d->tkey)
+		return -1;
+	for (i = 0; i < bin->n; i++)
+		if (bin_mapped_key(bin->e[i].key))
+			d->bkey[d->nb++] = bin->e[i].key;
+	for (i = 0; i < text->n; i++)
+		if (text->e[i].node == STATPARSE_NODE_NONE &&
+		    text->e[i].key < STATPARSE_MAX_KEYS)
+			d->tkey[d->nt++] = text->e[i].key;
+	d->hit = calloc((size_t)d->nb * d->nt * 2 + 1, sizeof(*d->hit));
+	d->nonzero = calloc(d->nb + 1, sizeof(*d->nonzero));
+	d->tval = malloc((d->nt + 1) * sizeof(*d->tval));
+	return d->hit && d->nonzero && d->tval ? 0 : -1;
+}
+
+int binschema_disc_add(struct binschema_disc *d, const struct stat_sample *text,
+		       const struct stat_sample *bin, uint32_t page_size)
+{
+	uint32_t b, t, i;
+
+	if (!d->rounds) {
+		d->page_size = page_size;
+		if (disc_setup(d, text, bin) < 0)
+			return -1;
+	}
+	if (d->rounds == UINT16_MAX)
+		return 0;
+
+	/* text values in first-round order; same layout each read */
+	for (t = 0; t < d->nt; t++) {
+		d->tval[t] = UINT64_MAX;
+		if (t < text->n && text->e[t].key == d->tkey[t] &&
+		    text->e[t].node == STATPARSE_NODE_NONE) {
+			d->tval[t] = text->e[t].value;
+			continue;
+		}
+		for (i = 0; i < text->n; i++)
+			if (text->e[i].key == d->tkey[t] &&
+			    text->e[i].node == STATPARSE_NODE_NONE) {
+				d->tval[t] = text->e[i].value;
+				break;
+			}
+	}
+
+	for (b = 0, i = 0; i < bin->n && b < d->nb; i++) {
+		uint16_t *hit;
+		uint64_t v;
+
+		if (bin->e[i].key != d->bkey[b])
+			continue;
+		v = bin->e[i].value;
+		hit = d->hit + (size_t)b * d->nt * 2;
+		if (v)
+			d->nonzero[b]++;
+		for (t = 0; t < d->nt; t++) {
+			if (v == d->tval[t])
+				hit[t * 2]++;
+			else if (v && v * d->page_size == d->tval[t])
+				hit[t * 2 + 1]++;
+		}
+		b++;
+	}
+	d->rounds++;
+	return 0;
+}
+
+struct disc_pick {
+	uint16_t best;
+	uint32_t ties;
+	uint32_t t;
+	uint8_t pages;
+	uint8_t state;
+};
+
+/* A (t, pages) pair of b that scored the tied best. */
+static int disc_candidate(const struct binschema_disc *d,
+			  const struct disc_pick *pk, uint32_t b, uint32_t t,
+			  uint32_t need, uint8_t *pages)
+{
+	const uint16_t *hit = d->hit + ((size_t)b * d->nt + t) * 2;
+
+	if (pk[b].best < need)
+		return 0;
+	if (hit[0] == pk[b].best) {
+		*pages = 0;
+		return 1;
+	}
+	if (hit[1] == pk[b].best) {
+		*pages = 1;
+		return 1;
+	}
+	return 0;
+}
+
+void binschema_disc_finish(const struct binschema_disc *d,
+			   struct binschema *s)
+{
+	uint32_t need = d->rounds - d->rounds / 4, b, t, sec;
+	int unit_pages[STAT_UNIT_UNKNOWN + 1] = { 0 };
+	enum stat_unit u;
+	struct disc_pick *pk = calloc(d->nb + 1, sizeof(*pk));
+	uint32_t *owner = malloc((d->nt + 1) * sizeof(*owner));
+
+	if (!need)
+		need = 1;
+	if (!pk || !owner)
+		goto out;
+	s->page_size = d->page_size;
+
+	/* best pair of every bin entry; unique and non-zero = verified */
+	for (t = 0; t < d->nt; t++)
+		owner[t] = UINT32_MAX;
+	for (b = 0; b < d->nb; b++) {
+		const uint16_t *hit = d->hit + (size_t)b * d->nt * 2;
+
+		for (t = 0; t < d->nt * 2; t++) {
+			if (hit[t] > pk[b].best) {
+				pk[b].best = hit[t];
+				pk[b].ties = 1;
+				pk[b].t = t / 2;
+				pk[b].pages = t & 1;
+			} else if (hit[t] && hit[t] == pk[b].best) {
+				pk[b].ties++;
+			}
+		}
+		if (pk[b].best < need || pk[b].ties != 1 || !d->nonzero[b])
+			continue;
+		t = pk[b].t;
+		if (owner[t] == UINT32_MAX) {
+			owner[t] = b;
+			pk[b].state = BINSCHEMA_VERIFIED;
+		} else if (pk[owner[t]].best < pk[b].best) {
+			pk[owner[t]].state = BINSCHEMA_UNKNOWN;
+			owner[t] = b;
+			pk[b].state = BINSCHEMA_VERIFIED;
+		} else if (pk[owner[t]].best == pk[b].best) {
+			/* two entries claim one key equally: trust neither */
+			pk[owner[t]].state = BINSCHEMA_UNKNOWN;
+		}
+	}
+	for (t = 0; t < d->nt; t++)
+		if (owner[t] != UINT32_MAX &&
+		    pk[owner[t]].state != BINSCHEMA_VERIFIED)
+			owner[t] = UINT32_MAX;
+
+	/*
+	 * Runs of ambiguous entries between two verified ones, in bin order,
+	 * against the unclaimed text keys between their text positions.
+	 */
+	for (b = 0; b < d->nb;) {
+		uint32_t a = b, c, k, hi, n = 0;
+		int64_t lo;
+		int ok = 1;
+
+		if (pk[b].state == BINSCHEMA_VERIFIED) {
+			b++;
+			continue;
+		}
+		for (c = b; c < d->nb && pk[c].state != BINSCHEMA_VERIFIED; c++)
+			;
+		b = c;
+		/* bounded by verified neighbours, or the start / end of the text */
+		lo = a ? (int64_t)pk[a - 1].t : -1;
+		hi = c < d->nb ? pk[c].t : d->nt;
+		if (lo >= (int64_t)hi)
+			continue;
+		for (t = (uint32_t)(lo + 1); t < hi; t++)
+			if (owner[t] == UINT32_MAX)
+				n++;
+		if (n != c - a)
+			continue;
+		for (k = a, t = (uint32_t)(lo + 1); k < c && ok; k++, t++) {
+			while (owner[t] != UINT32_MAX)
+				t++;
+			ok = disc_candidate(d, pk, k, t, need, &pk[k].pages);
+			pk[k].t = t;
+		}
+		if (!ok)
+			continue;
+		for (k = a; k < c; k++) {
+			pk[k].state = BINSCHEMA_ORDER;
+			owner[pk[k].t] = k;
+		}
+	}
+
+	/*
+	 * Zeros match at either scale: give ORDER entries the scale most
+	 * verified entries of the same unit have.
+	 */
+	for (b = 0; b < d->nb; b++)
+		if (pk[b].state == BINSCHEMA_VERIFIED) {
+			t = d->tkey[pk[b].t];
+			u = t < STAT_KEY_NR ? stat_key_unit(t) : STAT_UNIT_UNKNOWN;
+			unit_pages[u] += pk[b].pages ? 1 : -1;
+		}
+	for (b = 0; b < d->nb; b++)
+		if (pk[b].state == BINSCHEMA_ORDER) {
+			t = d->tkey[pk[b].t];
+			u = t < STAT_KEY_NR ? stat_key_unit(t) : STAT_UNIT_UNKNOWN;
+			pk[b].pages = unit_pages[u] > 0;
+		}
+
+	for (b = 0; b < d->nb; b++) {
+		struct binschema_entry *e;
+
+		sec = bin_section(d->bkey[b]);
+		e = &s->e[sec][bin_idx(d->bkey[b])];
+		e->present = 1;
+		e->state = pk[b].state;
+		if (pk[b].state == BINSCHEMA_UNKNOWN) {
+			e->key = BINSCHEMA_NO_KEY;
+			e->pages = 0;
+			s->nunknown++;
+			continue;
+		}
+		e->key = d->tkey[pk[b].t];
+		e->pages = pk[b].pages;
+		if (pk[b].state == BINSCHEMA_VERIFIED)
+			s->nverified++;
+		else
+			s->norder++;
+	}
+out:
+	free(pk);
+	free(owner);
+}
+
+static inline uint64_t scaled(const struct binschema *s,
+			      const struct binschema_entry *e, uint64_t v)
+{
+	return e->pages ? v * s->page_size : v;
+}
+
+void binschema_verify(struct binschema *s, const struct stat_sample *text,
+		      const struct stat_sample *bin,
+		      struct binschema_check *res)
+{
+	uint64_t tv[STATPARSE_MAX_KEYS];
+	uint8_t have[STATPARSE_MAX_KEYS];
+	uint32_t i;
+
+	memset(res, 0, sizeof(*res));
+	memset(have, 0, sizeof(have));
+	for (i = 0; i < text->n; i++)
+		if (text->e[i].node == STATPARSE_NODE_NONE &&
+		    text->e[i].key < STATPARSE_MAX_KEYS) {
+			tv[text->e[i].key] = text->e[i].value;
+			have[text->e[i].key] = 1;
+		}
+
+	for (i = 0; i < bin->n; i++) {
+		struct binschema_entry *e;
+		uint64_t v, t, diff;
+
+		if (!bin_mapped_key(bin->e[i].key)) {
+			if (bin_section(bin->e[i].key) < BINSCHEMA_SECTIONS)
+				res->unmapped++;
+			continue;
+		}
+		e = &s->e[bin_section(bin->e[i].key)][bin_idx(bin->e[i].key)];
+		if (e->key == BINSCHEMA_NO_KEY) {
+			res->unmapped++;
+			continue;
+		}
+		if (e->key >= STATPARSE_MAX_KEYS || !have[e->key]) {
+			res->missing++;
+			continue;
+		}
+		v = scaled(s, e, bin->e[i].value);
+		t = tv[e->key];
+		diff = v > t ? v - t : t - v;
+		if (e->state == BINSCHEMA_VERIFIED) {
+			res->checked++;
+			if (diff * 100 > t * BINSCHEMA_TOL_PCT &&
+			    diff > scaled(s, e, BINSCHEMA_TOL_ABS))
+				res->mismatched++;
+		} else if (t && (bin->e[i].value == t ||
+				 bin->e[i].value * s->page_size == t)) {
+			/* the scale was a guess until now */
+			e->pages = bin->e[i].value != t;
+			e->state = BINSCHEMA_VERIFIED;
+			s->norder--;
+			s->nverified++;
+			res->promoted++;
+		} else if (diff) {
+			e->state = BINSCHEMA_UNKNOWN;
+			e->key = BINSCHEMA_NO_KEY;
+			s->norder--;
+			s->nunknown++;
+			res->demoted++;
+		}
+	}
+}
+
+int binschema_translate(const struct binschema *s,
+			const struct stat_sample *bin, struct stat_sample *out,
+			int verified_only)
+{
+	uint32_t i;
+
+	out->n = 0;
+	out->truncated = bin->truncated;
+	for (i = 0; i < bin->n; i++) {
+		const struct binschema_entry *e;
+		struct stat_entry *o;
+
+		if (!bin_mapped_key(bin->e[i].key))
+			continue;
+		e = &s->e[bin_section(bin->e[i].key)][bin_idx(bin->e[i].key)];
+		if (e->state == BINSCHEMA_UNKNOWN ||
+		    (verified_only && e->state != BINSCHEMA_VERIFIED))
+			continue;
+		o = &out->e[out->n++];
+		o->key = e->key;
+		o->node = STATPARSE_NODE_NONE;
+		o->value = scaled(s, e, bin->e[i].value);
+	}
+	return (int)out->n;
+}
+
+int binschema_path(const struct binschema *s, const char *dir, char *out,
+		   size_t len)
+{
+	int n = snprintf(out, len, "%s/binschema-%s.txt", dir, s->build_id);
+
+	return n < 0 || (size_t)n >= len ? -1 : 0;
+}
+
+int binschema_load(struct binschema *s, const char *path)
+{
+	char line[256], id[80], name[128], state[16];
+	unsigned sec, idx, pages, page_size, st;
+	FILE *fp = fopen(path, "r");
+
+	if (!fp)
+		return -1;
+	if (!fgets(line, sizeof(line), fp) ||
+	    sscanf(line, "# binschema 1 %79s page_size %u", id, &page_size) != 2 ||
+	    strcmp(id, s->build_id) != 0) {
+		fclose(fp);
+		return -1;
+	}
+	binschema_init(s, id);
+	s->page_size = page_size;
+	while (fgets(line, sizeof(line), fp)) {
+		struct binschema_entry *e;
+
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%u %u %15s %u %127s", &sec, &idx, state, &pages,
+			   name) != 5 || sec >= BINSCHEMA_SECTIONS ||
+		    idx >= BINSCHEMA_MAX_IDX)
+			goto bad;
+		for (st = 0; st <= BINSCHEMA_VERIFIED; st++)
+			if (strcmp(state, state_names[st]) == 0)
+				break;
+		if (st > BINSCHEMA_VERIFIED)
+			goto bad;
+		e = &s->e[sec][idx];
+		e->present = 1;
+		e->pages = pages ? 1 : 0;
+		e->state = (uint8_t)st;
+		e->key = BINSCHEMA_NO_KEY;
+		if (st != BINSCHEMA_UNKNOWN && strcmp(name, "-") != 0)
+			e->key = statparse_key(name, strlen(name));
+		if (e->key == BINSCHEMA_NO_KEY || e->key >= STATPARSE_MAX_KEYS) {
+			e->key = BINSCHEMA_NO_KEY;
+			e->state = BINSCHEMA_UNKNOWN;
+		}
+		if (e->state == BINSCHEMA_VERIFIED)
+			s->nverified++;
+		else if (e->state == BINSCHEMA_ORDER)
+			s->norder++;
+		else
+			s->nunknown++;
+	}
+	fclose(fp);
+	return 0;
+bad:
+	fclose(fp);
+	binschema_init(s, id);
+	return -1;
+}
+
+int binschema_save(const struct binschema *s, const char *path)
+{
+	char tmp[4096];
+	uint32_t sec, idx;
+	FILE *fp;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+		return -1;
+	fp = fopen(tmp, "w");
+	if (!fp)
+		return -1;
+	fprintf(fp, "# binschema 1 %s page_size %u\n", s->build_id, s->page_size);
+	fprintf(fp, "# section idx state pages name unit\n");
+	for (sec = 0; sec < BINSCHEMA_SECTIONS; sec++)
+		for (idx = 0; idx < BINSCHEMA_MAX_IDX; idx++) {
+			const struct binschema_entry *e = &s->e[sec][idx];
+			const char *name = NULL;
+
+			if (!e->present)
+				continue;
+			if (e->key != BINSCHEMA_NO_KEY)
+				name = statparse_key_name(e->key);
+			fprintf(fp, "%u %u %s %u %s %s\n", sec, idx,
+				state_names[e->state], e->pages, name ? name : "-",
+				e->key < STAT_KEY_NR ?
+				stat_unit_name(stat_key_unit(e->key)) : "unknown");
+		}
+	if (fclose(fp) != 0 || rename(tmp, path) < 0) {
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
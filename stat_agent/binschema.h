@@ -0,0 +1,119 @@
+/*
+ * Names for memory.stat_bin indices, discovered from the text interface.
+ *
+ * stat_bin entries carry only (section, idx, value). Discovery reads text
+ * memory.stat and memory.stat_bin of one cgroup back to back for a number of
+ * rounds, ideally with its workload quiet, and scores every (bin entry,
+ * text key) pair whose values are equal, or equal once the bin value is
+ * multiplied by the page size. A bin entry whose best pair matched in
+ * (nearly) every round, with a non-zero value and no tie, is VERIFIED. Runs
+ * of entries that stayed ambiguous (typically counters that were zero all
+ * along) between two verified neighbours, or the start or end, are assigned
+ * in order to the unclaimed text keys between the same points of the text,
+ * if the counts agree and each pick was among the tied best. Their scale is
+ * the one most verified entries of the same unit have. Such entries are
+ * ORDER, usable but not proven. Everything else stays UNKNOWN.
+ *
+ * Schemas belong to a kernel build (GNU build id from /sys/kernel/notes)
+ * and are cached as text, by name, so later runs of the same kernel skip
+ * discovery. binschema_verify() re-checks a schema against another
+ * text/bin pair: verified entries must still agree (within tolerance,
+ * since the two reads are not atomic), ORDER entries are promoted once they
+ * match with a non-zero value and dropped if they disagree.
+ *
+ * numa_stat_bin entries (section 2) are not mapped: they carry no node.
+ */
+#ifndef BINSCHEMA_H
+#define BINSCHEMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "statparse.h"
+
+#define BINSCHEMA_SECTIONS	2	/* stats, events */
+#define BINSCHEMA_MAX_IDX	1024
+#define BINSCHEMA_NO_KEY	UINT32_MAX
+#define BINSCHEMA_TOL_PCT	1	/* verify: allowed drift between reads */
+#define BINSCHEMA_TOL_ABS	64	/* ... and at least this many bin units */
+
+enum binschema_state {
+	BINSCHEMA_UNKNOWN,
+	BINSCHEMA_ORDER,
+	BINSCHEMA_VERIFIED,
+};
+
+struct binschema_entry {
+	uint32_t key;			/* statparse key id, BINSCHEMA_NO_KEY */
+	uint8_t state;
+	uint8_t pages;			/* bin value in pages, text in bytes */
+	uint8_t present;		/* seen in stat_bin */
+};
+
+struct binschema {
+	char build_id[80];
+	uint32_t page_size;
+	uint32_t nverified, norder, nunknown;
+	struct binschema_entry e[BINSCHEMA_SECTIONS][BINSCHEMA_MAX_IDX];
+};
+
+/* Discovery state; the pair list is fixed by the first round. */
+struct binschema_disc {
+	uint32_t rounds;
+	uint32_t page_size;
+	uint32_t nb, nt;
+	uint32_t *bkey;			/* [nb] STATPARSE_BIN_KEY, bin order */
+	uint32_t *tkey;			/* [nt] text key ids, text order */
+	uint16_t *hit;			/* [(b * nt + t) * 2 + pages] */
+	uint16_t *nonzero;		/* [nb] rounds with a non-zero bin value */
+	uint64_t *tval;			/* [nt] scratch */
+};
+
+struct binschema_check {
+	uint32_t checked;		/* verified entries compared */
+	uint32_t mismatched;		/* beyond tolerance */
+	uint32_t missing;		/* mapped key absent from the text read */
+	uint32_t unmapped;		/* bin entries without a mapping */
+	uint32_t promoted;		/* ORDER -> VERIFIED */
+	uint32_t demoted;		/* ORDER -> UNKNOWN, value disagreed */
+};
+
+/*
+ * GNU build id of the running kernel as hex, or "uts-<hash>" of uname's
+ * release and version if /sys/kernel/notes has none. Returns 0 or -1.
+ */
+int binschema_build_id(char *out, size_t len);
+
+void binschema_init(struct binschema *s, const char *build_id);
+
+int binschema_disc_init(struct binschema_disc *d);
+void binschema_disc_destroy(struct binschema_disc *d);
+/* One back-to-back pair of reads: text memory.stat and memory.stat_bin. */
+int binschema_disc_add(struct binschema_disc *d, const struct stat_sample *text,
+		       const struct stat_sample *bin, uint32_t page_size);
+/* Build the schema from the rounds so far. */
+void binschema_disc_finish(const struct binschema_disc *d,
+			   struct binschema *s);
+
+/* Compare a schema with one more text/bin pair; updates ORDER entries. */
+void binschema_verify(struct binschema *s, const struct stat_sample *text,
+		      const struct stat_sample *bin,
+		      struct binschema_check *res);
+
+/*
+ * Rewrite a parsed stat_bin sample as named entries (text key ids, values
+ * in text units) into out. ORDER entries are included unless verified_only;
+ * unmapped entries are dropped. Returns the entry count.
+ */
+int binschema_translate(const struct binschema *s,
+			const struct stat_sample *bin, struct stat_sample *out,
+			int verified_only);
+
+/* dir/binschema-<build_id>.txt */
+int binschema_path(const struct binschema *s, const char *dir, char *out,
+		   size_t len);
+/* Returns 0, or -1 if missing, unreadable or for another build. */
+int binschema_load(struct binschema *s, const char *path);
+int binschema_save(const struct binschema *s, const char *path);
+
+#endif /* BINSCHEMA_H */
@@ -0,0 +1,322 @@
+/*
+ * Named metrics from memory.stat_bin only, with a discovered, cached and
+ * re-checked index schema.
+ *
+ * At startup the schema for the running kernel build is loaded from the
+ * cache directory and checked once against a text/bin pair. If there is no
+ * cache or the check fails, it is discovered (binschema.h): -R rounds of
+ * text memory.stat + memory.stat_bin of the discovery cgroup (-Q, required)
+ * read back to back, -D ms apart, then saved. Keep the workload of that
+ * cgroup quiet while this runs. It has its own fdcache: it is not part of
+ * the output unless it is also below ROOT, and rescans never drop it.
+ *
+ * Every interval each cgroup below ROOT is read through memory.stat_bin
+ * alone, translated to names and text units and written with statout. Every
+ * -V seconds the next cgroup in turn is also read as text and compared; -S
+ * failed checks in a row trigger a new discovery. stderr gets the schema
+ * summary, the checks and the time per bin read + translate.
+ *
+ * Usage:
+ *   binstat_agent [-C cache_dir] -Q cgroup [-R rounds] [-D round_ms]
+ *                 [-V verify_s] [-S strikes] [-F] [-x] [-f human|csv|json]
+ *                 [-i interval_ms] [-n snapshots] [-d depth] [-o file] ROOT
+ *   binstat_agent -Q /sys/fs/cgroup/idle -f json -n 10 /sys/fs/cgroup
+ *   binstat_agent -F -R 50 -Q /sys/fs/cgroup/idle -x -f csv /sys/fs/cgroup
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "binschema.h"
+#include "fdcache.h"
+#include "statout.h"
+#include "statparse.h"
+#include "util.h"
+
+#define BUF_SIZE	65536
+
+static char buf[BUF_SIZE];
+static struct stat_sample text, bin, named;
+
+/* Text memory.stat then memory.stat_bin of id, back to back. */
+static int read_pair(struct fdcache *c, uint32_t id)
+{
+	ssize_t n = fdcache_read(c, id, CGF_MEMORY_STAT, buf, sizeof(buf));
+
+	if (n < 0)
+		return (int)n;
+	statparse_text(buf, (size_t)n, &text);
+	n = fdcache_read(c, id, CGF_STAT_BIN, buf, sizeof(buf));
+	if (n < 0)
+		return (int)n;
+	return statparse_bin((const uint8_t *)buf, (size_t)n, &bin) < 0 ?
+	       -EINVAL : 0;
+}
+
+static int discover(struct fdcache *c, uint32_t id, struct binschema *s,
+		    long rounds, long round_ms)
+{
+	uint32_t page_size = (uint32_t)sysconf(_SC_PAGESIZE);
+	struct binschema_disc d;
+	char build_id[sizeof(s->build_id)];
+	long r;
+	int err;
+
+	binschema_disc_init(&d);
+	for (r = 0; r < rounds; r++) {
+		if (r && round_ms)
+			usleep((useconds_t)round_ms * 1000);
+		err = read_pair(c, id);
+		if (err < 0) {
+			fprintf(stderr, "discovery read of %s: %s\n",
+				fdcache_path(c, id), strerror(-err));
+			binschema_disc_destroy(&d);
+			return -1;
+		}
+		if (binschema_disc_add(&d, &text, &bin, page_size) < 0) {
+			perror("binschema_disc_add");
+			binschema_disc_destroy(&d);
+			return -1;
+		}
+	}
+	memcpy(build_id, s->build_id, sizeof(build_id));
+	binschema_init(s, build_id);
+	binschema_disc_finish(&d, s);
+	binschema_disc_destroy(&d);
+	return 0;
+}
+
+static void print_schema(const struct binschema *s, const char *how)
+{
+	fprintf(stderr, "binstat_agent: kernel %s, schema %s: %u verified, %u by order, "
+		"%u unknown (page size %u)\n", s->build_id, how, s->nverified,
+		s->norder, s->nunknown, s->page_size);
+}
+
+static void save(const struct binschema *s, const char *path)
+{
+	if (binschema_save(s, path) < 0)
+		fprintf(stderr, "binstat_agent: cannot write %s: %s\n", path,
+			strerror(errno));
+}
+
+int main(int argc, char *argv[])
+{
+	enum statout_fmt fmt = STATOUT_HUMAN;
+	long interval_ms = 1000, snapshots = 0, snap, rounds = 20, round_ms = 50;
+	long verify_s = 60, strikes_max = 3;
+	int depth = 8, force = 0, verified_only = 0, fd = STDOUT_FILENO, opt;
+	const char *out_path = NULL, *cache_dir = "/var/tmp", *disc_path = NULL;
+	char build_id[80], path[4096];
+	uint64_t t_bin = 0, reads = 0, next, next_verify;
+	uint64_t checks = 0, failed = 0, rediscoveries = 0;
+	uint32_t disc_id, verify_id = 0, strikes = 0;
+	static struct binschema s;
+	struct binschema_check chk;
+	struct statout o;
+	struct fdcache c, q;		/* output cgroups, discovery cgroup */
+
+	while ((opt = getopt(argc, argv, "C:Q:R:D:V:S:Fxf:i:n:d:o:")) != -1) {
+		switch (opt) {
+		case 'C':
+			cache_dir = optarg;
+			break;
+		case 'Q':
+			disc_path = optarg;
+			break;
+		case 'R':
+			rounds = atol(optarg);
+			break;
+		case 'D':
+			round_ms = atol(optarg);
+			break;
+		case 'V':
+			verify_s = atol(optarg);
+			break;
+		case 'S':
+			strikes_max = atol(optarg);
+			break;
+		case 'F':
+			force = 1;
+			break;
+		case 'x':
+			verified_only = 1;
+			break;
+		case 'f':
+			if (statout_parse_fmt(optarg) < 0)
+				goto usage;
+			fmt = (enum statout_fmt)statout_parse_fmt(optarg);
+			break;
+		case 'i':
+			interval_ms = atol(optarg);
+			break;
+		case 'n':
+			snapshots = atol(optarg);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'o':
+			out_path = optarg;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || !disc_path || rounds <= 0 || rounds > UINT16_MAX ||
+	    round_ms < 0 || verify_s < 0 || strikes_max <= 0 ||
+	    interval_ms < 0 || snapshots < 0 || depth < 0)
+		goto usage;
+
+	if (out_path) {
+		fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			perror(out_path);
+			return 1;
+		}
+	}
+	if (statout_init(&o, fmt, fd) < 0 || fdcache_init(&c, 0) < 0 ||
+	    fdcache_init(&q, 0) < 0) {
+		perror("init");
+		return 1;
+	}
+	if (fdcache_scan(&c, argv[optind], depth) <= 0) {
+		fprintf(stderr, "no cgroups with memory.stat below %s\n",
+			argv[optind]);
+		return 1;
+	}
+	disc_id = fdcache_add(&q, disc_path);
+	if (disc_id == FDCACHE_NONE) {
+		fprintf(stderr, "cannot open %s\n", disc_path);
+		return 1;
+	}
+
+	if (binschema_build_id(build_id, sizeof(build_id)) < 0) {
+		perror("build id");
+		return 1;
+	}
+	binschema_init(&s, build_id);
+	if (binschema_path(&s, cache_dir, path, sizeof(path)) < 0) {
+		fprintf(stderr, "cache path too long\n");
+		return 1;
+	}
+	if (!force && binschema_load(&s, path) == 0) {
+		print_schema(&s, "from cache");
+		if (read_pair(&q, disc_id) == 0) {
+			binschema_verify(&s, &text, &bin, &chk);
+			if (chk.mismatched || chk.unmapped > s.nunknown) {
+				fprintf(stderr, "binstat_agent: cached schema disagrees "
+					"(%u of %u off, %u unmapped), rediscovering\n",
+					chk.mismatched, chk.checked, chk.unmapped);
+				force = 1;
+			}
+		}
+	} else {
+		force = 1;
+	}
+	if (force) {
+		if (discover(&q, disc_id, &s, rounds, round_ms) < 0)
+			return 1;
+		print_schema(&s, "discovered");
+		save(&s, path);
+	}
+
+	next = now_ns();
+	next_verify = next + (uint64_t)verify_s * 1000000000;
+	for (snap = 0; !snapshots || snap < snapshots; snap++) {
+		uint64_t ts = now_ns();
+		uint32_t id;
+
+		if (snap && snap % 10 == 0)
+			fdcache_scan(&c, argv[optind], depth);
+		statout_begin(&o, ts);
+		for (id = 0; id < c.nentries; id++) {
+			uint64_t t0;
+			ssize_t n;
+
+			if (!fdcache_live(&c, id))
+				continue;
+			t0 = now_ns();
+			n = fdcache_read(&c, id, CGF_STAT_BIN, buf, sizeof(buf));
+			if (n < 0 || statparse_bin((const uint8_t *)buf, (size_t)n,
+						   &bin) < 0)
+				continue;
+			binschema_translate(&s, &bin, &named, verified_only);
+			t_bin += now_ns() - t0;
+			reads++;
+			if (statout_sample(&o, fdcache_path(&c, id), &named) < 0)
+				perror("statout_sample");
+		}
+		if (statout_flush(&o)) {
+			perror("write");
+			return 1;
+		}
+
+		/* one cgroup per check, in turn, so all of them get covered */
+		if (verify_s && now_ns() >= next_verify) {
+			uint32_t tries;
+
+			for (tries = 0; tries < c.nentries; tries++) {
+				verify_id = (verify_id + 1) % c.nentries;
+				if (fdcache_live(&c, verify_id))
+					break;
+			}
+			if (fdcache_live(&c, verify_id) && read_pair(&c, verify_id) == 0) {
+				binschema_verify(&s, &text, &bin, &chk);
+				checks++;
+				strikes = chk.mismatched ? strikes + 1 : 0;
+				failed += chk.mismatched != 0;
+				if (chk.mismatched)
+					fprintf(stderr, "binstat_agent: check of %s: %u of %u "
+						"entries off\n", fdcache_path(&c, verify_id),
+						chk.mismatched, chk.checked);
+				if (chk.promoted || chk.demoted)
+					save(&s, path);
+				if (strikes >= strikes_max) {
+					if (discover(&q, disc_id, &s, rounds, round_ms) < 0)
+						return 1;
+					print_schema(&s, "rediscovered");
+					save(&s, path);
+					rediscoveries++;
+					strikes = 0;
+				}
+			}
+			next_verify = now_ns() + (uint64_t)verify_s * 1000000000;
+		}
+
+		if (interval_ms) {
+			struct timespec tsl;
+
+			next += (uint64_t)interval_ms * 1000000;
+			if (next < now_ns())
+				next = now_ns();
+			tsl = ns_to_ts(next);
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					       &tsl, NULL) == EINTR)
+				;
+		}
+	}
+
+	print_schema(&s, "at exit");
+	fprintf(stderr, "  %ld snapshots, %.2f us per bin read + translate, "
+		"%llu checks (%llu failed), %llu rediscoveries\n", snap,
+		reads ? (double)t_bin / reads / 1e3 : 0.0,
+		(unsigned long long)checks, (unsigned long long)failed,
+		(unsigned long long)rediscoveries);
+	if (out_path)
+		close(fd);
+	statout_destroy(&o);
+	fdcache_destroy(&c);
+	fdcache_destroy(&q);
+	return 0;
+
+usage:
+	fprintf(stderr, "USAGE: %s [-C cache_dir] -Q cgroup [-R rounds] [-D round_ms] "
+		"[-V verify_s] [-S strikes] [-F] [-x] [-f human|csv|json] "
+		"[-i interval_ms] [-n snapshots] [-d depth] [-o file] ROOT\n", argv[0]);
+	return 1;
+}
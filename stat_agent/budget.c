@@ -0,0 +1,203 @@
+/*
+ * CPU-budgeted read scheduling. See budget.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "budget.h"
+
+int budget_init(struct budget *b, double cpu_frac, uint64_t min_ns,
+		uint64_t max_ns)
+{
+	memset(b, 0, sizeof(*b));
+	if (cpu_frac <= 0 || min_ns == 0 || max_ns < min_ns)
+		return -1;
+	b->cpu_frac = cpu_frac;
+	b->min_ns = min_ns;
+	b->max_ns = max_ns;
+	if (budget_reserve(b, 64) < 0)
+		return -1;
+	b->n = 0;
+	return 0;
+}
+
+void budget_destroy(struct budget *b)
+{
+	free(b->cg);
+	free(b->due);
+	memset(b, 0, sizeof(*b));
+}
+
+int budget_reserve(struct budget *b, uint32_t n)
+{
+	struct budget_cg *cg;
+	struct budget_due *due;
+	uint32_t cap;
+
+	if (n > b->n)
+		b->n = n;
+	if (n <= b->cap)
+		return 0;
+	cap = b->cap ? b->cap * 2 : 64;
+	if (cap < n)
+		cap = n;
+	cg = realloc(b->cg, cap * sizeof(*cg));
+	if (!cg)
+		return -1;
+	b->cg = cg;
+	due = realloc(b->due, cap * sizeof(*due));
+	if (!due)
+		return -1;
+	b->due = due;
+	memset(cg + b->cap, 0, (cap - b->cap) * sizeof(*cg));
+	b->cap = cap;
+	return 0;
+}
+
+void budget_add(struct budget *b, uint32_t id)
+{
+	if (id >= b->n || b->cg[id].live)
+		return;
+	memset(&b->cg[id], 0, sizeof(b->cg[id]));
+	b->cg[id].live = 1;
+}
+
+void budget_forget(struct budget *b, uint32_t id)
+{
+	if (id < b->n)
+		memset(&b->cg[id], 0, sizeof(b->cg[id]));
+}
+
+uint64_t budget_mean_cost(const struct budget *b)
+{
+	uint64_t sum = 0, n = 0;
+	uint32_t id;
+
+	for (id = 0; id < b->n; id++) {
+		if (b->cg[id].live && b->cg[id].cost_ns) {
+			sum += b->cg[id].cost_ns;
+			n++;
+		}
+	}
+	return n ? sum / n : BUDGET_DEFAULT_COST_NS;
+}
+
+static int cmp_due(const void *x, const void *y)
+{
+	const struct budget_due *a = x, *b = y;
+
+	return a->prio < b->prio ? 1 : a->prio > b->prio ? -1 :
+	       a->id < b->id ? -1 : a->id > b->id;
+}
+
+uint32_t budget_plan(struct budget *b, uint64_t now, uint32_t *ids,
+		     uint32_t max)
+{
+	uint64_t guess = 0, cap = (uint64_t)(b->cpu_frac * BUDGET_BURST_NS);
+	uint32_t id, ndue = 0, n = 0, i;
+	int64_t left;
+
+	if (b->refill_ns && now > b->refill_ns)
+		b->tokens_ns += (int64_t)(b->cpu_frac * (double)(now - b->refill_ns));
+	else if (!b->refill_ns)
+		b->tokens_ns = (int64_t)cap;	/* start with a full bucket */
+	if (b->tokens_ns > (int64_t)cap)
+		b->tokens_ns = (int64_t)cap;
+	b->refill_ns = now;
+
+	for (id = 0; id < b->n; id++) {
+		struct budget_cg *c = &b->cg[id];
+		double want;
+
+		if (!c->live)
+			continue;
+		if (!c->last_ns) {
+			c->prio = 1e9;		/* never read: first */
+		} else {
+			want = (double)b->max_ns -
+			       c->urgency * (double)(b->max_ns - b->min_ns);
+			c->prio = (double)(now - c->last_ns) / want;
+		}
+		if (c->prio >= 1.0) {
+			b->due[ndue].prio = c->prio;
+			b->due[ndue].id = id;
+			ndue++;
+		}
+	}
+	if (!ndue)
+		return 0;
+	qsort(b->due, ndue, sizeof(b->due[0]), cmp_due);
+
+	left = b->tokens_ns;
+	for (i = 0; i < ndue && n < max && left > 0; i++) {
+		struct budget_cg *c = &b->cg[b->due[i].id];
+		uint64_t cost = c->cost_ns;
+
+		if (!cost) {
+			if (!guess)
+				guess = budget_mean_cost(b);
+			cost = guess;
+		}
+		/* the most urgent read goes ahead while the bucket is positive */
+		if (n && (int64_t)cost > left)
+			break;
+		ids[n++] = b->due[i].id;
+		left -= (int64_t)cost;
+	}
+	b->stats.deferred += ndue - n;
+	return n;
+}
+
+static double clamp01(double x)
+{
+	return x < 0 ? 0 : x > 1 ? 1 : x;
+}
+
+void budget_done(struct budget *b, uint32_t id, uint64_t now, uint64_t cpu_ns,
+		 uint64_t usage, uint64_t current, uint64_t limit)
+{
+	struct budget_cg *c;
+	double rate = 0, pressure = 0;
+
+	if (id >= b->n || !b->cg[id].live)
+		return;
+	c = &b->cg[id];
+
+	if (!c->cost_ns)
+		c->cost_ns = cpu_ns;
+	else
+		c->cost_ns = (uint64_t)((int64_t)c->cost_ns +
+			((int64_t)cpu_ns - (int64_t)c->cost_ns) / (1 << BUDGET_EWMA_SHIFT));
+
+	if (c->last_ns && now > c->last_ns) {
+		uint64_t iv = now - c->last_ns;
+		uint64_t d = usage > c->usage ? usage - c->usage : c->usage - usage;
+
+		if (!c->interval_ns)
+			c->interval_ns = iv;
+		else
+			c->interval_ns = (uint64_t)((int64_t)c->interval_ns +
+				((int64_t)iv - (int64_t)c->interval_ns) / (1 << BUDGET_EWMA_SHIFT));
+		rate = (double)d / ((double)iv / 1e9) /
+		       (double)(current ? current : 1);
+	}
+	if (limit != UINT64_MAX && limit)
+		pressure = ((double)current / (double)limit - BUDGET_PRESSURE_LO) /
+			   (BUDGET_PRESSURE_HI - BUDGET_PRESSURE_LO);
+	rate = clamp01(rate / BUDGET_RATE_REF);
+	c->urgency = rate > clamp01(pressure) ? rate : clamp01(pressure);
+
+	c->usage = usage;
+	c->last_ns = now;
+	c->reads++;
+	b->tokens_ns -= (int64_t)cpu_ns;
+	b->stats.spent_ns += cpu_ns;
+	b->stats.read_ns += cpu_ns;
+	b->stats.reads++;
+}
+
+void budget_charge(struct budget *b, uint64_t cpu_ns)
+{
+	b->tokens_ns -= (int64_t)cpu_ns;
+	b->stats.spent_ns += cpu_ns;
+}
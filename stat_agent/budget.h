@@ -0,0 +1,97 @@
+/*
+ * CPU-budgeted read scheduling for many cgroups.
+ *
+ * The controller holds a token bucket of CPU time that fills at `cpu_frac`
+ * of one core. Every tick, budget_plan() picks the cgroups that are due, most
+ * urgent first, for as long as their estimated read cost fits in the bucket.
+ * The caller reads them, reports the measured thread CPU time of each read
+ * with budget_done() and the rest of its tick (planning, parsing, output)
+ * with budget_charge(), so everything the agent spends is paid from the
+ * same bucket and total overhead stays at the budget however many cgroups
+ * there are: more cgroups only stretch their intervals.
+ *
+ * A cgroup's wanted interval goes from max_ns (idle) down to min_ns as its
+ * urgency rises. Urgency is the larger of
+ *   - change rate: |d(anon + file)| per second relative to memory.current,
+ *     BUDGET_RATE_REF per second or more counts as fully urgent;
+ *   - pressure: memory.current against the lower of memory.high and
+ *     memory.max, from BUDGET_PRESSURE_LO (0) to BUDGET_PRESSURE_HI (1).
+ * Priority is age / wanted interval; a cgroup is due once it reaches 1.
+ */
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <stdint.h>
+
+#define BUDGET_EWMA_SHIFT	3	/* cost and interval EWMA weight 1/8 */
+#define BUDGET_DEFAULT_COST_NS	20000	/* cost guess before the first read */
+#define BUDGET_BURST_NS		1000000000ull	/* bucket holds 1 s of budget */
+#define BUDGET_RATE_REF		0.01	/* 1% of current per second */
+#define BUDGET_PRESSURE_LO	0.50
+#define BUDGET_PRESSURE_HI	0.95
+
+struct budget_cg {
+	uint64_t cost_ns;		/* EWMA of read CPU time, 0 = unknown */
+	uint64_t last_ns;		/* last read, 0 = never */
+	uint64_t interval_ns;		/* EWMA of time between reads */
+	uint64_t usage;			/* anon + file at the last read */
+	uint64_t reads;
+	double urgency;			/* 0 .. 1 */
+	double prio;			/* from the last budget_plan() */
+	int live;
+};
+
+struct budget_due {
+	double prio;
+	uint32_t id;
+};
+
+struct budget_stats {
+	uint64_t spent_ns;		/* all CPU charged */
+	uint64_t read_ns;		/* of which reads */
+	uint64_t reads;
+	uint64_t deferred;		/* due but not read for lack of budget */
+};
+
+struct budget {
+	struct budget_cg *cg;
+	uint32_t n, cap;
+	struct budget_due *due;		/* budget_plan() scratch, cap entries */
+	double cpu_frac;
+	uint64_t min_ns, max_ns;
+	int64_t tokens_ns;		/* may go negative: cost over estimate */
+	uint64_t refill_ns;		/* time of the last refill */
+	struct budget_stats stats;
+};
+
+int budget_init(struct budget *b, double cpu_frac, uint64_t min_ns,
+		uint64_t max_ns);
+void budget_destroy(struct budget *b);
+
+/* Make ids < n usable; new ids start live and never read. */
+int budget_reserve(struct budget *b, uint32_t n);
+void budget_add(struct budget *b, uint32_t id);
+void budget_forget(struct budget *b, uint32_t id);
+
+/*
+ * Refill the bucket up to now and write the ids to read this tick, most
+ * urgent first, to ids (up to max). Returns how many.
+ */
+uint32_t budget_plan(struct budget *b, uint64_t now, uint32_t *ids,
+		     uint32_t max);
+
+/*
+ * One read of id finished at now and took cpu_ns. usage is anon + file,
+ * current/limit are memory.current and min(memory.high, memory.max)
+ * (UINT64_MAX = no limit).
+ */
+void budget_done(struct budget *b, uint32_t id, uint64_t now, uint64_t cpu_ns,
+		 uint64_t usage, uint64_t current, uint64_t limit);
+
+/* CPU spent outside reads (planning, output). */
+void budget_charge(struct budget *b, uint64_t cpu_ns);
+
+/* Mean estimated read cost over cgroups read at least once. */
+uint64_t budget_mean_cost(const struct budget *b);
+
+#endif /* BUDGET_H */
@@ -0,0 +1,315 @@
+/*
+ * Interval sampler for every cgroup below ROOT under a fixed CPU budget.
+ *
+ * Each tick the budget controller (budget.h) picks the cgroups that are due
+ * and fit in the budget, most urgent first; they are read through one
+ * fdcache (memory.stat and memory.numa_stat parsed, memory.current, .max,
+ * .high). The thread CPU time of every read feeds that cgroup's cost
+ * estimate, and the rest of the tick is charged as controller overhead, so
+ * the agent's total CPU stays at the budget whatever the cgroup count;
+ * more cgroups only stretch the effective intervals.
+ *
+ * Every report period it prints the CPU actually used against the budget,
+ * reads per second, deferred reads and the spread of effective intervals;
+ * -v adds one line per cgroup.
+ *
+ * Usage:
+ *   budget_agent [-c cpu_pct] [-i min_ms] [-I max_ms] [-t tick_ms]
+ *                [-r report_s] [-n duration_s] [-d depth] [-b fd_budget]
+ *                [-s rescan_s] [-v] ROOT
+ *   budget_agent -c 0.5 /sys/fs/cgroup          # 0.5% of one core
+ *   budget_agent -c 0.1 -i 500 -I 60000 -v -n 60 /sys/fs/cgroup/a
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "budget.h"
+#include "fdcache.h"
+#include "statparse.h"
+#include "util.h"
+
+#define BUF_SIZE	65536
+
+static char buf[BUF_SIZE];
+static struct stat_sample sample;
+
+static uint64_t read_single(struct fdcache *c, uint32_t id, enum cg_file f,
+			    uint64_t missing)
+{
+	ssize_t n = fdcache_read(c, id, f, buf, sizeof(buf));
+
+	return n > 0 ? statparse_single(buf, (size_t)n) : missing;
+}
+
+/* One collection of a cgroup. Returns 0, or -ENOENT if it is gone. */
+static int read_cgroup(struct fdcache *c, uint32_t id, uint64_t *usage,
+		       uint64_t *current, uint64_t *limit)
+{
+	uint64_t max, high;
+	ssize_t n;
+	uint32_t i;
+
+	n = fdcache_read(c, id, CGF_MEMORY_STAT, buf, sizeof(buf));
+	if (n == -ENOENT)
+		return -ENOENT;
+	*usage = 0;
+	if (n > 0) {
+		statparse_text(buf, (size_t)n, &sample);
+		for (i = 0; i < sample.n; i++)
+			if (sample.e[i].key == SK_anon || sample.e[i].key == SK_file)
+				*usage += sample.e[i].value;
+	}
+	n = fdcache_read(c, id, CGF_NUMA_STAT, buf, sizeof(buf));
+	if (n > 0)
+		statparse(STAT_KIND_NUMA, buf, (size_t)n, &sample);
+	/* the root has no current/max/high */
+	*current = read_single(c, id, CGF_MEMORY_CURRENT, 0);
+	max = read_single(c, id, CGF_MEMORY_MAX, UINT64_MAX);
+	high = read_single(c, id, CGF_MEMORY_HIGH, UINT64_MAX);
+	*limit = high < max ? high : max;
+	return 0;
+}
+
+static void sync_tree(struct fdcache *c, struct budget *b)
+{
+	uint32_t id;
+
+	if (budget_reserve(b, c->nentries) < 0) {
+		perror("budget_reserve");
+		exit(1);
+	}
+	for (id = 0; id < c->nentries; id++) {
+		if (fdcache_live(c, id))
+			budget_add(b, id);
+		else
+			budget_forget(b, id);
+	}
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(const struct fdcache *c, const struct budget *b,
+		   uint64_t wall_ns, uint64_t cpu_ns, uint64_t reads,
+		   uint64_t deferred, uint64_t *iv, int verbose)
+{
+	uint32_t id, live = 0, never = 0, niv = 0;
+
+	for (id = 0; id < b->n; id++) {
+		const struct budget_cg *g = &b->cg[id];
+
+		if (!g->live)
+			continue;
+		live++;
+		if (!g->reads)
+			never++;
+		if (g->interval_ns)
+			iv[niv++] = g->interval_ns;
+	}
+	qsort(iv, niv, sizeof(iv[0]), cmp_u64);
+
+	printf("cpu %.3f%% of a core (budget %.3f%%), %.1f reads/s, %llu deferred, "
+	       "%u cgroups (%u not read yet), mean cost %.1f us\n",
+	       (double)cpu_ns * 100 / (double)wall_ns, b->cpu_frac * 100,
+	       (double)reads * 1e9 / (double)wall_ns,
+	       (unsigned long long)deferred, live, never,
+	       (double)budget_mean_cost(b) / 1e3);
+	if (niv)
+		printf("  effective interval: min %.2f s, p50 %.2f s, p90 %.2f s, max %.2f s\n",
+		       (double)iv[0] / 1e9, (double)iv[niv / 2] / 1e9,
+		       (double)iv[niv * 9 / 10] / 1e9, (double)iv[niv - 1] / 1e9);
+	if (!verbose)
+		goto out;
+	printf("  %10s %10s %7s %8s  %s\n", "interval", "cost", "urgency",
+	       "reads", "cgroup");
+	for (id = 0; id < b->n; id++) {
+		const struct budget_cg *g = &b->cg[id];
+
+		if (!g->live || !fdcache_live(c, id))
+			continue;
+		printf("  %8.2f s %7.1f us %7.2f %8llu  %s\n",
+		       (double)g->interval_ns / 1e9, (double)g->cost_ns / 1e3,
+		       g->urgency, (unsigned long long)g->reads,
+		       fdcache_path(c, id));
+	}
+out:
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	double cpu_pct = 0.5;
+	long min_ms = 1000, max_ms = 30000, tick_ms = 100, report_s = 10;
+	long duration_s = 0, rescan_s = 30;
+	int depth = 8, verbose = 0, opt;
+	uint32_t fd_budget = 0, *ids = NULL, ncap = 0, n, i;
+	uint64_t *iv = NULL, start, next, next_report, next_rescan, win_wall, win_cpu;
+	uint64_t cpu_mark;
+	struct budget_stats win;
+	struct fdcache c;
+	struct budget b;
+
+	while ((opt = getopt(argc, argv, "c:i:I:t:r:n:d:b:s:v")) != -1) {
+		switch (opt) {
+		case 'c':
+			cpu_pct = atof(optarg);
+			break;
+		case 'i':
+			min_ms = atol(optarg);
+			break;
+		case 'I':
+			max_ms = atol(optarg);
+			break;
+		case 't':
+			tick_ms = atol(optarg);
+			break;
+		case 'r':
+			report_s = atol(optarg);
+			break;
+		case 'n':
+			duration_s = atol(optarg);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'b':
+			fd_budget = (uint32_t)atoi(optarg);
+			break;
+		case 's':
+			rescan_s = atol(optarg);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || cpu_pct <= 0 || min_ms <= 0 ||
+	    max_ms < min_ms || tick_ms <= 0 || report_s <= 0 ||
+	    duration_s < 0 || rescan_s < 0 || depth < 0)
+		goto usage;
+
+	if (fdcache_init(&c, fd_budget) < 0 ||
+	    budget_init(&b, cpu_pct / 100, (uint64_t)min_ms * 1000000,
+			(uint64_t)max_ms * 1000000) < 0) {
+		perror("init");
+		return 1;
+	}
+	if (fdcache_scan(&c, argv[optind], depth) <= 0) {
+		fprintf(stderr, "no cgroups with memory.stat below %s\n",
+			argv[optind]);
+		return 1;
+	}
+	sync_tree(&c, &b);
+
+	start = now_ns();
+	next = start;
+	next_report = start + (uint64_t)report_s * 1000000000;
+	next_rescan = start + (uint64_t)rescan_s * 1000000000;
+	win_wall = start;
+	win_cpu = thread_cpu_ns();
+	cpu_mark = win_cpu;
+	win = b.stats;
+	printf("=== budget_agent: %s, budget %.3f%% of a core, interval %ld..%ld ms, "
+	       "tick %ld ms ===\n", argv[optind], cpu_pct, min_ms, max_ms, tick_ms);
+
+	for (;;) {
+		uint64_t read_cpu = 0, now = now_ns(), cpu;
+		struct timespec ts;
+
+		if (duration_s && now - start >= (uint64_t)duration_s * 1000000000)
+			break;
+		if (rescan_s && now >= next_rescan) {
+			fdcache_scan(&c, argv[optind], depth);
+			sync_tree(&c, &b);
+			next_rescan = now + (uint64_t)rescan_s * 1000000000;
+		}
+		if (ncap < b.cap) {
+			ncap = b.cap;
+			ids = realloc(ids, ncap * sizeof(*ids));
+			iv = realloc(iv, ncap * sizeof(uint64_t));
+			if (!ids || !iv) {
+				perror("realloc");
+				return 1;
+			}
+		}
+
+		n = budget_plan(&b, now, ids, ncap);
+		for (i = 0; i < n; i++) {
+			uint64_t usage, current, limit, c0 = thread_cpu_ns(), c1;
+
+			if (read_cgroup(&c, ids[i], &usage, &current, &limit) < 0) {
+				budget_forget(&b, ids[i]);
+				continue;
+			}
+			c1 = thread_cpu_ns();
+			budget_done(&b, ids[i], now_ns(), c1 - c0, usage, current,
+				    limit);
+			read_cpu += c1 - c0;
+		}
+
+		now = now_ns();
+		if (now >= next_report) {
+			cpu = thread_cpu_ns();
+			report(&c, &b, now - win_wall, cpu - win_cpu,
+			       b.stats.reads - win.reads,
+			       b.stats.deferred - win.deferred, iv,
+			       verbose);
+			win_wall = now;
+			win_cpu = cpu;
+			win = b.stats;
+			next_report += (uint64_t)report_s * 1000000000;
+		}
+		/*
+		 * Everything since the last mark that was not a read, including
+		 * the previous sleep's syscalls, is controller overhead.
+		 */
+		cpu = thread_cpu_ns();
+		budget_charge(&b, cpu - cpu_mark - read_cpu);
+		cpu_mark = cpu;
+
+		/*
+		 * Absolute deadlines, so a slow tick does not shift the next
+		 * ones. In debt, sleep until the bucket is back at zero: even
+		 * the bare ticks must not exceed a tiny budget.
+		 */
+		next += (uint64_t)tick_ms * 1000000;
+		now = now_ns();
+		if (b.tokens_ns < 0 &&
+		    next < now + (uint64_t)((double)-b.tokens_ns / b.cpu_frac))
+			next = now + (uint64_t)((double)-b.tokens_ns / b.cpu_frac);
+		if (next < now)
+			next = now;
+		ts = ns_to_ts(next);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+			;
+	}
+
+	printf("=== total: %.3f%% of a core over %.1f s, %llu reads, "
+	       "%.1f%% of CPU in reads ===\n",
+	       (double)b.stats.spent_ns * 100 / (double)(now_ns() - start),
+	       (double)(now_ns() - start) / 1e9,
+	       (unsigned long long)b.stats.reads,
+	       b.stats.spent_ns ? (double)b.stats.read_ns * 100 /
+				  (double)b.stats.spent_ns : 0.0);
+	free(ids);
+	free(iv);
+	budget_destroy(&b);
+	fdcache_destroy(&c);
+	return 0;
+
+usage:
+	fprintf(stderr, "USAGE: %s [-c cpu_pct] [-i min_ms] [-I max_ms] [-t tick_ms] "
+		"[-r report_s] [-n duration_s] [-d depth] [-b fd_budget] "
+		"[-s rescan_s] [-v] ROOT\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,29 @@
+#!/bin/bash
+# Capture memory.stat + memory.numa_stat snapshots as text for bench_tsenc.
+# Each snapshot starts with "@ <timestamp_ns> <cgroup path>".
+# Usage:
+#   ./capture_memstat.sh COUNT INTERVAL_SEC CGROUP_PATH... > capture.txt
+#   ./capture_memstat.sh 3600 1 /sys/fs/cgroup/a/b/c/* > capture.txt
+
+set -euo pipefail
+
+if [[ $# -lt 3 ]]; then
+  echo "USAGE: $0 COUNT INTERVAL_SEC CGROUP_PATH..." >&2
+  exit 1
+fi
+
+COUNT="$1"
+INTERVAL="$2"
+shift 2
+
+for ((i = 0; i < COUNT; i++)); do
+  for cg in "$@"; do
+    [[ -r "${cg}/memory.stat" ]] || continue
+    echo "@ $(date +%s%N) ${cg}"
+    cat "${cg}/memory.stat"
+    cat "${cg}/memory.numa_stat" 2>/dev/null || true
+  done
+  if [[ $i -lt $((COUNT - 1)) ]]; then
+    sleep "${INTERVAL}"
+  fi
+done
@@ -0,0 +1,379 @@
+/*
+ * Query engine over snapstore columns. See cgquery.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgquery.h"
+#include "util.h"
+
+#define QUERY_MAX	256
+
+static const char *const extra_cols[] = {
+	[SNAP_COL_CURRENT - STAT_KEY_NR] = "current",
+	[SNAP_COL_MAX - STAT_KEY_NR]     = "max",
+	[SNAP_COL_HIGH - STAT_KEY_NR]    = "high",
+};
+
+const char *cgquery_col_name(uint32_t col)
+{
+	if (col < STAT_KEY_NR)
+		return stat_key_name(col);
+	if (col <= SNAP_COL_HIGH)
+		return extra_cols[col - STAT_KEY_NR];
+	return "?";
+}
+
+static int parse_field(const char *tok, uint32_t *col, int *rate)
+{
+	size_t len = strlen(tok);
+	uint32_t c;
+
+	*rate = 0;
+	if (len > 2 && strcmp(tok + len - 2, "/s") == 0) {
+		*rate = 1;
+		len -= 2;
+	}
+	for (c = SNAP_COL_CURRENT; c <= SNAP_COL_HIGH; c++) {
+		const char *name = extra_cols[c - STAT_KEY_NR];
+
+		if (strlen(name) == len && memcmp(name, tok, len) == 0) {
+			*col = c;
+			return 0;
+		}
+	}
+	c = stat_key_lookup(tok, len);
+	if (c == STAT_KEY_UNKNOWN)
+		return -1;
+	*col = c;
+	return 0;
+}
+
+static int parse_value(const char *tok, int64_t *v)
+{
+	char *end;
+	long long x = strtoll(tok, &end, 10);
+
+	switch (*end) {
+	case 'G': case 'g':
+		x <<= 10;
+		/* fall through */
+	case 'M': case 'm':
+		x <<= 10;
+		/* fall through */
+	case 'K': case 'k':
+		x <<= 10;
+		end++;
+		break;
+	}
+	if (end == tok || *end)
+		return -1;
+	*v = x;
+	return 0;
+}
+
+static int parse_op(const char *tok, enum cgq_op *op)
+{
+	if (strcmp(tok, ">") == 0)
+		*op = CGQ_GT;
+	else if (strcmp(tok, ">=") == 0)
+		*op = CGQ_GE;
+	else if (strcmp(tok, "<") == 0)
+		*op = CGQ_LT;
+	else if (strcmp(tok, "<=") == 0)
+		*op = CGQ_LE;
+	else
+		return -1;
+	return 0;
+}
+
+int cgquery_parse(const char *text, struct cgquery *q, char *err,
+		  size_t errlen)
+{
+	char buf[QUERY_MAX], *tok[6], *save, *t;
+	int ntok = 0, rate2;
+
+	memset(q, 0, sizeof(*q));
+	if (strlen(text) >= sizeof(buf)) {
+		snprintf(err, errlen, "query too long");
+		return -1;
+	}
+	strcpy(buf, text);
+	/* a sixth token makes ntok 6, which no form accepts */
+	for (t = strtok_r(buf, " \t\n", &save); t && ntok < 6;
+	     t = strtok_r(NULL, " \t\n", &save))
+		tok[ntok++] = t;
+
+	if (ntok == 3 && strcmp(tok[0], "top") == 0) {
+		q->kind = CGQ_TOP;
+		q->k = (uint32_t)atoi(tok[1]);
+		if (q->k == 0 || q->k > CGQ_MAX_RESULTS) {
+			snprintf(err, errlen, "K must be 1..%d", CGQ_MAX_RESULTS);
+			return -1;
+		}
+		if (parse_field(tok[2], &q->col, &q->rate) < 0)
+			goto bad_field;
+		return 0;
+	}
+	if ((ntok == 4 || ntok == 5) && strcmp(tok[0], "where") == 0) {
+		size_t len = strlen(tok[3]);
+
+		q->kind = CGQ_WHERE;
+		if (parse_field(tok[1], &q->col, &q->rate) < 0)
+			goto bad_field;
+		if (parse_op(tok[2], &q->op) < 0) {
+			snprintf(err, errlen, "bad operator '%s'", tok[2]);
+			return -1;
+		}
+		if (ntok == 4) {
+			if (parse_value(tok[3], &q->value) < 0) {
+				snprintf(err, errlen, "bad value '%s'", tok[3]);
+				return -1;
+			}
+			return 0;
+		}
+		if (len < 2 || tok[3][len - 1] != '%' || q->rate) {
+			snprintf(err, errlen, "expected: where FIELD OP PCT%% FIELD2");
+			return -1;
+		}
+		q->pct = (uint32_t)atoi(tok[3]);
+		if (q->pct == 0) {
+			snprintf(err, errlen, "bad percentage '%s'", tok[3]);
+			return -1;
+		}
+		if (parse_field(tok[4], &q->col2, &rate2) < 0 || rate2) {
+			tok[1] = tok[4];
+			goto bad_field;
+		}
+		return 0;
+	}
+	snprintf(err, errlen, "expected: top K FIELD[/s] | "
+		 "where FIELD[/s] OP VALUE | where FIELD OP PCT%% FIELD2");
+	return -1;
+
+bad_field:
+	snprintf(err, errlen, "unknown field '%s'",
+		 q->kind == CGQ_TOP ? tok[2] : tok[1]);
+	return -1;
+}
+
+/*
+ * Column kernels. All columns are snapstore columns or scratch columns:
+ * 64-byte aligned, n a multiple of 8.
+ */
+static void k_values(const uint64_t *restrict cur, const uint64_t *restrict prev,
+		     int64_t *restrict out, uint32_t n, int rate)
+{
+	const uint64_t *c = __builtin_assume_aligned(cur, SNAP_ALIGN);
+	const uint64_t *p = __builtin_assume_aligned(prev, SNAP_ALIGN);
+	int64_t *o = __builtin_assume_aligned(out, SNAP_ALIGN);
+	uint32_t i;
+
+	n &= ~7u;
+	if (rate) {
+		for (i = 0; i < n; i++)
+			o[i] = (int64_t)(c[i] - p[i]);
+	} else {
+		/* "max" limits (UINT64_MAX) stay the largest value */
+		for (i = 0; i < n; i++)
+			o[i] = c[i] > INT64_MAX ? INT64_MAX : (int64_t)c[i];
+	}
+}
+
+static void k_live(const uint64_t *restrict cur_read,
+		   const uint64_t *restrict prev_read, uint64_t *restrict out,
+		   uint32_t n, int rate)
+{
+	const uint64_t *c = __builtin_assume_aligned(cur_read, SNAP_ALIGN);
+	const uint64_t *p = __builtin_assume_aligned(prev_read, SNAP_ALIGN);
+	uint64_t *o = __builtin_assume_aligned(out, SNAP_ALIGN);
+	uint32_t i;
+
+	n &= ~7u;
+	if (rate) {
+		for (i = 0; i < n; i++)
+			o[i] = (c[i] != 0) & (p[i] != 0);
+	} else {
+		for (i = 0; i < n; i++)
+			o[i] = c[i] != 0;
+	}
+}
+
+#define CMP_LOOP(expr)						\
+	for (i = 0; i < n; i++)					\
+		h[i] = l[i] & (uint64_t)(expr)
+
+/* hits[i] = live[i] && vals[i] OP thr */
+static void k_cmp(const int64_t *restrict vals, const uint64_t *restrict live,
+		  int64_t thr, enum cgq_op op, uint64_t *restrict hits,
+		  uint32_t n)
+{
+	const int64_t *v = __builtin_assume_aligned(vals, SNAP_ALIGN);
+	const uint64_t *l = __builtin_assume_aligned(live, SNAP_ALIGN);
+	uint64_t *h = __builtin_assume_aligned(hits, SNAP_ALIGN);
+	uint32_t i;
+
+	n &= ~7u;
+	switch (op) {
+	case CGQ_GT:
+		CMP_LOOP(v[i] > thr);
+		break;
+	case CGQ_GE:
+		CMP_LOOP(v[i] >= thr);
+		break;
+	case CGQ_LT:
+		CMP_LOOP(v[i] < thr);
+		break;
+	case CGQ_LE:
+		CMP_LOOP(v[i] <= thr);
+		break;
+	}
+}
+
+/* hits[i] = live[i] && a[i] * 100 OP b[i] * pct, b = "max" never overflows */
+static void k_cmp_pct(const uint64_t *restrict a, const uint64_t *restrict b,
+		      const uint64_t *restrict live, uint32_t pct,
+		      enum cgq_op op, uint64_t *restrict hits, uint32_t n)
+{
+	const uint64_t *x = __builtin_assume_aligned(a, SNAP_ALIGN);
+	const uint64_t *y = __builtin_assume_aligned(b, SNAP_ALIGN);
+	const uint64_t *l = __builtin_assume_aligned(live, SNAP_ALIGN);
+	uint64_t *h = __builtin_assume_aligned(hits, SNAP_ALIGN);
+	uint64_t cap = UINT64_MAX / pct;
+	uint32_t i;
+
+#define LIM(i)	(y[i] > cap ? UINT64_MAX : y[i] * pct)
+	n &= ~7u;
+	switch (op) {
+	case CGQ_GT:
+		CMP_LOOP(x[i] * 100 > LIM(i));
+		break;
+	case CGQ_GE:
+		CMP_LOOP(x[i] * 100 >= LIM(i));
+		break;
+	case CGQ_LT:
+		CMP_LOOP(x[i] * 100 < LIM(i));
+		break;
+	case CGQ_LE:
+		CMP_LOOP(x[i] * 100 <= LIM(i));
+		break;
+	}
+#undef LIM
+}
+
+/* Min-heap of the K largest values seen so far; heap[0] is the smallest. */
+static void heap_sift_down(int64_t *v, uint32_t *id, uint32_t n, uint32_t i)
+{
+	for (;;) {
+		uint32_t l = 2 * i + 1, m = i;
+		int64_t tv;
+		uint32_t tid;
+
+		if (l < n && v[l] < v[m])
+			m = l;
+		if (l + 1 < n && v[l + 1] < v[m])
+			m = l + 1;
+		if (m == i)
+			return;
+		tv = v[i], v[i] = v[m], v[m] = tv;
+		tid = id[i], id[i] = id[m], id[m] = tid;
+		i = m;
+	}
+}
+
+static void run_top(const struct cgquery *q, const int64_t *vals,
+		    const uint64_t *live, uint32_t n, struct cgq_result *r)
+{
+	uint32_t i, j, k = q->k;
+
+	for (i = 0; i < n; i++) {
+		if (!live[i])
+			continue;
+		r->matched++;
+		if (r->n < k) {
+			/* sift up */
+			j = r->n++;
+			r->value[j] = vals[i];
+			r->id[j] = i;
+			while (j && r->value[(j - 1) / 2] > r->value[j]) {
+				uint32_t p = (j - 1) / 2, tid = r->id[p];
+				int64_t tv = r->value[p];
+
+				r->value[p] = r->value[j], r->value[j] = tv;
+				r->id[p] = r->id[j], r->id[j] = tid;
+				j = p;
+			}
+		} else if (vals[i] > r->value[0]) {
+			r->value[0] = vals[i];
+			r->id[0] = i;
+			heap_sift_down(r->value, r->id, k, 0);
+		}
+	}
+	/* largest first */
+	for (i = 1; i < r->n; i++) {
+		int64_t v = r->value[i];
+		uint32_t id = r->id[i];
+
+		for (j = i; j && r->value[j - 1] < v; j--) {
+			r->value[j] = r->value[j - 1];
+			r->id[j] = r->id[j - 1];
+		}
+		r->value[j] = v;
+		r->id[j] = id;
+	}
+}
+
+int cgquery_run(const struct cgquery *q, const struct snapstore *s,
+		struct cgq_result *r)
+{
+	uint64_t t0 = now_ns(), dt;
+	uint32_t n = snapstore_len(s), i;
+	int64_t *vals = (int64_t *)snapstore_scratch(s, 0);
+	uint64_t *live = snapstore_scratch(s, 1);
+	uint64_t *hits = snapstore_scratch(s, 2);
+
+	r->matched = r->n = 0;
+	if (q->rate && !snapstore_has_prev(s)) {
+		r->eval_ns = 0;
+		return 0;
+	}
+	dt = s->ep[s->cur].ts_ns - s->ep[s->cur ^ 1].ts_ns;
+
+	k_live(snapstore_col(s, 0, SNAP_COL_READ_NS),
+	       snapstore_col(s, 1, SNAP_COL_READ_NS), live, n, q->rate);
+	k_values(snapstore_col(s, 0, q->col), snapstore_col(s, 1, q->col),
+		 vals, n, q->rate);
+
+	if (q->kind == CGQ_TOP) {
+		run_top(q, vals, live, n, r);
+	} else {
+		if (q->pct) {
+			k_cmp_pct(snapstore_col(s, 0, q->col),
+				  snapstore_col(s, 0, q->col2), live, q->pct,
+				  q->op, hits, n);
+		} else {
+			int64_t thr = q->value;
+
+			/* rate thresholds are per second, values per epoch */
+			if (q->rate && dt)
+				thr = (int64_t)((double)q->value * dt / 1e9);
+			k_cmp(vals, live, thr, q->op, hits, n);
+		}
+		for (i = 0; i < n; i++) {
+			if (!hits[i])
+				continue;
+			if (r->n < CGQ_MAX_RESULTS) {
+				r->id[r->n] = i;
+				r->value[r->n] = vals[i];
+				r->n++;
+			}
+			r->matched++;
+		}
+	}
+	if (q->rate && dt)
+		for (i = 0; i < r->n; i++)
+			r->value[i] = (int64_t)((double)r->value[i] * 1e9 / dt);
+	r->eval_ns = now_ns() - t0;
+	return (int)r->n;
+}
@@ -0,0 +1,67 @@
+/*
+ * Top-K and threshold queries over a snapstore, answered from memory.
+ *
+ *   top K FIELD             largest values in the current epoch
+ *   top K FIELD/s           largest change per second since the previous epoch
+ *   where FIELD OP VALUE    VALUE is a number with optional K/M/G suffix
+ *   where FIELD/s OP VALUE  (rate per second)
+ *   where FIELD OP PCT% FIELD2   e.g. "where file > 80% max"
+ *
+ * FIELD is a memory.stat key (stat_keys.def) or current / max / high;
+ * OP is one of > >= < <=. Only cgroups read at least once are considered
+ * (both epochs for rates). Each query is one pass over contiguous columns:
+ * a vectorizable kernel builds the value or match column, then a scalar
+ * pass collects ids (top-K through a K-entry min-heap).
+ */
+#ifndef CGQUERY_H
+#define CGQUERY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "snapstore.h"
+
+#define CGQ_MAX_RESULTS	256
+
+enum cgq_kind {
+	CGQ_TOP,
+	CGQ_WHERE,
+};
+
+enum cgq_op {
+	CGQ_GT,
+	CGQ_GE,
+	CGQ_LT,
+	CGQ_LE,
+};
+
+struct cgquery {
+	enum cgq_kind kind;
+	uint32_t col;			/* snapstore column */
+	int rate;			/* FIELD/s */
+	uint32_t k;			/* top */
+	enum cgq_op op;			/* where */
+	int64_t value;			/* where ... VALUE */
+	uint32_t pct;			/* where ... PCT% FIELD2, 0 = VALUE form */
+	uint32_t col2;
+};
+
+struct cgq_result {
+	uint32_t matched;		/* may exceed n for where queries */
+	uint32_t n;
+	uint32_t id[CGQ_MAX_RESULTS];
+	int64_t value[CGQ_MAX_RESULTS];	/* per second for rates */
+	uint64_t eval_ns;
+};
+
+/* Returns 0, or -1 with a message in err. */
+int cgquery_parse(const char *text, struct cgquery *q, char *err,
+		  size_t errlen);
+/* Name of a snapstore column as accepted by cgquery_parse(). */
+const char *cgquery_col_name(uint32_t col);
+
+/* Uses snapstore scratch columns 0..2. Returns the number of ids in r. */
+int cgquery_run(const struct cgquery *q, const struct snapstore *s,
+		struct cgq_result *r);
+
+#endif /* CGQUERY_H */
@@ -0,0 +1,301 @@
+/*
+ * Live top-K / threshold queries over every cgroup below ROOT.
+ *
+ * Refreshes memory.stat, memory.current, memory.max and memory.high of all
+ * cgroups once per interval through one fdcache (open-once fds) into a
+ * snapstore, then answers queries from the in-memory columns without
+ * touching the kernel files. Queries come from -q (re-run every tick) and
+ * from stdin (answered at once, between ticks). See cgquery.h for syntax.
+ *
+ * Usage:
+ *   cgtop [-i interval_ms] [-n ticks] [-d depth] [-b fd_budget]
+ *         [-s rescan_every] [-q query]... ROOT
+ *   cgtop -q "top 10 anon/s" /sys/fs/cgroup
+ *   echo "where file > 80% max" | cgtop -n 3 /sys/fs/cgroup/a
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cgquery.h"
+#include "fdcache.h"
+#include "snapstore.h"
+#include "statparse.h"
+#include "util.h"
+
+#define BUF_SIZE	65536
+#define MAX_QUERIES	8
+
+static char buf[BUF_SIZE];
+static struct stat_sample sample;
+static struct cgq_result result;
+
+static uint64_t read_single(struct fdcache *c, uint32_t id, enum cg_file f,
+			    uint64_t missing)
+{
+	ssize_t n = fdcache_read(c, id, f, buf, sizeof(buf));
+
+	return n > 0 ? statparse_single(buf, (size_t)n) : missing;
+}
+
+/* Parent links for every live id and cleared columns for removed ones. */
+static void sync_tree(struct fdcache *c, struct snapstore *s)
+{
+	char path[4096];
+	uint32_t id;
+
+	if (snapstore_reserve(s, c->nentries) < 0) {
+		perror("snapstore_reserve");
+		exit(1);
+	}
+	for (id = 0; id < c->nentries; id++) {
+		char *slash;
+		uint32_t parent;
+
+		if (!fdcache_live(c, id)) {
+			snapstore_clear(s, id);
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s", fdcache_path(c, id));
+		slash = strrchr(path, '/');
+		parent = SNAP_NO_PARENT;
+		if (slash && slash != path) {
+			*slash = '\0';
+			parent = fdcache_lookup(c, path);
+		}
+		snapstore_set_parent(s, id, parent == FDCACHE_NONE ?
+				     SNAP_NO_PARENT : parent);
+	}
+}
+
+static void refresh(struct fdcache *c, struct snapstore *s)
+{
+	uint32_t id;
+
+	snapstore_begin(s, now_ns());
+	for (id = 0; id < c->nentries; id++) {
+		ssize_t n;
+
+		if (!fdcache_live(c, id))
+			continue;
+		n = fdcache_read(c, id, CGF_MEMORY_STAT, buf, sizeof(buf));
+		if (n == -ENOENT) {
+			snapstore_clear(s, id);
+			continue;
+		}
+		if (n < 0)
+			continue;
+		statparse_text(buf, (size_t)n, &sample);
+		snapstore_put(s, id, &sample, now_ns());
+		/* the root has no current/max/high */
+		snapstore_set(s, id, SNAP_COL_CURRENT,
+			      read_single(c, id, CGF_MEMORY_CURRENT, 0));
+		snapstore_set(s, id, SNAP_COL_MAX,
+			      read_single(c, id, CGF_MEMORY_MAX, UINT64_MAX));
+		snapstore_set(s, id, SNAP_COL_HIGH,
+			      read_single(c, id, CGF_MEMORY_HIGH, UINT64_MAX));
+	}
+}
+
+static void print_value(uint32_t col, int rate, int64_t v)
+{
+	int bytes = col >= STAT_KEY_NR || stat_key_unit(col) == STAT_UNIT_BYTES;
+	double x = (double)v;
+
+	if (!rate && (uint64_t)v >= INT64_MAX) {
+		printf("%14s", "max");
+	} else if (bytes && (v >= 1 << 20 || v <= -(1 << 20))) {
+		printf("%10.1f MiB", x / (1 << 20));
+	} else if (bytes && (v >= 1 << 10 || v <= -(1 << 10))) {
+		printf("%10.1f KiB", x / (1 << 10));
+	} else {
+		printf("%14lld", (long long)v);
+	}
+	printf("%s", rate ? "/s" : "  ");
+}
+
+static void answer(const char *text, const struct cgquery *q,
+		   const struct fdcache *c, const struct snapstore *s)
+{
+	uint32_t i;
+
+	cgquery_run(q, s, &result);
+	printf("-- %s: %u matched, %.1f us\n", text, result.matched,
+	       (double)result.eval_ns / 1e3);
+	if (q->rate && !snapstore_has_prev(s))
+		printf("   (rates need two refreshes)\n");
+	for (i = 0; i < result.n; i++) {
+		printf("   ");
+		print_value(q->col, q->rate, result.value[i]);
+		printf("  %s\n", fdcache_path(c, result.id[i]));
+	}
+	if (result.matched > result.n && q->kind == CGQ_WHERE)
+		printf("   ... %u more\n", result.matched - result.n);
+	fflush(stdout);
+}
+
+static void handle_line(char *line, const struct fdcache *c,
+			const struct snapstore *s)
+{
+	struct cgquery q;
+	char err[128];
+
+	if (!line[0] || line[0] == '#')
+		return;
+	if (cgquery_parse(line, &q, err, sizeof(err)) < 0) {
+		printf("-- %s: %s\n", line, err);
+		fflush(stdout);
+		return;
+	}
+	answer(line, &q, c, s);
+}
+
+/*
+ * Answer every complete line waiting on stdin. read() rather than stdio so
+ * poll() never misses lines sitting in a FILE buffer. Returns 0 at EOF.
+ */
+static int read_queries(const struct fdcache *c, const struct snapstore *s)
+{
+	static char in[4096];
+	static size_t inlen;
+	ssize_t n = read(STDIN_FILENO, in + inlen, sizeof(in) - 1 - inlen);
+	char *nl;
+
+	if (n <= 0) {
+		if (n < 0 && errno == EINTR)
+			return 1;
+		in[inlen] = '\0';
+		handle_line(in, c, s);
+		inlen = 0;
+		return 0;
+	}
+	inlen += (size_t)n;
+	while ((nl = memchr(in, '\n', inlen))) {
+		*nl = '\0';
+		handle_line(in, c, s);
+		inlen -= (size_t)(nl + 1 - in);
+		memmove(in, nl + 1, inlen);
+	}
+	if (inlen == sizeof(in) - 1)
+		inlen = 0;	/* overlong line: drop it */
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	struct cgquery queries[MAX_QUERIES];
+	const char *qtext[MAX_QUERIES];
+	int nq = 0, depth = 8, rescan = 10, opt, i, stdin_open = 1;
+	long interval_ms = 1000, ticks = 0, tick;
+	uint32_t budget = 0;
+	struct fdcache c;
+	struct snapstore s;
+	char err[128];
+
+	while ((opt = getopt(argc, argv, "i:n:d:b:s:q:")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval_ms = atol(optarg);
+			break;
+		case 'n':
+			ticks = atol(optarg);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'b':
+			budget = (uint32_t)atoi(optarg);
+			break;
+		case 's':
+			rescan = atoi(optarg);
+			break;
+		case 'q':
+			if (nq == MAX_QUERIES) {
+				fprintf(stderr, "at most %d -q queries\n",
+					MAX_QUERIES);
+				return 1;
+			}
+			if (cgquery_parse(optarg, &queries[nq], err,
+					  sizeof(err)) < 0) {
+				fprintf(stderr, "%s: %s\n", optarg, err);
+				return 1;
+			}
+			qtext[nq++] = optarg;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || interval_ms <= 0 || ticks < 0 ||
+	    depth < 0 || rescan < 0)
+		goto usage;
+
+	if (fdcache_init(&c, budget) < 0 || snapstore_init(&s, 1024) < 0) {
+		perror("init");
+		return 1;
+	}
+	if (fdcache_scan(&c, argv[optind], depth) <= 0) {
+		fprintf(stderr, "no cgroups with memory.stat below %s\n",
+			argv[optind]);
+		return 1;
+	}
+	sync_tree(&c, &s);
+
+	for (tick = 1; !ticks || tick <= ticks; tick++) {
+		uint64_t t0 = now_ns(), deadline;
+
+		if (rescan && tick > 1 && tick % rescan == 0) {
+			fdcache_scan(&c, argv[optind], depth);
+			sync_tree(&c, &s);
+		}
+		refresh(&c, &s);
+		if (nq) {
+			printf("=== tick %ld: %u cgroups refreshed in %.2f ms ===\n",
+			       tick, s.n, (double)(now_ns() - t0) / 1e6);
+			for (i = 0; i < nq; i++)
+				answer(qtext[i], &queries[i], &c, &s);
+		}
+		if (!nq && !stdin_open)
+			break;
+
+		/* answer stdin queries until the next refresh is due */
+		deadline = t0 + (uint64_t)interval_ms * 1000000;
+		for (;;) {
+			struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+			uint64_t now = now_ns();
+			int wait_ms;
+
+			if (now >= deadline)
+				break;
+			wait_ms = (int)((deadline - now + 999999) / 1000000);
+			if (!stdin_open) {
+				usleep((useconds_t)wait_ms * 1000);
+				continue;
+			}
+			if (poll(&pfd, 1, wait_ms) <= 0)
+				continue;
+			if (!read_queries(&c, &s)) {
+				stdin_open = 0;
+				if (!nq)
+					break;
+			}
+		}
+		if (!nq && !stdin_open)
+			break;
+	}
+
+	snapstore_destroy(&s);
+	fdcache_destroy(&c);
+	return 0;
+
+usage:
+	fprintf(stderr, "USAGE: %s [-i interval_ms] [-n ticks] [-d depth] "
+		"[-b fd_budget] [-s rescan_every] [-q query]... ROOT\n", argv[0]);
+	fprintf(stderr, "  query: top K FIELD[/s] | where FIELD[/s] OP VALUE | "
+		"where FIELD OP PCT%% FIELD2\n");
+	return 1;
+}
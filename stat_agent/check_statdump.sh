@@ -0,0 +1,80 @@
+#!/bin/bash
+# Check that statdump writes the same bytes through statout and through the
+# stdio path (-p), in every format, on a fake cgroup tree whose byte counters
+# sit on rounding ties (x.25 / x.75 of KiB, MiB, GiB, TiB) and next to them.
+# Timestamps differ between the two runs and are masked.
+# Usage:
+#   make check
+#   ./check_statdump.sh [STATDUMP_BIN]
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+STATDUMP="${1:-${SCRIPT_DIR}/statdump}"
+
+if [[ ! -x "${STATDUMP}" ]]; then
+  echo "Error: ${STATDUMP} not found or not executable (run make first)" >&2
+  exit 1
+fi
+
+TREE="$(mktemp -d)"
+trap 'rm -rf "${TREE}"' EXIT
+
+KiB=1024
+MiB=$((1024 * KiB))
+GiB=$((1024 * MiB))
+TiB=$((1024 * GiB))
+
+# value for "<whole> + <quarters>/4 <unit>", plus an offset in bytes
+q() { echo $(($1 * $3 + $2 * $3 / 4 + ${4:-0})); }
+
+# root: ties to even and odd tenths in every unit
+cat > "${TREE}/memory.stat" <<EOF
+anon $(q 14 1 "${MiB}")
+file $(q 14 3 "${MiB}")
+anon_thp $(q 0 1 "${MiB}")
+kernel_stack $(q 0 3 "${MiB}")
+pagetables $(q 1 1 "${KiB}")
+sec_pagetables $(q 1 3 "${KiB}")
+percpu $(q 2 1 "${GiB}")
+sock $(q 3 3 "${GiB}")
+vmalloc $(q 0 1 "${GiB}")
+shmem $(q 0 3 "${GiB}")
+zswap $(q 5 1 "${TiB}")
+zswapped $(q 5 3 "${TiB}")
+file_mapped 1023
+file_dirty 1024
+pgfault 14942208
+EOF
+cat > "${TREE}/memory.numa_stat" <<EOF
+anon N0=$(q 7 1 "${MiB}") N1=$(q 7 3 "${MiB}")
+file N0=$(q 1 1 "${GiB}") N1=$(q 1 3 "${GiB}")
+EOF
+
+# child: one byte either side of the ties, and the carry into the next whole
+mkdir "${TREE}/c"
+cat > "${TREE}/c/memory.stat" <<EOF
+anon $(q 14 1 "${MiB}" -1)
+file $(q 14 1 "${MiB}" 1)
+slab_reclaimable $(q 2 3 "${GiB}" -1)
+kernel_stack $(q 2 3 "${GiB}" 1)
+shmem $((1024 * KiB - 1))
+percpu $((10 * MiB - 1))
+EOF
+printf 'anon N0=%s\n' "$(q 0 1 "${KiB}")" > "${TREE}/c/memory.numa_stat"
+
+mask() { sed -E 's/^[0-9]+,/TS,/; s/"ts":[0-9]+/"ts":TS/'; }
+
+fail=0
+for fmt in human csv json; do
+  a="$("${STATDUMP}" -f "${fmt}" -N -i 0 -n 2 "${TREE}" 2>/dev/null | mask)"
+  b="$("${STATDUMP}" -f "${fmt}" -N -i 0 -n 2 -p "${TREE}" 2>/dev/null | mask)"
+  if [[ "${a}" == "${b}" ]]; then
+    echo "ok    ${fmt}"
+  else
+    echo "FAIL  ${fmt}: statout and -p differ"
+    diff <(echo "${a}") <(echo "${b}") | head -20
+    fail=1
+  fi
+done
+exit "${fail}"
@@ -0,0 +1,553 @@
+/*
+ * Cgroup churn vs. read cost of the parent's memory.stat.
+ *
+ * A churner process creates leaf cgroups below PARENT at a fixed rate. A
+ * short-lived child joins each leaf, charges it (page cache by default,
+ * which outlives the cgroup, or anonymous memory) and exits. The leaf is
+ * removed once it is `lifetime` old. Leaves whose pages are still charged
+ * become dying memcgs and show up in PARENT/cgroup.stat as
+ * nr_dying_descendants.
+ *
+ * Meanwhile the reader samples PARENT every interval: cgroup.stat, then
+ * `reads` back-to-back reads of memory.stat on one open fd. The first read
+ * after the idle interval has all the pending stat updates to flush; the
+ * others find little to flush. So "first" is the flush-bound read cost,
+ * "hot" is the median of the rest, and first - hot estimates the flush.
+ * After the churn the reader keeps sampling for `settle` seconds, to see
+ * whether the dying count and the latency come back down.
+ *
+ * At the end it prints the Pearson correlation and the least-squares slope
+ * (ns per dying memcg) of each latency against nr_dying_descendants, and
+ * the mean latencies per quintile of the dying count.
+ *
+ * Usage:
+ *   churn_bench [-r leaves_per_s] [-s KiB] [-m file|anon] [-l lifetime_ms]
+ *               [-t churn_s] [-T settle_s] [-i interval_ms] [-n reads]
+ *               [-d file_dir] [-o out.tsv] PARENT
+ *   churn_bench -r 20 -s 256 -t 120 -d /var/tmp /sys/fs/cgroup/churn
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "statparse.h"
+#include "util.h"
+
+#define READ_BUF_SIZE	65536
+#define MAX_LIVE	4096
+#define MAX_READS	1024
+
+struct config {
+	const char *parent;
+	const char *file_dir;
+	double rate;
+	size_t bytes;
+	int file_mode;
+	long lifetime_ms;
+	long churn_s, settle_s;
+	long interval_ms;
+	int reads;
+};
+
+/* Shared with the churner: counts only, written by it, read by the reader. */
+struct churn_counts {
+	volatile uint64_t created;
+	volatile uint64_t removed;
+	volatile uint64_t failed;
+	volatile int done;
+};
+
+struct row {
+	double t;
+	uint64_t descendants, dying;
+	uint64_t created, removed;
+	uint64_t first_ns, hot_ns, max_ns;
+};
+
+static char g_buf[READ_BUF_SIZE];
+static struct stat_sample g_sample;
+
+/* ---- churner ---- */
+
+static int join_cgroup(const char *leaf)
+{
+	char path[600];
+	int fd, ret;
+
+	snprintf(path, sizeof(path), "%s/cgroup.procs", leaf);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, "0", 1) == 1 ? 0 : -1;
+	close(fd);
+	return ret;
+}
+
+/* Child: join the leaf, charge it, exit. Page cache stays charged. */
+static void charge_leaf(const struct config *cfg, const char *leaf,
+			uint64_t seq)
+{
+	static char chunk[1 << 16];
+	char path[512];
+	size_t off;
+	char *mem;
+	int fd;
+
+	if (join_cgroup(leaf) < 0)
+		_exit(1);
+	if (!cfg->file_mode) {
+		mem = mmap(NULL, cfg->bytes, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mem == MAP_FAILED)
+			_exit(1);
+		for (off = 0; off < cfg->bytes; off += 4096)
+			mem[off] = 1;
+		_exit(0);
+	}
+	memset(chunk, 1, sizeof(chunk));
+	snprintf(path, sizeof(path), "%s/churn_bench.%d.%llu", cfg->file_dir,
+		 (int)getppid(), (unsigned long long)seq);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		_exit(1);
+	for (off = 0; off < cfg->bytes; off += sizeof(chunk)) {
+		size_t len = cfg->bytes - off < sizeof(chunk) ?
+			     cfg->bytes - off : sizeof(chunk);
+
+		if (write(fd, chunk, len) != (ssize_t)len)
+			_exit(1);
+	}
+	close(fd);
+	_exit(0);
+}
+
+static void leaf_path(const struct config *cfg, char *path, size_t len,
+		      uint64_t seq)
+{
+	snprintf(path, len, "%s/churn.%llu", cfg->parent, (unsigned long long)seq);
+}
+
+static void unlink_files(const struct config *cfg, uint64_t upto)
+{
+	char path[512];
+	uint64_t seq;
+
+	if (!cfg->file_mode)
+		return;
+	for (seq = 0; seq < upto; seq++) {
+		snprintf(path, sizeof(path), "%s/churn_bench.%d.%llu",
+			 cfg->file_dir, (int)getpid(), (unsigned long long)seq);
+		unlink(path);
+	}
+}
+
+static void churner(const struct config *cfg, struct churn_counts *cnt)
+{
+	static uint64_t live_seq[MAX_LIVE], live_ns[MAX_LIVE];
+	uint64_t start = now_ns(), next = start, seq = 0, step;
+	uint32_t head = 0, nlive = 0;
+	char path[512];
+
+	step = (uint64_t)(1e9 / cfg->rate);
+	while (now_ns() - start < (uint64_t)cfg->churn_s * 1000000000) {
+		uint64_t now = now_ns();
+		struct timespec ts;
+		pid_t pid;
+		int status;
+
+		/* remove leaves that reached their lifetime, oldest first */
+		while (nlive && (now - live_ns[head] >=
+				 (uint64_t)cfg->lifetime_ms * 1000000 ||
+				 nlive == MAX_LIVE)) {
+			leaf_path(cfg, path, sizeof(path), live_seq[head]);
+			if (rmdir(path) == 0)
+				cnt->removed++;
+			else
+				cnt->failed++;
+			head = (head + 1) % MAX_LIVE;
+			nlive--;
+		}
+
+		leaf_path(cfg, path, sizeof(path), seq);
+		if (mkdir(path, 0755) < 0) {
+			cnt->failed++;
+		} else {
+			pid = fork();
+			if (pid == 0)
+				charge_leaf(cfg, path, seq);
+			if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+			    !WIFEXITED(status) || WEXITSTATUS(status))
+				cnt->failed++;
+			cnt->created++;
+			live_seq[(head + nlive) % MAX_LIVE] = seq;
+			live_ns[(head + nlive) % MAX_LIVE] = now_ns();
+			nlive++;
+		}
+		seq++;
+
+		next += step;
+		if (next < now_ns())
+			next = now_ns();
+		ts = ns_to_ts(next);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+				       NULL) == EINTR)
+			;
+	}
+	while (nlive) {
+		leaf_path(cfg, path, sizeof(path), live_seq[head]);
+		if (rmdir(path) == 0)
+			cnt->removed++;
+		else
+			cnt->failed++;
+		head = (head + 1) % MAX_LIVE;
+		nlive--;
+	}
+	cnt->done = 1;
+	/* the page cache keeps dying memcgs pinned until the reader is done */
+	while (getppid() != 1 && cnt->done == 1)
+		usleep(100000);
+	unlink_files(cfg, seq);
+	_exit(0);
+}
+
+/* ---- reader ---- */
+
+static int read_cgroup_stat(int fd, uint64_t *desc, uint64_t *dying)
+{
+	static uint32_t k_desc, k_dying;
+	ssize_t n = read_whole(fd, g_buf, sizeof(g_buf));
+	uint32_t i;
+
+	if (n < 0)
+		return -1;
+	if (!k_desc) {
+		k_desc = statparse_key("nr_descendants", 14);
+		k_dying = statparse_key("nr_dying_descendants", 20);
+	}
+	statparse_text(g_buf, (size_t)n, &g_sample);
+	*desc = *dying = 0;
+	for (i = 0; i < g_sample.n; i++) {
+		if (g_sample.e[i].key == k_desc)
+			*desc = g_sample.e[i].value;
+		else if (g_sample.e[i].key == k_dying)
+			*dying = g_sample.e[i].value;
+	}
+	return 0;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void sample(const struct config *cfg, int stat_fd, int cgstat_fd,
+		   struct row *r)
+{
+	static uint64_t lat[MAX_READS];
+	int i;
+
+	read_cgroup_stat(cgstat_fd, &r->descendants, &r->dying);
+	for (i = 0; i < cfg->reads; i++) {
+		uint64_t t0 = now_ns();
+
+		read_whole(stat_fd, g_buf, sizeof(g_buf));
+		lat[i] = now_ns() - t0;
+	}
+	r->first_ns = lat[0];
+	if (cfg->reads > 1) {
+		qsort(lat + 1, (size_t)cfg->reads - 1, sizeof(lat[0]), cmp_u64);
+		r->hot_ns = lat[1 + (cfg->reads - 1) / 2];
+		r->max_ns = lat[cfg->reads - 1];
+	} else {
+		r->hot_ns = r->max_ns = lat[0];
+	}
+	if (r->max_ns < r->first_ns)
+		r->max_ns = r->first_ns;
+}
+
+static double row_val(const struct row *r, int which)
+{
+	switch (which) {
+	case 0:
+		return (double)r->first_ns;
+	case 1:
+		return (double)r->hot_ns;
+	default:
+		return (double)r->first_ns - (double)r->hot_ns;
+	}
+}
+
+static void correlate(const struct row *rows, int n)
+{
+	static const char *const names[] = { "first read", "hot read", "flush est" };
+	double sx = 0, sxx = 0, mx;
+	int w, i;
+
+	for (i = 0; i < n; i++) {
+		sx += (double)rows[i].dying;
+		sxx += (double)rows[i].dying * (double)rows[i].dying;
+	}
+	mx = sx / n;
+	printf("\n=== Against nr_dying_descendants (%d samples) ===\n", n);
+	if (sxx - sx * mx <= 0) {
+		printf("nr_dying_descendants never changed; nothing to correlate\n");
+		return;
+	}
+	printf("%-11s %8s %14s\n", "", "pearson", "ns per dying");
+	for (w = 0; w < 3; w++) {
+		double sy = 0, syy = 0, sxy = 0, my, cov, vx, vy;
+
+		for (i = 0; i < n; i++) {
+			double y = row_val(&rows[i], w);
+
+			sy += y;
+			syy += y * y;
+			sxy += (double)rows[i].dying * y;
+		}
+		my = sy / n;
+		cov = sxy - sx * my;
+		vx = sxx - sx * mx;
+		vy = syy - sy * my;
+		printf("%-11s %8.3f %14.2f\n", names[w],
+		       vy > 0 ? cov / sqrt(vx * vy) : 0.0, cov / vx);
+	}
+}
+
+static int cmp_row_dying(const void *a, const void *b)
+{
+	const struct row *x = a, *y = b;
+
+	return x->dying < y->dying ? -1 : x->dying > y->dying;
+}
+
+/* Mean latencies per quintile of the dying count; sorts rows. */
+static void quintiles(struct row *rows, int n)
+{
+	int q;
+
+	qsort(rows, (size_t)n, sizeof(rows[0]), cmp_row_dying);
+	printf("\n%-17s %8s %12s %12s %12s\n", "nr_dying", "samples",
+	       "first ns", "hot ns", "flush ns");
+	for (q = 0; q < 5; q++) {
+		int lo = n * q / 5, hi = n * (q + 1) / 5, i;
+		double f = 0, h = 0;
+		char range[32];
+
+		if (hi <= lo)
+			continue;
+		for (i = lo; i < hi; i++) {
+			f += (double)rows[i].first_ns;
+			h += (double)rows[i].hot_ns;
+		}
+		snprintf(range, sizeof(range), "%llu..%llu",
+			 (unsigned long long)rows[lo].dying,
+			 (unsigned long long)rows[hi - 1].dying);
+		printf("%-17s %8d %12.0f %12.0f %12.0f\n", range, hi - lo,
+		       f / (hi - lo), h / (hi - lo), (f - h) / (hi - lo));
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "USAGE: %s [-r leaves_per_s] [-s KiB] [-m file|anon] "
+		"[-l lifetime_ms] [-t churn_s] [-T settle_s] [-i interval_ms] "
+		"[-n reads] [-d file_dir] [-o out.tsv] PARENT\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct config cfg = {
+		.file_dir = ".",
+		.rate = 10,
+		.bytes = 256 << 10,
+		.file_mode = 1,
+		.lifetime_ms = 0,
+		.churn_s = 60,
+		.settle_s = 10,
+		.interval_ms = 500,
+		.reads = 20,
+	};
+	const char *out_path = NULL;
+	struct churn_counts *cnt;
+	struct row *rows;
+	int nrows = 0, maxrows, stat_fd, cgstat_fd, opt, status;
+	uint64_t start, next, churn_end = 0;
+	char path[512];
+	FILE *out = NULL;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "r:s:m:l:t:T:i:n:d:o:")) != -1) {
+		switch (opt) {
+		case 'r':
+			cfg.rate = atof(optarg);
+			break;
+		case 's':
+			cfg.bytes = (size_t)atol(optarg) << 10;
+			break;
+		case 'm':
+			if (strcmp(optarg, "file") && strcmp(optarg, "anon"))
+				usage(argv[0]);
+			cfg.file_mode = !strcmp(optarg, "file");
+			break;
+		case 'l':
+			cfg.lifetime_ms = atol(optarg);
+			break;
+		case 't':
+			cfg.churn_s = atol(optarg);
+			break;
+		case 'T':
+			cfg.settle_s = atol(optarg);
+			break;
+		case 'i':
+			cfg.interval_ms = atol(optarg);
+			break;
+		case 'n':
+			cfg.reads = atoi(optarg);
+			break;
+		case 'd':
+			cfg.file_dir = optarg;
+			break;
+		case 'o':
+			out_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || cfg.rate <= 0 || cfg.bytes == 0 ||
+	    cfg.lifetime_ms < 0 || cfg.churn_s <= 0 || cfg.settle_s < 0 ||
+	    cfg.interval_ms <= 0 || cfg.reads <= 0 || cfg.reads > MAX_READS)
+		usage(argv[0]);
+	cfg.parent = argv[optind];
+
+	snprintf(path, sizeof(path), "%s/memory.stat", cfg.parent);
+	stat_fd = open(path, O_RDONLY);
+	if (stat_fd < 0) {
+		perror(path);
+		return 1;
+	}
+	snprintf(path, sizeof(path), "%s/cgroup.stat", cfg.parent);
+	cgstat_fd = open(path, O_RDONLY);
+	if (cgstat_fd < 0) {
+		perror(path);
+		return 1;
+	}
+	/* leaves need the memory controller; fails harmlessly if already on */
+	snprintf(path, sizeof(path), "%s/cgroup.subtree_control", cfg.parent);
+	{
+		int fd = open(path, O_WRONLY);
+
+		if (fd >= 0) {
+			if (write(fd, "+memory", 7) < 0)
+				fprintf(stderr, "%s: +memory: %s\n", path,
+					strerror(errno));
+			close(fd);
+		}
+	}
+
+	maxrows = (int)((cfg.churn_s + cfg.settle_s) * 1000 / cfg.interval_ms) + 16;
+	rows = calloc((size_t)maxrows, sizeof(*rows));
+	cnt = mmap(NULL, sizeof(*cnt), PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (!rows || cnt == MAP_FAILED) {
+		perror("alloc");
+		return 1;
+	}
+	memset(cnt, 0, sizeof(*cnt));
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (pid == 0)
+		churner(&cfg, cnt);
+
+	if (out_path) {
+		out = fopen(out_path, "w");
+		if (!out) {
+			perror(out_path);
+			return 1;
+		}
+		fprintf(out, "t_s\tnr_descendants\tnr_dying\tcreated\tremoved\t"
+			"first_ns\thot_ns\tmax_ns\n");
+	}
+	printf("=== churn_bench: %s, %.1f leaves/s, %zu KiB %s each, lifetime %ld ms, "
+	       "%ld s churn + %ld s settle ===\n", cfg.parent, cfg.rate,
+	       cfg.bytes >> 10, cfg.file_mode ? "page cache" : "anon",
+	       cfg.lifetime_ms, cfg.churn_s, cfg.settle_s);
+	printf("%7s %6s %7s %8s %8s %10s %10s %10s\n", "t_s", "desc", "dying",
+	       "created", "removed", "first_ns", "hot_ns", "max_ns");
+
+	start = now_ns();
+	next = start;
+	while (nrows < maxrows) {
+		struct row *r = &rows[nrows];
+		struct timespec ts;
+
+		if (cnt->done && !churn_end)
+			churn_end = now_ns();
+		if (churn_end && now_ns() - churn_end >=
+				 (uint64_t)cfg.settle_s * 1000000000)
+			break;
+
+		sample(&cfg, stat_fd, cgstat_fd, r);
+		r->t = (double)(now_ns() - start) / 1e9;
+		r->created = cnt->created;
+		r->removed = cnt->removed;
+		printf("%7.1f %6llu %7llu %8llu %8llu %10llu %10llu %10llu%s\n",
+		       r->t, (unsigned long long)r->descendants,
+		       (unsigned long long)r->dying,
+		       (unsigned long long)r->created,
+		       (unsigned long long)r->removed,
+		       (unsigned long long)r->first_ns,
+		       (unsigned long long)r->hot_ns,
+		       (unsigned long long)r->max_ns, churn_end ? "  (settle)" : "");
+		if (out)
+			fprintf(out, "%.3f\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\n",
+				r->t, (unsigned long long)r->descendants,
+				(unsigned long long)r->dying,
+				(unsigned long long)r->created,
+				(unsigned long long)r->removed,
+				(unsigned long long)r->first_ns,
+				(unsigned long long)r->hot_ns,
+				(unsigned long long)r->max_ns);
+		fflush(stdout);
+		nrows++;
+
+		next += (uint64_t)cfg.interval_ms * 1000000;
+		if (next < now_ns())
+			next = now_ns();
+		ts = ns_to_ts(next);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+				       NULL) == EINTR)
+			;
+	}
+
+	/* let the churner drop its page cache files and exit */
+	cnt->done = 2;
+	waitpid(pid, &status, 0);
+	if (out)
+		fclose(out);
+
+	printf("\ncreated %llu, removed %llu, failed %llu (mkdir/charge/rmdir)\n",
+	       (unsigned long long)cnt->created, (unsigned long long)cnt->removed,
+	       (unsigned long long)cnt->failed);
+	if (nrows >= 2) {
+		correlate(rows, nrows);
+		quintiles(rows, nrows);
+	}
+	free(rows);
+	return 0;
+}
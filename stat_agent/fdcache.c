@@ -0,0 +1,452 @@
+/*
+ * dirfd-relative fd cache with an LRU fd budget. See fdcache.h.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fdcache.h"
+#include "util.h"
+
+#define FDCACHE_MAX_BUDGET	(1u << 20)
+#define SCAN_PATH_MAX		4096
+
+static const char *const file_names[CGF_NR] = {
+	[CGF_MEMORY_STAT]    = "memory.stat",
+	[CGF_NUMA_STAT]      = "memory.numa_stat",
+	[CGF_MEMORY_CURRENT] = "memory.current",
+	[CGF_MEMORY_MAX]     = "memory.max",
+	[CGF_MEMORY_HIGH]    = "memory.high",
+	[CGF_CGROUP_STAT]    = "cgroup.stat",
+	[CGF_STAT_KS]        = "memory.stat.ks",
+	[CGF_NUMA_STAT_KS]   = "memory.numa_stat.ks",
+	[CGF_STAT_BIN]       = "memory.stat_bin",
+	[CGF_NUMA_STAT_BIN]  = "memory.numa_stat_bin",
+};
+
+const char *fdcache_file_name(enum cg_file f)
+{
+	return f < CGF_NR ? file_names[f] : "?";
+}
+
+static uint32_t path_hash(const char *s)
+{
+	uint32_t h = 2166136261u;
+
+	while (*s)
+		h = (h ^ (uint8_t)*s++) * 16777619u;
+	return h;
+}
+
+/* ---- LRU of open stat fds ---- */
+
+static void lru_unlink(struct fdcache *c, uint32_t slot)
+{
+	uint32_t p = c->lru_prev[slot], n = c->lru_next[slot];
+
+	if (p != FDCACHE_NONE)
+		c->lru_next[p] = n;
+	else
+		c->lru_head = n;
+	if (n != FDCACHE_NONE)
+		c->lru_prev[n] = p;
+	else
+		c->lru_tail = p;
+}
+
+static void lru_push_head(struct fdcache *c, uint32_t slot)
+{
+	c->lru_prev[slot] = FDCACHE_NONE;
+	c->lru_next[slot] = c->lru_head;
+	if (c->lru_head != FDCACHE_NONE)
+		c->lru_prev[c->lru_head] = slot;
+	else
+		c->lru_tail = slot;
+	c->lru_head = slot;
+}
+
+static void close_dir(struct fdcache *c, struct fdcache_entry *e)
+{
+	if (e->dirfd >= 0) {
+		close(e->dirfd);
+		e->dirfd = -1;
+		c->nopen--;
+	}
+}
+
+static void close_slot(struct fdcache *c, uint32_t slot)
+{
+	struct fdcache_entry *e = &c->e[slot / CGF_NR];
+
+	lru_unlink(c, slot);
+	close(e->fd[slot % CGF_NR]);
+	e->fd[slot % CGF_NR] = -1;
+	e->nfds--;
+	c->nopen--;
+}
+
+/*
+ * Evict LRU stat fds until need more fds fit. A cgroup left without stat
+ * fds also gives up its dirfd, except the one we are about to open into.
+ */
+static int make_room(struct fdcache *c, uint32_t need, uint32_t protect)
+{
+	while (c->nopen + need > c->budget) {
+		uint32_t slot = c->lru_tail, id;
+
+		if (slot == FDCACHE_NONE)
+			return -1;
+		id = slot / CGF_NR;
+		close_slot(c, slot);
+		c->stats.evictions++;
+		if (c->e[id].nfds == 0 && id != protect)
+			close_dir(c, &c->e[id]);
+	}
+	return 0;
+}
+
+/* ---- entries and path hash ---- */
+
+static void hash_insert(struct fdcache *c, uint32_t id)
+{
+	uint32_t b = path_hash(c->e[id].path) & (c->nbuckets - 1);
+
+	c->e[id].hash_next = c->buckets[b];
+	c->buckets[b] = id;
+}
+
+static void hash_remove(struct fdcache *c, uint32_t id)
+{
+	uint32_t *pp = &c->buckets[path_hash(c->e[id].path) & (c->nbuckets - 1)];
+
+	while (*pp != FDCACHE_NONE) {
+		if (*pp == id) {
+			*pp = c->e[id].hash_next;
+			return;
+		}
+		pp = &c->e[*pp].hash_next;
+	}
+}
+
+static int grow(struct fdcache *c)
+{
+	uint32_t cap = c->cap ? c->cap * 2 : 256, i;
+	struct fdcache_entry *e;
+	uint32_t *prev, *next, *buckets;
+
+	e = realloc(c->e, cap * sizeof(*e));
+	if (!e)
+		return -1;
+	c->e = e;
+	prev = realloc(c->lru_prev, (size_t)cap * CGF_NR * sizeof(uint32_t));
+	if (!prev)
+		return -1;
+	c->lru_prev = prev;
+	next = realloc(c->lru_next, (size_t)cap * CGF_NR * sizeof(uint32_t));
+	if (!next)
+		return -1;
+	c->lru_next = next;
+
+	/* keep at least one bucket per entry */
+	buckets = malloc(cap * sizeof(uint32_t));
+	if (!buckets)
+		return -1;
+	free(c->buckets);
+	c->buckets = buckets;
+	c->nbuckets = cap;
+	for (i = 0; i < cap; i++)
+		c->buckets[i] = FDCACHE_NONE;
+	for (i = 0; i < c->nentries; i++)
+		if (c->e[i].live)
+			hash_insert(c, i);
+	c->cap = cap;
+	return 0;
+}
+
+static void drop_entry(struct fdcache *c, uint32_t id)
+{
+	struct fdcache_entry *e = &c->e[id];
+	int f;
+
+	for (f = 0; f < CGF_NR; f++)
+		if (e->fd[f] >= 0)
+			close_slot(c, id * CGF_NR + (uint32_t)f);
+	close_dir(c, e);
+	hash_remove(c, id);
+	free(e->path);
+	e->path = NULL;
+	e->live = 0;
+	e->hash_next = c->free_head;
+	c->free_head = id;
+}
+
+int fdcache_init(struct fdcache *c, uint32_t budget)
+{
+	memset(c, 0, sizeof(*c));
+	c->free_head = FDCACHE_NONE;
+	c->lru_head = c->lru_tail = FDCACHE_NONE;
+
+	if (budget == 0) {
+		struct rlimit rl;
+
+		if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+			return -1;
+		if (rl.rlim_cur < rl.rlim_max) {
+			rl.rlim_cur = rl.rlim_max;
+			if (setrlimit(RLIMIT_NOFILE, &rl) < 0)
+				getrlimit(RLIMIT_NOFILE, &rl);
+		}
+		if (rl.rlim_cur > FDCACHE_MAX_BUDGET + FDCACHE_RESERVE_FDS)
+			rl.rlim_cur = FDCACHE_MAX_BUDGET + FDCACHE_RESERVE_FDS;
+		budget = rl.rlim_cur > FDCACHE_RESERVE_FDS ?
+			 (uint32_t)(rl.rlim_cur - FDCACHE_RESERVE_FDS) : 0;
+	}
+	/* one dirfd plus one stat fd is the minimum to read anything */
+	c->budget = budget < 2 ? 2 : budget;
+	return grow(c);
+}
+
+void fdcache_destroy(struct fdcache *c)
+{
+	uint32_t i;
+
+	for (i = 0; i < c->nentries; i++)
+		if (c->e[i].live)
+			drop_entry(c, i);
+	free(c->e);
+	free(c->lru_prev);
+	free(c->lru_next);
+	free(c->buckets);
+	memset(c, 0, sizeof(*c));
+}
+
+uint32_t fdcache_lookup(const struct fdcache *c, const char *path)
+{
+	uint32_t id = c->buckets[path_hash(path) & (c->nbuckets - 1)];
+
+	while (id != FDCACHE_NONE) {
+		if (strcmp(c->e[id].path, path) == 0)
+			return id;
+		id = c->e[id].hash_next;
+	}
+	return FDCACHE_NONE;
+}
+
+uint32_t fdcache_add(struct fdcache *c, const char *path)
+{
+	struct fdcache_entry *e;
+	uint32_t id = fdcache_lookup(c, path);
+	int f;
+
+	if (id != FDCACHE_NONE) {
+		c->e[id].scan_epoch = c->scan_epoch;
+		return id;
+	}
+	if (c->free_head != FDCACHE_NONE) {
+		id = c->free_head;
+		c->free_head = c->e[id].hash_next;
+	} else {
+		if (c->nentries == c->cap && grow(c) < 0)
+			return FDCACHE_NONE;
+		id = c->nentries++;
+	}
+	e = &c->e[id];
+	e->path = strdup(path);
+	if (!e->path) {
+		e->live = 0;
+		e->hash_next = c->free_head;
+		c->free_head = id;
+		return FDCACHE_NONE;
+	}
+	e->dirfd = -1;
+	for (f = 0; f < CGF_NR; f++)
+		e->fd[f] = -1;
+	e->nfds = 0;
+	e->scan_epoch = c->scan_epoch;
+	e->live = 1;
+	hash_insert(c, id);
+	return id;
+}
+
+void fdcache_remove(struct fdcache *c, uint32_t id)
+{
+	if (fdcache_live(c, id))
+		drop_entry(c, id);
+}
+
+static void mark_removed(struct fdcache *c, uint32_t id)
+{
+	c->stats.removed++;
+	drop_entry(c, id);
+}
+
+/* Is the directory behind dirfd still the one at its path? */
+static int dir_alive(const struct fdcache_entry *e)
+{
+	struct stat a, b;
+
+	if (fstat(e->dirfd, &a) < 0 || stat(e->path, &b) < 0)
+		return 0;
+	return a.st_ino == b.st_ino && a.st_dev == b.st_dev;
+}
+
+static int open_file(struct fdcache *c, uint32_t id, enum cg_file f)
+{
+	struct fdcache_entry *e = &c->e[id];
+	uint32_t slot = id * CGF_NR + f;
+	int fd;
+
+	if (make_room(c, e->dirfd < 0 ? 2 : 1, id) < 0)
+		return -EMFILE;
+	if (e->dirfd < 0) {
+		e->dirfd = open(e->path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+		if (e->dirfd < 0) {
+			int err = errno;
+
+			if (err == ENOENT || err == ENOTDIR) {
+				mark_removed(c, id);
+				return -ENOENT;
+			}
+			return -err;
+		}
+		c->nopen++;
+		c->stats.dir_opens++;
+	}
+	fd = openat(e->dirfd, file_names[f], O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		int err = errno;
+
+		if (err == ENOENT || err == ENODEV) {
+			if (!dir_alive(e)) {
+				mark_removed(c, id);
+				return -ENOENT;
+			}
+			err = EOPNOTSUPP;
+		}
+		if (e->nfds == 0)
+			close_dir(c, e);
+		return -err;
+	}
+	e->fd[f] = fd;
+	e->nfds++;
+	c->nopen++;
+	c->stats.opens++;
+	lru_push_head(c, slot);
+	return fd;
+}
+
+ssize_t fdcache_read(struct fdcache *c, uint32_t id, enum cg_file f,
+		     char *buf, size_t cap)
+{
+	ssize_t n;
+	int fd;
+
+	if (!fdcache_live(c, id) || f >= CGF_NR)
+		return -ENOENT;
+	c->stats.reads++;
+	fd = c->e[id].fd[f];
+	if (fd >= 0) {
+		uint32_t slot = id * CGF_NR + f;
+
+		c->stats.hits++;
+		if (c->lru_head != slot) {
+			lru_unlink(c, slot);
+			lru_push_head(c, slot);
+		}
+	} else {
+		fd = open_file(c, id, f);
+		if (fd < 0)
+			return fd;
+	}
+	n = read_whole(fd, buf, cap);
+	if (n < 0) {
+		int err = errno;
+
+		if (err == ENODEV || err == ENOENT) {
+			mark_removed(c, id);
+			return -ENOENT;
+		}
+		return -err;
+	}
+	return n;
+}
+
+static int is_cgroup_dir(int dirfd)
+{
+	return faccessat(dirfd, "memory.stat", F_OK, 0) == 0;
+}
+
+static void scan_dir(struct fdcache *c, char *path, size_t len, int depth)
+{
+	struct dirent *de;
+	DIR *d;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+	if (is_cgroup_dir(fd))
+		fdcache_add(c, path);
+	if (depth == 0) {
+		close(fd);
+		return;
+	}
+	d = fdopendir(fd);
+	if (!d) {
+		close(fd);
+		return;
+	}
+	while ((de = readdir(d)) != NULL) {
+		size_t nlen = strlen(de->d_name);
+
+		if (de->d_name[0] == '.')
+			continue;
+		if (de->d_type != DT_DIR && de->d_type != DT_UNKNOWN)
+			continue;
+		if (len + 1 + nlen >= SCAN_PATH_MAX)
+			continue;
+		path[len] = '/';
+		memcpy(path + len + 1, de->d_name, nlen + 1);
+		scan_dir(c, path, len + 1 + nlen, depth - 1);
+		path[len] = '\0';
+	}
+	closedir(d);
+}
+
+int fdcache_scan(struct fdcache *c, const char *root, int max_depth)
+{
+	char path[SCAN_PATH_MAX];
+	size_t len = strlen(root);
+	uint32_t id;
+	int live = 0;
+
+	while (len > 1 && root[len - 1] == '/')
+		len--;
+	if (len >= sizeof(path))
+		return -1;
+	memcpy(path, root, len);
+	path[len] = '\0';
+
+	c->scan_epoch++;
+	scan_dir(c, path, len, max_depth);
+
+	/* anything under root that was not seen this time is gone */
+	for (id = 0; id < c->nentries; id++) {
+		struct fdcache_entry *e = &c->e[id];
+
+		if (!e->live || strncmp(e->path, path, len) != 0 ||
+		    (e->path[len] != '\0' && e->path[len] != '/'))
+			continue;
+		if (e->scan_epoch != c->scan_epoch)
+			mark_removed(c, id);
+		else
+			live++;
+	}
+	return live;
+}
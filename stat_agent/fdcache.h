@@ -0,0 +1,111 @@
+/*
+ * fd cache for reading stat files of many cgroups with open-once cost.
+ *
+ * Each cgroup gets a small integer id. Its directory is opened with
+ * O_PATH and stat files are opened relative to it with openat(), so a read
+ * of a hot file is just lseek(0) + read() on a cached fd. Open stat fds are
+ * kept in one LRU; together with the directory fds they never exceed the
+ * budget (by default derived from RLIMIT_NOFILE). A cgroup whose last stat
+ * fd is evicted also drops its directory fd and is reopened by path later.
+ *
+ * Removed cgroups are detected from ENODEV on read or ENOENT on openat; the
+ * entry is closed, unhashed and its id recycled, and the read returns
+ * -ENOENT so callers drop their own state for that id.
+ */
+#ifndef FDCACHE_H
+#define FDCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define FDCACHE_NONE		UINT32_MAX
+#define FDCACHE_RESERVE_FDS	32	/* left for stdio, sockets, logs */
+
+enum cg_file {
+	CGF_MEMORY_STAT,
+	CGF_NUMA_STAT,
+	CGF_MEMORY_CURRENT,
+	CGF_MEMORY_MAX,
+	CGF_MEMORY_HIGH,
+	CGF_CGROUP_STAT,
+	CGF_STAT_KS,
+	CGF_NUMA_STAT_KS,
+	CGF_STAT_BIN,
+	CGF_NUMA_STAT_BIN,
+	CGF_NR,
+};
+
+struct fdcache_stats {
+	uint64_t reads;
+	uint64_t hits;		/* read on an already open fd */
+	uint64_t opens;		/* openat() of a stat file */
+	uint64_t dir_opens;	/* open(O_PATH) of a cgroup directory */
+	uint64_t evictions;	/* stat fds closed to stay within budget */
+	uint64_t removed;	/* cgroups found deleted */
+};
+
+struct fdcache_entry {
+	char *path;
+	int dirfd;
+	int fd[CGF_NR];
+	uint32_t nfds;			/* open stat fds */
+	uint32_t hash_next;
+	uint32_t scan_epoch;
+	int live;
+};
+
+struct fdcache {
+	struct fdcache_entry *e;
+	uint32_t nentries, cap;
+	uint32_t *buckets;
+	uint32_t nbuckets;
+	uint32_t free_head;		/* recycled ids, linked via hash_next */
+
+	/* LRU of open stat fds; slot = id * CGF_NR + file */
+	uint32_t *lru_prev, *lru_next;
+	uint32_t lru_head, lru_tail;	/* head = most recently used */
+
+	uint32_t budget;		/* max dirfds + stat fds */
+	uint32_t nopen;
+	uint32_t scan_epoch;
+	struct fdcache_stats stats;
+};
+
+const char *fdcache_file_name(enum cg_file f);
+
+/* budget 0 = RLIMIT_NOFILE (soft raised to hard) minus FDCACHE_RESERVE_FDS */
+int fdcache_init(struct fdcache *c, uint32_t budget);
+void fdcache_destroy(struct fdcache *c);
+
+/* Register a cgroup directory; returns its id (existing id if known). */
+uint32_t fdcache_add(struct fdcache *c, const char *path);
+uint32_t fdcache_lookup(const struct fdcache *c, const char *path);
+void fdcache_remove(struct fdcache *c, uint32_t id);
+
+static inline int fdcache_live(const struct fdcache *c, uint32_t id)
+{
+	return id < c->nentries && c->e[id].live;
+}
+
+static inline const char *fdcache_path(const struct fdcache *c, uint32_t id)
+{
+	return fdcache_live(c, id) ? c->e[id].path : NULL;
+}
+
+/*
+ * Read the whole file into buf. Returns bytes read, -ENOENT if the cgroup
+ * is gone (id recycled), -EOPNOTSUPP if the cgroup has no such file (root
+ * has no memory.max, older kernels have no .ks), or another -errno.
+ */
+ssize_t fdcache_read(struct fdcache *c, uint32_t id, enum cg_file f,
+		     char *buf, size_t cap);
+
+/*
+ * Register every cgroup directory below root (root included) up to
+ * max_depth levels down, and drop registered cgroups that no longer exist.
+ * Returns the number of live cgroups or -1.
+ */
+int fdcache_scan(struct fdcache *c, const char *root, int max_depth);
+
+#endif /* FDCACHE_H */
@@ -0,0 +1,140 @@
+/*
+ * Read memory.stat + memory.numa_stat of every cgroup below ROOT through
+ * fdcache, round after round, rescanning the tree periodically so created
+ * and removed cgroups are picked up. Reports ns per read and how often the
+ * cache had to open, evict or drop fds. -c adds the cat pattern (open +
+ * read + close per read) on the same cgroups for comparison.
+ *
+ * Usage:
+ *   fdcache_bench [-b fd_budget] [-r rounds] [-d depth] [-s rescan_every] [-c] ROOT
+ *   fdcache_bench -r 100 -s 10 /sys/fs/cgroup/a
+ *   fdcache_bench -b 64 -r 100 /sys/fs/cgroup     # force LRU churn
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fdcache.h"
+#include "util.h"
+
+#define BUF_SIZE	65536
+
+static char buf[BUF_SIZE];
+
+static uint64_t cat_round(struct fdcache *c, uint64_t *reads)
+{
+	static const enum cg_file files[] = { CGF_MEMORY_STAT, CGF_NUMA_STAT };
+	char path[4200];
+	uint64_t t0 = now_ns();
+	uint32_t id;
+	size_t f;
+
+	for (id = 0; id < c->nentries; id++) {
+		if (!fdcache_live(c, id))
+			continue;
+		for (f = 0; f < 2; f++) {
+			int fd;
+
+			snprintf(path, sizeof(path), "%s/%s", fdcache_path(c, id),
+				 fdcache_file_name(files[f]));
+			fd = open(path, O_RDONLY);
+			if (fd < 0)
+				continue;
+			while (read(fd, buf, sizeof(buf)) > 0)
+				;
+			close(fd);
+			(*reads)++;
+		}
+	}
+	return now_ns() - t0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct fdcache c;
+	uint32_t budget = 0, id;
+	int rounds = 10, depth = 8, rescan = 0, cat = 0, opt, r, live;
+	uint64_t total_ns = 0, cat_ns = 0, cat_reads = 0, errors = 0;
+
+	while ((opt = getopt(argc, argv, "b:r:d:s:c")) != -1) {
+		switch (opt) {
+		case 'b':
+			budget = (uint32_t)atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 's':
+			rescan = atoi(optarg);
+			break;
+		case 'c':
+			cat = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || rounds <= 0 || depth < 0 || rescan < 0)
+		goto usage;
+
+	if (fdcache_init(&c, budget) < 0) {
+		perror("fdcache_init");
+		return 1;
+	}
+	live = fdcache_scan(&c, argv[optind], depth);
+	if (live <= 0) {
+		fprintf(stderr, "no cgroups with memory.stat below %s\n",
+			argv[optind]);
+		return 1;
+	}
+	printf("=== fdcache: %d cgroups below %s, fd budget %u ===\n", live,
+	       argv[optind], c.budget);
+
+	for (r = 0; r < rounds; r++) {
+		uint64_t t0;
+
+		if (rescan && r && r % rescan == 0)
+			fdcache_scan(&c, argv[optind], depth);
+		t0 = now_ns();
+		for (id = 0; id < c.nentries; id++) {
+			if (!fdcache_live(&c, id))
+				continue;
+			if (fdcache_read(&c, id, CGF_MEMORY_STAT, buf, sizeof(buf)) < 0 ||
+			    fdcache_read(&c, id, CGF_NUMA_STAT, buf, sizeof(buf)) < 0)
+				errors++;
+		}
+		total_ns += now_ns() - t0;
+		if (cat)
+			cat_ns += cat_round(&c, &cat_reads);
+	}
+
+	printf("Reads:        %llu (%llu failed or removed)\n",
+	       (unsigned long long)c.stats.reads, (unsigned long long)errors);
+	printf("fdcache:      %.2f us/read\n",
+	       (double)total_ns / 1000.0 / c.stats.reads);
+	if (cat && cat_reads)
+		printf("cat pattern:  %.2f us/read\n",
+		       (double)cat_ns / 1000.0 / cat_reads);
+	printf("Hit rate:     %.2f%%\n",
+	       (double)c.stats.hits * 100 / c.stats.reads);
+	printf("Stat opens:   %llu\n", (unsigned long long)c.stats.opens);
+	printf("Dir opens:    %llu\n", (unsigned long long)c.stats.dir_opens);
+	printf("Evictions:    %llu\n", (unsigned long long)c.stats.evictions);
+	printf("Removed:      %llu\n", (unsigned long long)c.stats.removed);
+	printf("Open fds:     %u\n", c.nopen);
+
+	fdcache_destroy(&c);
+	return 0;
+
+usage:
+	fprintf(stderr, "USAGE: %s [-b fd_budget] [-r rounds] [-d depth] "
+		"[-s rescan_every] [-c] ROOT\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,177 @@
+/*
+ * Build-time generator for stat_keys_gen.h: a perfect hash over the names
+ * in stat_keys.def (hash-and-displace).
+ *
+ * A seed picks stat_key_hash()'s multiplier. The top STAT_KEY_DISP_BITS of
+ * the hash select a bucket; every key of a bucket lands in slot
+ * ((h >> 32) ^ disp[bucket]) & (slots - 1). Buckets are placed largest
+ * first, trying displacements until all their keys hit free slots. Slots
+ * are about twice the key count so this converges within a few seeds;
+ * seeds come from a fixed sequence so the output is reproducible.
+ *
+ * Usage: ./gen_stat_keys > stat_keys_gen.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stat_keys.h"
+
+#define MAX_SEEDS	10000
+
+static const char *const names[STAT_KEY_NR] = {
+#define STAT_KEY(name, unit)	#name,
+#include "stat_keys.def"
+#undef STAT_KEY
+};
+
+static const char *const units[STAT_KEY_NR] = {
+#define STAT_KEY(name, unit)	"STAT_UNIT_" #unit,
+#include "stat_keys.def"
+#undef STAT_KEY
+};
+
+static uint64_t hashes[STAT_KEY_NR];
+
+static uint64_t splitmix64(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+/* Returns 0 and fills disp/slot if every bucket could be placed. */
+static int try_seed(uint64_t mul, int slot_bits, int disp_bits,
+		    uint16_t *disp, uint16_t *slot)
+{
+	uint32_t nslots = 1u << slot_bits, nbuckets = 1u << disp_bits;
+	uint32_t count[1u << 12] = { 0 }, order[1u << 12];
+	uint32_t b, i, k, d, n;
+
+	for (k = 0; k < STAT_KEY_NR; k++) {
+		uint64_t w0, w1;
+
+		stat_key_words(names[k], strlen(names[k]), &w0, &w1);
+		hashes[k] = stat_key_hash(w0, w1, strlen(names[k]), mul);
+		count[hashes[k] >> (64 - disp_bits)]++;
+	}
+	for (b = 0; b < nbuckets; b++)
+		order[b] = b;
+	/* largest buckets first */
+	for (i = 0; i < nbuckets; i++)
+		for (b = i + 1; b < nbuckets; b++)
+			if (count[order[b]] > count[order[i]]) {
+				uint32_t t = order[i];
+
+				order[i] = order[b];
+				order[b] = t;
+			}
+
+	for (i = 0; i < nslots; i++)
+		slot[i] = STAT_KEY_UNKNOWN;
+	for (i = 0; i < nbuckets; i++) {
+		uint32_t bucket = order[i];
+
+		disp[bucket] = 0;
+		if (!count[bucket])
+			continue;
+		for (d = 0; d < nslots; d++) {
+			uint32_t taken[64], ntaken = 0;
+
+			for (k = 0; k < STAT_KEY_NR; k++) {
+				uint32_t s;
+
+				if (hashes[k] >> (64 - disp_bits) != bucket)
+					continue;
+				s = ((uint32_t)(hashes[k] >> 32) ^ d) & (nslots - 1);
+				if (slot[s] != STAT_KEY_UNKNOWN || ntaken == 64)
+					break;
+				slot[s] = (uint16_t)k;
+				taken[ntaken++] = s;
+			}
+			if (k == STAT_KEY_NR)
+				break;
+			/* collision: undo this bucket and try the next displacement */
+			for (n = 0; n < ntaken; n++)
+				slot[taken[n]] = STAT_KEY_UNKNOWN;
+		}
+		if (d == nslots)
+			return -1;
+		disp[bucket] = (uint16_t)d;
+	}
+	return 0;
+}
+
+static void print_table(const char *type, const char *name,
+			const uint16_t *v, uint32_t n)
+{
+	uint32_t i;
+
+	printf("static const %s %s[%u] = {", type, name, n);
+	for (i = 0; i < n; i++)
+		printf("%s%u,", i % 12 ? " " : "\n\t", v[i]);
+	printf("\n};\n\n");
+}
+
+int main(void)
+{
+	static uint16_t disp[1u << 12], slot[1u << 12];
+	uint64_t state = 0, mul = 0;
+	int slot_bits = 1, disp_bits, seed;
+	size_t maxlen = 0;
+	uint32_t k, j;
+
+	for (k = 0; k < STAT_KEY_NR; k++) {
+		if (strlen(names[k]) > maxlen)
+			maxlen = strlen(names[k]);
+		for (j = 0; j < k; j++)
+			if (strcmp(names[j], names[k]) == 0) {
+				fprintf(stderr, "duplicate key %s\n", names[k]);
+				return 1;
+			}
+	}
+	while ((1u << slot_bits) < 2 * STAT_KEY_NR)
+		slot_bits++;
+	disp_bits = slot_bits > 2 ? slot_bits - 2 : 1;
+	if (slot_bits + disp_bits > 32 || slot_bits > 12) {
+		fprintf(stderr, "too many keys (%d)\n", STAT_KEY_NR);
+		return 1;
+	}
+
+	for (seed = 0; seed < MAX_SEEDS; seed++) {
+		mul = splitmix64(&state) | 1;
+		if (try_seed(mul, slot_bits, disp_bits, disp, slot) == 0)
+			break;
+	}
+	if (seed == MAX_SEEDS) {
+		fprintf(stderr, "no perfect hash found in %d seeds\n", MAX_SEEDS);
+		return 1;
+	}
+
+	printf("/* Generated by gen_stat_keys from stat_keys.def; do not edit. */\n");
+	printf("#ifndef STAT_KEYS_GEN_H\n#define STAT_KEYS_GEN_H\n\n");
+	printf("#define STAT_KEY_HASH_MUL\t0x%016llxull\t/* seed %d */\n",
+	       (unsigned long long)mul, seed);
+	printf("#define STAT_KEY_SLOT_BITS\t%d\n", slot_bits);
+	printf("#define STAT_KEY_DISP_BITS\t%d\n", disp_bits);
+	printf("#define STAT_KEY_NAME_MAX\t%zu\n\n", maxlen);
+	print_table("uint16_t", "stat_key_disp", disp, 1u << disp_bits);
+	print_table("uint16_t", "stat_key_slot", slot, 1u << slot_bits);
+
+	/* words are host byte order, like the loads in stat_key_words() */
+	printf("static const struct {\n\tuint64_t w0, w1;\n\tconst char *name;\n"
+	       "\tuint8_t len;\n\tuint8_t unit;\n} stat_key_info[%d] = {\n",
+	       STAT_KEY_NR);
+	for (k = 0; k < STAT_KEY_NR; k++) {
+		uint64_t a, b;
+
+		stat_key_words(names[k], strlen(names[k]), &a, &b);
+		printf("\t{ 0x%016llxull, 0x%016llxull, \"%s\", %zu, %s },\n",
+		       (unsigned long long)a, (unsigned long long)b, names[k],
+		       strlen(names[k]), units[k]);
+	}
+	printf("};\n\n#endif /* STAT_KEYS_GEN_H */\n");
+	return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * Phase-staggered timerfd scheduler. See phase.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "phase.h"
+#include "util.h"
+
+int phase_init(struct phase *p, uint64_t interval_ns, uint64_t slot_ns,
+	       int stagger, uint32_t cap)
+{
+	memset(p, 0, sizeof(*p));
+	p->tfd = -1;
+	if (!slot_ns || !interval_ns || interval_ns % slot_ns ||
+	    interval_ns / slot_ns > UINT32_MAX)
+		return -1;
+	p->interval_ns = interval_ns;
+	p->slot_ns = slot_ns;
+	p->nslots = (uint32_t)(interval_ns / slot_ns);
+	p->stagger = stagger;
+	p->head = malloc(p->nslots * sizeof(*p->head));
+	p->count = calloc(p->nslots, sizeof(*p->count));
+	if (!p->head || !p->count)
+		goto fail;
+	memset(p->head, 0xff, p->nslots * sizeof(*p->head));
+	p->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (p->tfd < 0 || phase_reserve(p, cap ? cap : 64) < 0)
+		goto fail;
+	p->n = 0;
+	return 0;
+fail:
+	phase_destroy(p);
+	return -1;
+}
+
+void phase_destroy(struct phase *p)
+{
+	if (p->tfd >= 0)
+		close(p->tfd);
+	free(p->head);
+	free(p->count);
+	free(p->slot);
+	free(p->prev);
+	free(p->nxt);
+	memset(p, 0, sizeof(*p));
+	p->tfd = -1;
+}
+
+int phase_reserve(struct phase *p, uint32_t n)
+{
+	uint32_t cap, *slot, *prev, *nxt;
+
+	if (n <= p->cap)
+		goto out;
+	cap = p->cap ? p->cap * 2 : 64;
+	if (cap < n)
+		cap = n;
+	slot = realloc(p->slot, cap * sizeof(*slot));
+	if (!slot)
+		return -1;
+	p->slot = slot;
+	prev = realloc(p->prev, cap * sizeof(*prev));
+	if (!prev)
+		return -1;
+	p->prev = prev;
+	nxt = realloc(p->nxt, cap * sizeof(*nxt));
+	if (!nxt)
+		return -1;
+	p->nxt = nxt;
+	memset(slot + p->cap, 0xff, (cap - p->cap) * sizeof(*slot));
+	p->cap = cap;
+out:
+	/* only now: ids below n must index grown arrays */
+	if (n > p->n)
+		p->n = n;
+	return 0;
+}
+
+/*
+ * Middle of the longest circular run of least loaded slots, so that a few
+ * ids spread over the whole interval (slots 0, nslots/2, nslots/4, ...)
+ * instead of filling it front to back.
+ */
+static uint32_t spread_slot(const struct phase *p)
+{
+	uint32_t s, min = p->count[0], full = PHASE_NONE;
+	uint32_t i, run = 0, best = 0, best_len = 0;
+
+	for (s = 1; s < p->nslots; s++)
+		if (p->count[s] < min)
+			min = p->count[s];
+	for (s = 0; s < p->nslots; s++)
+		if (p->count[s] > min) {
+			full = s;
+			break;
+		}
+	if (full == PHASE_NONE)
+		return 0;
+	/* walk once around, starting after a loaded slot */
+	for (i = 1; i <= p->nslots; i++) {
+		s = (full + i) % p->nslots;
+		if (p->count[s] == min) {
+			run++;
+			continue;
+		}
+		if (run > best_len) {
+			best_len = run;
+			best = (s + p->nslots - run + (run - 1) / 2) % p->nslots;
+		}
+		run = 0;
+	}
+	return best;
+}
+
+void phase_add(struct phase *p, uint32_t id)
+{
+	uint32_t best = 0;
+
+	if (id >= p->n || p->slot[id] != PHASE_NONE)
+		return;
+	if (p->stagger)
+		best = spread_slot(p);
+	p->slot[id] = best;
+	p->prev[id] = PHASE_NONE;
+	p->nxt[id] = p->head[best];
+	if (p->head[best] != PHASE_NONE)
+		p->prev[p->head[best]] = id;
+	p->head[best] = id;
+	p->count[best]++;
+	p->live++;
+}
+
+void phase_remove(struct phase *p, uint32_t id)
+{
+	uint32_t s;
+
+	if (id >= p->n || p->slot[id] == PHASE_NONE)
+		return;
+	s = p->slot[id];
+	if (p->prev[id] != PHASE_NONE)
+		p->nxt[p->prev[id]] = p->nxt[id];
+	else
+		p->head[s] = p->nxt[id];
+	if (p->nxt[id] != PHASE_NONE)
+		p->prev[p->nxt[id]] = p->prev[id];
+	p->slot[id] = PHASE_NONE;
+	p->count[s]--;
+	p->live--;
+}
+
+void phase_start(struct phase *p, uint64_t now_ns)
+{
+	p->base_ns = now_ns;
+	p->next = 0;
+}
+
+static inline uint64_t deadline(const struct phase *p, uint64_t k)
+{
+	return p->base_ns + k * p->slot_ns;
+}
+
+int phase_wait(struct phase *p, uint32_t *ids, uint32_t max,
+	       struct phase_tick *t)
+{
+	struct itimerspec its = { 0 };
+	uint64_t k, j, exp, wake;
+	uint32_t i, n = 0, slots = 0;
+
+	/* next non-empty slot; with none, wake once per interval anyway */
+	k = p->next + p->nslots;
+	for (i = 0; i < p->nslots; i++)
+		if (p->count[(p->next + i) % p->nslots]) {
+			k = p->next + i;
+			break;
+		}
+
+	its.it_value = ns_to_ts(deadline(p, k));
+	if (timerfd_settime(p->tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+		return -1;
+	if (read(p->tfd, &exp, sizeof(exp)) < 0)
+		return -1;
+	wake = now_ns();
+
+	for (j = k; j < k + p->nslots && deadline(p, j) <= wake; j++) {
+		uint32_t s = (uint32_t)(j % p->nslots), id;
+
+		if (!p->count[s])
+			continue;
+		for (id = p->head[s]; id != PHASE_NONE && n < max; id = p->nxt[id])
+			ids[n++] = id;
+		if (j > k)
+			p->stats.catchup_slots++;
+		slots++;
+	}
+	p->next = j;
+	/* a whole round overdue: every id ran once, restart from now */
+	if (deadline(p, j) <= wake) {
+		p->next = (wake - p->base_ns) / p->slot_ns + 1;
+		p->stats.resyncs++;
+	}
+
+	p->stats.wakeups++;
+	p->stats.slots_run += slots;
+	p->stats.ids_run += n;
+	p->stats.late_ns += wake - deadline(p, k);
+	if (wake - deadline(p, k) > p->stats.late_max_ns)
+		p->stats.late_max_ns = wake - deadline(p, k);
+	if (n > p->stats.batch_max)
+		p->stats.batch_max = n;
+	if (t) {
+		t->deadline_ns = deadline(p, k);
+		t->wake_ns = wake;
+		t->late_ns = wake - deadline(p, k);
+		t->slots = slots;
+	}
+	return (int)n;
+}
+
+uint32_t phase_max_load(const struct phase *p)
+{
+	uint32_t s, m = 0;
+
+	for (s = 0; s < p->nslots; s++)
+		if (p->count[s] > m)
+			m = p->count[s];
+	return m;
+}
@@ -0,0 +1,94 @@
+/*
+ * Phase-staggered sampling of many cgroups on absolute timerfd deadlines.
+ *
+ * The interval is cut into nslots slots of slot_ns. Every cgroup owns one
+ * slot, its phase, and is due once per interval at the start of that slot.
+ * New cgroups take a slot with the fewest members, the one farthest from the
+ * loaded slots around it, so N cgroups are spread over the interval N /
+ * nslots per slot, and a few cgroups are spaced across all of it, instead of
+ * one burst of N flushes at the top of every interval.
+ *
+ * Deadlines are base + k * slot_ns on CLOCK_MONOTONIC, armed with
+ * TFD_TIMER_ABSTIME: they never drift, however long a round of reads takes,
+ * unlike a sleep of a fixed relative interval. Slots with no members are not
+ * woken for, and all cgroups of a slot come back from one phase_wait(), so a
+ * wakeup costs one timerfd read however many cgroups are due (coalescing).
+ *
+ * A wakeup that comes late also runs the slots it passed on the way, up to
+ * one full round; beyond that the schedule restarts from now (a resync), so
+ * a stalled agent reads each cgroup once, not once per missed interval.
+ */
+#ifndef PHASE_H
+#define PHASE_H
+
+#include <stdint.h>
+
+#define PHASE_NONE	UINT32_MAX
+
+struct phase_stats {
+	uint64_t wakeups;
+	uint64_t slots_run;		/* non-empty slots, including catch-up */
+	uint64_t ids_run;
+	uint64_t late_ns;		/* sum of wakeup lateness */
+	uint64_t late_max_ns;
+	uint64_t catchup_slots;		/* run after their own deadline had passed */
+	uint64_t resyncs;		/* late by more than one interval */
+	uint32_t batch_max;		/* most ids from one wakeup */
+};
+
+/* Result of one phase_wait(). */
+struct phase_tick {
+	uint64_t deadline_ns;		/* of the first slot run */
+	uint64_t wake_ns;
+	uint64_t late_ns;		/* wake_ns - deadline_ns */
+	uint32_t slots;			/* slots run */
+};
+
+struct phase {
+	uint64_t interval_ns, slot_ns;
+	uint32_t nslots;
+	int stagger;			/* 0: every id in slot 0 (burst) */
+	int tfd;
+	uint64_t base_ns;		/* deadline of slot index 0 */
+	uint64_t next;			/* index of the next slot to run */
+
+	/* members of each slot: doubly linked through id */
+	uint32_t *head;			/* [nslots] */
+	uint32_t *count;		/* [nslots] */
+	uint32_t *slot;			/* [cap] PHASE_NONE = not scheduled */
+	uint32_t *prev, *nxt;		/* [cap] */
+	uint32_t n, cap, live;
+	struct phase_stats stats;
+};
+
+/*
+ * slot_ns must divide interval_ns. stagger 0 puts every id in slot 0, which
+ * is the unstaggered burst for comparison. cap is the initial id capacity.
+ */
+int phase_init(struct phase *p, uint64_t interval_ns, uint64_t slot_ns,
+	       int stagger, uint32_t cap);
+void phase_destroy(struct phase *p);
+
+/* Make ids < n usable. */
+int phase_reserve(struct phase *p, uint32_t n);
+
+/* Schedule id in a spaced-out least loaded slot (no-op if scheduled). */
+void phase_add(struct phase *p, uint32_t id);
+void phase_remove(struct phase *p, uint32_t id);
+
+/* First deadline: slot 0 starts at now_ns. */
+void phase_start(struct phase *p, uint64_t now_ns);
+
+/*
+ * Sleep until the next non-empty slot is due, then write the ids of every
+ * slot whose deadline has passed to ids (max must be at least p->live) and
+ * return how many. Returns -1 with errno EINTR if a signal interrupted the
+ * sleep, or another errno from timerfd.
+ */
+int phase_wait(struct phase *p, uint32_t *ids, uint32_t max,
+	       struct phase_tick *t);
+
+/* Number of ids in the fullest slot. */
+uint32_t phase_max_load(const struct phase *p);
+
+#endif /* PHASE_H */
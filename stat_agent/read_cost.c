@@ -0,0 +1,110 @@
+/*
+ * Per-read cost of one cgroup's stat files, open-once (lseek(0) + read()).
+ * One "read" is one pass over all listed files, as the agent would do it.
+ *
+ * Usage:
+ *   read_cost [-n reads] [-f file,file...] [-q] CGROUP_PATH
+ *   read_cost -n 100000 /sys/fs/cgroup/a
+ *   read_cost -f memory.stat.ks -q /sys/fs/cgroup/a/b
+ *   -q prints one machine-readable line: "<mean_ns> <p50_ns> <p99_ns>"
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.h"
+
+#define MAX_FILES	8
+#define BUF_SIZE	65536
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *files = "memory.stat,memory.numa_stat";
+	static char buf[BUF_SIZE];
+	int fds[MAX_FILES], nfiles = 0, quiet = 0, opt, f;
+	long reads = 20000, i;
+	uint64_t *lat, sum = 0;
+	char *list, *save, *tok;
+
+	while ((opt = getopt(argc, argv, "n:f:q")) != -1) {
+		switch (opt) {
+		case 'n':
+			reads = atol(optarg);
+			break;
+		case 'f':
+			files = optarg;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || reads <= 0)
+		goto usage;
+
+	list = strdup(files);
+	for (tok = strtok_r(list, ",", &save); tok && nfiles < MAX_FILES;
+	     tok = strtok_r(NULL, ",", &save)) {
+		char path[512];
+
+		snprintf(path, sizeof(path), "%s/%s", argv[optind], tok);
+		fds[nfiles] = open(path, O_RDONLY);
+		if (fds[nfiles] < 0) {
+			perror(path);
+			return 1;
+		}
+		nfiles++;
+	}
+	free(list);
+
+	lat = malloc((size_t)reads * sizeof(uint64_t));
+	if (!lat) {
+		perror("malloc");
+		return 1;
+	}
+	for (i = 0; i < reads; i++) {
+		uint64_t t0 = now_ns();
+
+		for (f = 0; f < nfiles; f++)
+			if (read_whole(fds[f], buf, sizeof(buf)) < 0) {
+				perror("read");
+				return 1;
+			}
+		lat[i] = now_ns() - t0;
+		sum += lat[i];
+	}
+	qsort(lat, (size_t)reads, sizeof(uint64_t), cmp_u64);
+
+	if (quiet) {
+		printf("%.0f %llu %llu\n", (double)sum / reads,
+		       (unsigned long long)lat[reads / 2],
+		       (unsigned long long)lat[reads * 99 / 100]);
+	} else {
+		printf("=== %s: %ld reads of %s ===\n", argv[optind], reads, files);
+		printf("mean: %.0f ns\n", (double)sum / reads);
+		printf("p50:  %llu ns\n", (unsigned long long)lat[reads / 2]);
+		printf("p99:  %llu ns\n", (unsigned long long)lat[reads * 99 / 100]);
+		printf("max:  %llu ns\n", (unsigned long long)lat[reads - 1]);
+	}
+	for (f = 0; f < nfiles; f++)
+		close(fds[f]);
+	free(lat);
+	return 0;
+
+usage:
+	fprintf(stderr, "USAGE: %s [-n reads] [-f file,file...] [-q] CGROUP_PATH\n",
+		argv[0]);
+	return 1;
+}
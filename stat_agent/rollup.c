@@ -0,0 +1,296 @@
+/*
+ * Multi-resolution rollups. See rollup.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "rollup.h"
+
+int rollup_parse_spec(const char *s, struct rollup_spec *spec, uint32_t max)
+{
+	uint32_t n = 0;
+
+	while (*s) {
+		char *end;
+		unsigned long long w = strtoull(s, &end, 10);
+		unsigned long slots;
+
+		if (end == s || n == max)
+			return -1;
+		if (strncmp(end, "ms", 2) == 0) {
+			w *= 1000000ull;
+			end += 2;
+		} else if (*end == 's') {
+			w *= 1000000000ull;
+			end++;
+		} else if (*end == 'm') {
+			w *= 60000000000ull;
+			end++;
+		} else if (*end == 'h') {
+			w *= 3600000000000ull;
+			end++;
+		} else {
+			return -1;
+		}
+		if (*end != ':')
+			return -1;
+		s = end + 1;
+		slots = strtoul(s, &end, 10);
+		if (end == s || !w || !slots || slots > UINT32_MAX)
+			return -1;
+		if (n && w <= spec[n - 1].width_ns)
+			return -1;
+		spec[n].width_ns = w;
+		spec[n].nslots = (uint32_t)slots;
+		n++;
+		s = end;
+		if (*s == ',')
+			s++;
+		else if (*s)
+			return -1;
+	}
+	return n ? (int)n : -1;
+}
+
+int rollup_init(struct rollup *r, const struct rollup_spec *spec,
+		uint32_t ntiers, uint32_t ncounters, uint32_t cap)
+{
+	uint32_t t;
+
+	memset(r, 0, sizeof(*r));
+	if (!ntiers || ntiers > ROLLUP_MAX_TIERS || !ncounters)
+		return -1;
+	for (t = 0; t < ntiers; t++) {
+		if (!spec[t].width_ns || !spec[t].nslots ||
+		    (t && spec[t].width_ns <= spec[t - 1].width_ns))
+			return -1;
+		r->tier[t].width_ns = spec[t].width_ns;
+		r->tier[t].nslots = spec[t].nslots;
+	}
+	r->ntiers = ntiers;
+	r->ncounters = ncounters;
+	if (rollup_reserve(r, cap ? cap : 64) < 0) {
+		rollup_destroy(r);
+		return -1;
+	}
+	r->n = 0;
+	return 0;
+}
+
+void rollup_destroy(struct rollup *r)
+{
+	uint32_t t;
+
+	for (t = 0; t < r->ntiers; t++) {
+		free(r->tier[t].epoch);
+		free(r->tier[t].count);
+		free(r->tier[t].agg);
+	}
+	memset(r, 0, sizeof(*r));
+}
+
+int rollup_reserve(struct rollup *r, uint32_t n)
+{
+	uint32_t cap, t;
+
+	if (n <= r->cap)
+		goto out;
+	cap = r->cap ? r->cap * 2 : 64;
+	if (cap < n)
+		cap = n;
+	for (t = 0; t < r->ntiers; t++) {
+		struct rollup_tier *tr = &r->tier[t];
+		size_t old = (size_t)r->cap * tr->nslots;
+		size_t slots = (size_t)cap * tr->nslots;
+		uint64_t *epoch;
+		uint32_t *count;
+		struct rollup_agg *agg;
+
+		epoch = realloc(tr->epoch, slots * sizeof(*epoch));
+		if (!epoch)
+			return -1;
+		tr->epoch = epoch;
+		count = realloc(tr->count, slots * sizeof(*count));
+		if (!count)
+			return -1;
+		tr->count = count;
+		agg = realloc(tr->agg, slots * r->ncounters * sizeof(*agg));
+		if (!agg)
+			return -1;
+		tr->agg = agg;
+		memset(epoch + old, 0, (slots - old) * sizeof(*epoch));
+		memset(count + old, 0, (slots - old) * sizeof(*count));
+		memset(agg + old * r->ncounters, 0,
+		       (slots - old) * r->ncounters * sizeof(*agg));
+	}
+	r->cap = cap;
+out:
+	/* only now: ids below n must index grown arrays */
+	if (n > r->n)
+		r->n = n;
+	return 0;
+}
+
+void rollup_clear(struct rollup *r, uint32_t id)
+{
+	uint32_t t;
+
+	if (id >= r->n)
+		return;
+	for (t = 0; t < r->ntiers; t++) {
+		struct rollup_tier *tr = &r->tier[t];
+		size_t s = (size_t)id * tr->nslots;
+
+		memset(tr->epoch + s, 0, tr->nslots * sizeof(*tr->epoch));
+		memset(tr->count + s, 0, tr->nslots * sizeof(*tr->count));
+		memset(tr->agg + s * r->ncounters, 0,
+		       (size_t)tr->nslots * r->ncounters * sizeof(*tr->agg));
+	}
+}
+
+void rollup_add(struct rollup *r, uint32_t id, uint64_t ts_ns,
+		const uint64_t *v)
+{
+	uint32_t t, c, nc = r->ncounters;
+
+	if (id >= r->n)
+		return;
+	for (t = 0; t < r->ntiers; t++) {
+		struct rollup_tier *tr = &r->tier[t];
+		uint64_t e = ts_ns / tr->width_ns + 1;
+		size_t s = (size_t)id * tr->nslots + (e - 1) % tr->nslots;
+		struct rollup_agg *a = tr->agg + s * nc;
+
+		if (tr->epoch[s] != e) {
+			/* the clock stepped back past this slot: drop it here */
+			if (tr->epoch[s] > e)
+				continue;
+			tr->epoch[s] = e;
+			tr->count[s] = 1;
+			for (c = 0; c < nc; c++) {
+				a[c].min = v[c];
+				a[c].max = v[c];
+				a[c].sum = v[c];
+				a[c].last = v[c];
+			}
+			r->stats.slot_resets++;
+			continue;
+		}
+		tr->count[s]++;
+		for (c = 0; c < nc; c++) {
+			if (v[c] < a[c].min)
+				a[c].min = v[c];
+			if (v[c] > a[c].max)
+				a[c].max = v[c];
+			a[c].sum += v[c];
+			a[c].last = v[c];
+		}
+	}
+	if (ts_ns > r->last_ts)
+		r->last_ts = ts_ns;
+	r->stats.samples++;
+}
+
+/* Oldest epoch the ring of tier t still holds. */
+static uint64_t oldest_epoch(const struct rollup *r, uint32_t t)
+{
+	const struct rollup_tier *tr = &r->tier[t];
+	uint64_t latest = r->last_ts / tr->width_ns;
+
+	return latest >= tr->nslots - 1 ? latest - (tr->nslots - 1) : 0;
+}
+
+uint64_t rollup_tier_oldest(const struct rollup *r, uint32_t t)
+{
+	return oldest_epoch(r, t) * r->tier[t].width_ns;
+}
+
+uint32_t rollup_pick_tier(const struct rollup *r, uint64_t from_ns,
+			  uint64_t step_ns)
+{
+	uint32_t t, best = 0;
+
+	for (t = r->ntiers; t-- > 0;)
+		if (r->tier[t].width_ns <= step_ns &&
+		    rollup_tier_oldest(r, t) <= from_ns)
+			return t;
+	for (t = 0; t < r->ntiers; t++)
+		if (rollup_tier_oldest(r, t) <= from_ns)
+			return t;
+	for (t = 1; t < r->ntiers; t++)
+		if (rollup_tier_oldest(r, t) < rollup_tier_oldest(r, best))
+			best = t;
+	return best;
+}
+
+uint32_t rollup_query(const struct rollup *r, uint32_t id, uint32_t c,
+		      uint64_t from_ns, uint64_t to_ns, uint64_t step_ns,
+		      struct rollup_point *out, uint32_t max, uint32_t *tier)
+{
+	const struct rollup_tier *tr;
+	uint64_t e, e0, e1, latest;
+	uint32_t t, n = 0;
+
+	if (id >= r->n || c >= r->ncounters || to_ns <= from_ns || !step_ns ||
+	    !r->stats.samples)
+		return 0;
+	t = rollup_pick_tier(r, from_ns, step_ns);
+	if (tier)
+		*tier = t;
+	tr = &r->tier[t];
+	if (step_ns < tr->width_ns)
+		step_ns = tr->width_ns;
+
+	/* only epochs the ring still holds: at most nslots iterations */
+	e0 = from_ns / tr->width_ns;
+	e1 = (to_ns - 1) / tr->width_ns;
+	latest = r->last_ts / tr->width_ns;
+	if (e0 < oldest_epoch(r, t))
+		e0 = oldest_epoch(r, t);
+	if (e1 > latest)
+		e1 = latest;
+
+	for (e = e0; e <= e1; e++) {
+		size_t s = (size_t)id * tr->nslots + e % tr->nslots;
+		const struct rollup_agg *a = &tr->agg[s * r->ncounters + c];
+		uint64_t start = e * tr->width_ns / step_ns * step_ns;
+		struct rollup_point *p;
+
+		if (tr->epoch[s] != e + 1)
+			continue;
+		if (n && out[n - 1].start_ns == start) {
+			p = &out[n - 1];
+			if (a->min < p->min)
+				p->min = a->min;
+			if (a->max > p->max)
+				p->max = a->max;
+			p->sum += a->sum;
+			p->last = a->last;
+			p->count += tr->count[s];
+			continue;
+		}
+		if (n == max)
+			break;
+		p = &out[n++];
+		p->start_ns = start;
+		p->width_ns = step_ns;
+		p->min = a->min;
+		p->max = a->max;
+		p->sum = a->sum;
+		p->last = a->last;
+		p->count = tr->count[s];
+	}
+	return n;
+}
+
+size_t rollup_bytes_per_id(const struct rollup *r)
+{
+	size_t bytes = 0;
+	uint32_t t;
+
+	for (t = 0; t < r->ntiers; t++)
+		bytes += (size_t)r->tier[t].nslots *
+			 (sizeof(uint64_t) + sizeof(uint32_t) +
+			  r->ncounters * sizeof(struct rollup_agg));
+	return bytes;
+}
@@ -0,0 +1,118 @@
+/*
+ * Multi-resolution rollups of per-cgroup counters.
+ *
+ * Every tier (e.g. 1 s, 10 s, 1 min, 1 h) is a ring of `nslots` slots per
+ * cgroup; slot k of a tier with width w holds the samples whose timestamp
+ * falls in [e * w, (e + 1) * w) for the epoch e with e % nslots == k. A slot
+ * keeps count plus min/max/sum/last of each counter, so a tier retains
+ * nslots * w of history at fixed size.
+ *
+ * rollup_add() updates the current slot of every tier directly from the
+ * sample: one division per tier to find the slot, a reset when the slot
+ * still holds an older epoch, then min/max/sum/last per counter. That is
+ * O(tiers * counters) per sample whatever the history, and the arenas are
+ * allocated once per cgroup capacity, not per sample. Counters of one slot
+ * are contiguous, so an update touches one short run of memory per tier.
+ *
+ * Queries go to the coarsest tier that still has the requested resolution
+ * and reaches back far enough (see rollup_pick_tier()), and merge its slots
+ * into points of the requested step.
+ *
+ * Timestamps are whatever clock the caller uses; slot boundaries are
+ * multiples of the tier width on that clock (CLOCK_REALTIME gives slots on
+ * whole seconds, minutes and hours).
+ */
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ROLLUP_MAX_TIERS	8
+#define ROLLUP_DEFAULT_SPEC	"1s:120,10s:90,1m:120,1h:48"
+
+struct rollup_spec {
+	uint64_t width_ns;
+	uint32_t nslots;
+};
+
+/* Aggregate of one counter over one slot. */
+struct rollup_agg {
+	uint64_t min, max, sum, last;
+};
+
+struct rollup_tier {
+	uint64_t width_ns;
+	uint32_t nslots;
+	uint64_t *epoch;		/* [id * nslots + slot], epoch + 1, 0 = empty */
+	uint32_t *count;		/* [id * nslots + slot] samples in the slot */
+	struct rollup_agg *agg;		/* [(id * nslots + slot) * ncounters + c] */
+};
+
+struct rollup_stats {
+	uint64_t samples;
+	uint64_t slot_resets;		/* slots (re)started, all tiers */
+};
+
+struct rollup {
+	struct rollup_tier tier[ROLLUP_MAX_TIERS];	/* finest first */
+	uint32_t ntiers;
+	uint32_t ncounters;
+	uint32_t n, cap;		/* ids in use are 0 .. n-1 */
+	uint64_t last_ts;		/* newest timestamp added */
+	struct rollup_stats stats;
+};
+
+/* One point of a query result. */
+struct rollup_point {
+	uint64_t start_ns, width_ns;
+	uint64_t min, max, sum, last;
+	uint32_t count;
+};
+
+/*
+ * Parse "1s:120,10s:90,1m:120,1h:48" (width with ms/s/m/h suffix : slots)
+ * into spec. Returns the number of tiers, or -1.
+ */
+int rollup_parse_spec(const char *s, struct rollup_spec *spec, uint32_t max);
+
+/* Tiers must be given finest first. cap is the initial id capacity. */
+int rollup_init(struct rollup *r, const struct rollup_spec *spec,
+		uint32_t ntiers, uint32_t ncounters, uint32_t cap);
+void rollup_destroy(struct rollup *r);
+
+/* Make ids < n usable; grows the arenas if needed. */
+int rollup_reserve(struct rollup *r, uint32_t n);
+
+/* Forget the history of id (cgroup removed, id recycled). */
+void rollup_clear(struct rollup *r, uint32_t id);
+
+/* Add one sample of all ncounters values v for id at ts_ns. */
+void rollup_add(struct rollup *r, uint32_t id, uint64_t ts_ns,
+		const uint64_t *v);
+
+/*
+ * The coarsest tier with width <= step_ns whose ring still reaches back to
+ * from_ns. If no such tier retains from_ns, the finest tier that does, and
+ * failing that the one with the longest retention.
+ */
+uint32_t rollup_pick_tier(const struct rollup *r, uint64_t from_ns,
+			  uint64_t step_ns);
+
+/*
+ * Points of counter c of id over [from_ns, to_ns), one per step_ns (or per
+ * slot, if the tier is coarser than step_ns), read from tier
+ * rollup_pick_tier(). Empty steps are left out. Writes at most max points
+ * and returns how many; *tier gets the tier used if not NULL.
+ */
+uint32_t rollup_query(const struct rollup *r, uint32_t id, uint32_t c,
+		      uint64_t from_ns, uint64_t to_ns, uint64_t step_ns,
+		      struct rollup_point *out, uint32_t max, uint32_t *tier);
+
+/* Oldest timestamp tier t can still answer for. */
+uint64_t rollup_tier_oldest(const struct rollup *r, uint32_t t);
+
+/* Bytes of slot storage per id (all tiers). */
+size_t rollup_bytes_per_id(const struct rollup *r);
+
+#endif /* ROLLUP_H */
@@ -0,0 +1,392 @@
+/*
+ * Fast sampling of every cgroup below ROOT into fixed-size rollups.
+ *
+ * Every tick (-t, default 100 ms, to catch short spikes) the selected
+ * counters of each cgroup are read through one fdcache and added to a
+ * rollup (rollup.h): min/max/sum/last per counter in 1 s / 10 s / 1 min /
+ * 1 h rings by default (-R). Raw samples are never kept, so memory is fixed
+ * per cgroup however long the agent runs.
+ *
+ * Every report period the query window (-q RANGE:STEP, in seconds) is
+ * answered from the coarsest tier that has STEP resolution and reaches back
+ * RANGE, one line per cgroup and counter (-p adds the points). The header
+ * gives the cost of rollup_add() per sample and the rollup memory against
+ * what the raw samples of the longest tier's span would take.
+ *
+ * Counters (-k) are memory.stat keys plus "current" (memory.current).
+ *
+ * Usage:
+ *   rollup_agent [-t tick_ms] [-n duration_s] [-k key,...] [-R tiers]
+ *                [-r report_s] [-q range_s:step_s] [-p] [-d depth]
+ *                [-s rescan_s] ROOT
+ *   rollup_agent -k anon,file,current -q 60:10 /sys/fs/cgroup/a
+ *   rollup_agent -t 10 -R 100ms:50,1s:300,1m:60 -q 300:60 -p /sys/fs/cgroup
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fdcache.h"
+#include "rollup.h"
+#include "stat_keys.h"
+#include "statparse.h"
+#include "util.h"
+
+#define BUF_SIZE	65536
+#define MAX_COUNTERS	16
+#define MAX_POINTS	1024
+#define KEY_CURRENT	UINT32_MAX	/* counter read from memory.current */
+
+static char buf[BUF_SIZE];
+static struct stat_sample sample;
+static struct rollup_point points[MAX_POINTS];
+
+struct counters {
+	uint32_t key[MAX_COUNTERS];	/* SK_* or KEY_CURRENT */
+	const char *name[MAX_COUNTERS];
+	uint32_t n;
+	int need_stat;
+};
+
+static uint64_t wall_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_REALTIME, &t);
+	return ts_to_ns(&t);
+}
+
+static int parse_counters(char *list, struct counters *k)
+{
+	char *tok, *save = NULL;
+
+	memset(k, 0, sizeof(*k));
+	for (tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		uint32_t key;
+
+		if (k->n == MAX_COUNTERS)
+			return -1;
+		if (strcmp(tok, "current") == 0) {
+			key = KEY_CURRENT;
+		} else {
+			key = stat_key_lookup(tok, strlen(tok));
+			if (key == STAT_KEY_UNKNOWN) {
+				fprintf(stderr, "unknown memory.stat key %s\n", tok);
+				return -1;
+			}
+			k->need_stat = 1;
+		}
+		k->key[k->n] = key;
+		k->name[k->n] = tok;
+		k->n++;
+	}
+	return k->n ? 0 : -1;
+}
+
+/* Values of all counters of one cgroup. Returns 0 or -errno. */
+static int read_cgroup(struct fdcache *c, uint32_t id, const struct counters *k,
+		       uint64_t *v)
+{
+	ssize_t n;
+	uint32_t i, j;
+
+	memset(v, 0, k->n * sizeof(*v));
+	if (k->need_stat) {
+		n = fdcache_read(c, id, CGF_MEMORY_STAT, buf, sizeof(buf));
+		if (n < 0)
+			return (int)n;
+		statparse_text(buf, (size_t)n, &sample);
+		for (i = 0; i < sample.n; i++)
+			for (j = 0; j < k->n; j++)
+				if (sample.e[i].key == k->key[j])
+					v[j] = sample.e[i].value;
+	}
+	for (j = 0; j < k->n; j++) {
+		if (k->key[j] != KEY_CURRENT)
+			continue;
+		/* the root has no memory.current */
+		n = fdcache_read(c, id, CGF_MEMORY_CURRENT, buf, sizeof(buf));
+		if (n == -ENOENT)
+			return -ENOENT;
+		v[j] = n > 0 ? statparse_single(buf, (size_t)n) : 0;
+	}
+	return 0;
+}
+
+/* Drop the history of ids whose cgroup went away or was replaced. */
+static void sync_tree(struct fdcache *c, struct rollup *r, char ***seen)
+{
+	uint32_t id, old = r->n;
+
+	if (rollup_reserve(r, c->nentries) < 0) {
+		perror("rollup_reserve");
+		exit(1);
+	}
+	if (r->n > old) {
+		*seen = realloc(*seen, r->n * sizeof(**seen));
+		if (!*seen) {
+			perror("realloc");
+			exit(1);
+		}
+		memset(*seen + old, 0, (r->n - old) * sizeof(**seen));
+	}
+	for (id = 0; id < r->n; id++) {
+		const char *path = fdcache_path(c, id);
+
+		if ((*seen)[id] && path && strcmp((*seen)[id], path) == 0)
+			continue;
+		if ((*seen)[id])
+			rollup_clear(r, id);
+		free((*seen)[id]);
+		(*seen)[id] = path ? strdup(path) : NULL;
+	}
+}
+
+static const char *fmt_value(char *out, size_t len, uint32_t key, double v)
+{
+	static const char *const units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+	int u = 0;
+
+	if (key != KEY_CURRENT && stat_key_unit(key) != STAT_UNIT_BYTES) {
+		snprintf(out, len, "%.0f", v);
+		return out;
+	}
+	while (v >= 1024 && u < 4) {
+		v /= 1024;
+		u++;
+	}
+	snprintf(out, len, u ? "%.1f%s" : "%.0f%s", v, units[u]);
+	return out;
+}
+
+static const char *fmt_width(char *out, size_t len, uint64_t ns)
+{
+	if (ns >= 3600000000000ull && ns % 3600000000000ull == 0)
+		snprintf(out, len, "%lluh", (unsigned long long)(ns / 3600000000000ull));
+	else if (ns >= 60000000000ull && ns % 60000000000ull == 0)
+		snprintf(out, len, "%llum", (unsigned long long)(ns / 60000000000ull));
+	else if (ns >= 1000000000ull && ns % 1000000000ull == 0)
+		snprintf(out, len, "%llus", (unsigned long long)(ns / 1000000000ull));
+	else
+		snprintf(out, len, "%llums", (unsigned long long)(ns / 1000000ull));
+	return out;
+}
+
+static void report(const struct fdcache *c, const struct rollup *r,
+		   const struct counters *k, uint64_t now, uint64_t range_ns,
+		   uint64_t step_ns, int show_points, uint64_t add_ns,
+		   uint64_t tick_ns)
+{
+	const struct rollup_tier *longest = &r->tier[r->ntiers - 1];
+	uint64_t span = longest->width_ns * longest->nslots;
+	double raw = (double)span / (double)tick_ns * k->n * 16;
+	uint32_t id, j, i, live = 0, t;
+	char w[24], a[24], b[24], d[24], e[24];
+
+	for (id = 0; id < r->n; id++)
+		live += fdcache_live(c, id);
+	fmt_width(w, sizeof(w), span);
+	printf("%llu samples, rollup_add %.0f ns/sample, %.1f KiB/cgroup "
+	       "(raw %s at %.0f ms: %.1f KiB), %u cgroups\n",
+	       (unsigned long long)r->stats.samples,
+	       r->stats.samples ? (double)add_ns / (double)r->stats.samples : 0.0,
+	       (double)rollup_bytes_per_id(r) / 1024, w, (double)tick_ns / 1e6,
+	       raw / 1024, live);
+
+	for (id = 0; id < r->n; id++) {
+		if (!fdcache_live(c, id))
+			continue;
+		printf("%s\n", fdcache_path(c, id));
+		for (j = 0; j < k->n; j++) {
+			uint64_t min = UINT64_MAX, max = 0, sum = 0, cnt = 0;
+			uint32_t np = rollup_query(r, id, j, now - range_ns, now,
+						   step_ns, points, MAX_POINTS, &t);
+
+			if (!np) {
+				printf("  %-16s no samples\n", k->name[j]);
+				continue;
+			}
+			for (i = 0; i < np; i++) {
+				if (points[i].min < min)
+					min = points[i].min;
+				if (points[i].max > max)
+					max = points[i].max;
+				sum += points[i].sum;
+				cnt += points[i].count;
+			}
+			fmt_width(w, sizeof(w), r->tier[t].width_ns);
+			printf("  %-16s [%s tier, %u pts] min %s avg %s max %s last %s\n",
+			       k->name[j], w, np,
+			       fmt_value(a, sizeof(a), k->key[j], (double)min),
+			       fmt_value(b, sizeof(b), k->key[j], (double)sum / (double)cnt),
+			       fmt_value(d, sizeof(d), k->key[j], (double)max),
+			       fmt_value(e, sizeof(e), k->key[j],
+					 (double)points[np - 1].last));
+			if (!show_points)
+				continue;
+			for (i = 0; i < np; i++) {
+				time_t ts = (time_t)(points[i].start_ns / 1000000000ull);
+				struct tm tm;
+
+				localtime_r(&ts, &tm);
+				printf("    %02d:%02d:%02d  n %5u  min %10s  avg %10s  max %10s\n",
+				       tm.tm_hour, tm.tm_min, tm.tm_sec, points[i].count,
+				       fmt_value(a, sizeof(a), k->key[j], (double)points[i].min),
+				       fmt_value(b, sizeof(b), k->key[j],
+						 (double)points[i].sum / points[i].count),
+				       fmt_value(d, sizeof(d), k->key[j], (double)points[i].max));
+			}
+		}
+	}
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	char keys_default[] = "anon,file,shmem,current", *keys = keys_default;
+	const char *tiers = ROLLUP_DEFAULT_SPEC;
+	long tick_ms = 100, duration_s = 0, report_s = 10, rescan_s = 30;
+	long range_s = 60, step_s = 10;
+	int depth = 8, show_points = 0, ntiers, opt;
+	uint64_t *v = NULL, add_ns = 0, start, next, next_report, next_rescan;
+	struct rollup_spec spec[ROLLUP_MAX_TIERS];
+	struct counters k;
+	struct fdcache c;
+	struct rollup r;
+	char **seen = NULL, *ok = NULL;
+	uint32_t id, vcap = 0;
+
+	while ((opt = getopt(argc, argv, "t:n:k:R:r:q:pd:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			tick_ms = atol(optarg);
+			break;
+		case 'n':
+			duration_s = atol(optarg);
+			break;
+		case 'k':
+			keys = optarg;
+			break;
+		case 'R':
+			tiers = optarg;
+			break;
+		case 'r':
+			report_s = atol(optarg);
+			break;
+		case 'q':
+			if (sscanf(optarg, "%ld:%ld", &range_s, &step_s) != 2)
+				goto usage;
+			break;
+		case 'p':
+			show_points = 1;
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 's':
+			rescan_s = atol(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || tick_ms <= 0 || duration_s < 0 ||
+	    report_s <= 0 || range_s <= 0 || step_s <= 0 || rescan_s < 0 ||
+	    depth < 0)
+		goto usage;
+	if (parse_counters(keys, &k) < 0)
+		goto usage;
+	ntiers = rollup_parse_spec(tiers, spec, ROLLUP_MAX_TIERS);
+	if (ntiers < 0) {
+		fprintf(stderr, "bad tier spec %s (e.g. %s)\n", tiers,
+			ROLLUP_DEFAULT_SPEC);
+		return 1;
+	}
+
+	if (fdcache_init(&c, 0) < 0 ||
+	    rollup_init(&r, spec, (uint32_t)ntiers, k.n, 0) < 0) {
+		perror("init");
+		return 1;
+	}
+	if (fdcache_scan(&c, argv[optind], depth) <= 0) {
+		fprintf(stderr, "no cgroups with memory.stat below %s\n",
+			argv[optind]);
+		return 1;
+	}
+	sync_tree(&c, &r, &seen);
+
+	printf("=== rollup_agent: %s, tick %ld ms, tiers %s, query %ld s by %ld s ===\n",
+	       argv[optind], tick_ms, tiers, range_s, step_s);
+	start = now_ns();
+	next = start;
+	next_report = start + (uint64_t)report_s * 1000000000;
+	next_rescan = start + (uint64_t)rescan_s * 1000000000;
+
+	for (;;) {
+		uint64_t now = now_ns(), ts = wall_ns(), t0;
+		struct timespec tsl;
+
+		if (duration_s && now - start >= (uint64_t)duration_s * 1000000000)
+			break;
+		if (rescan_s && now >= next_rescan) {
+			fdcache_scan(&c, argv[optind], depth);
+			sync_tree(&c, &r, &seen);
+			next_rescan = now + (uint64_t)rescan_s * 1000000000;
+		}
+		/* read everything first, so the timed adds run back to back */
+		if (vcap < c.nentries) {
+			vcap = c.nentries;
+			v = realloc(v, (size_t)vcap * k.n * sizeof(*v));
+			ok = realloc(ok, vcap);
+			if (!v || !ok) {
+				perror("realloc");
+				return 1;
+			}
+		}
+		for (id = 0; id < c.nentries; id++)
+			ok[id] = fdcache_live(&c, id) &&
+				 read_cgroup(&c, id, &k, v + (size_t)id * k.n) == 0;
+		t0 = now_ns();
+		for (id = 0; id < c.nentries; id++)
+			if (ok[id])
+				rollup_add(&r, id, ts, v + (size_t)id * k.n);
+		add_ns += now_ns() - t0;
+
+		now = now_ns();
+		if (now >= next_report) {
+			report(&c, &r, &k, wall_ns(), (uint64_t)range_s * 1000000000,
+			       (uint64_t)step_s * 1000000000, show_points, add_ns,
+			       (uint64_t)tick_ms * 1000000);
+			next_report += (uint64_t)report_s * 1000000000;
+		}
+
+		next += (uint64_t)tick_ms * 1000000;
+		if (next < now)
+			next = now;
+		tsl = ns_to_ts(next);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tsl, NULL) == EINTR)
+			;
+	}
+
+	report(&c, &r, &k, wall_ns(), (uint64_t)range_s * 1000000000,
+	       (uint64_t)step_s * 1000000000, show_points, add_ns,
+	       (uint64_t)tick_ms * 1000000);
+	for (id = 0; id < r.n; id++)
+		free(seen[id]);
+	free(seen);
+	free(v);
+	free(ok);
+	rollup_destroy(&r);
+	fdcache_destroy(&c);
+	return 0;
+
+usage:
+	fprintf(stderr, "USAGE: %s [-t tick_ms] [-n duration_s] [-k key,...] [-R tiers] "
+		"[-r report_s] [-q range_s:step_s] [-p] [-d depth] [-s rescan_s] ROOT\n",
+		argv[0]);
+	return 1;
+}
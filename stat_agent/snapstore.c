@@ -0,0 +1,189 @@
+/*
+ * Arena-backed SoA snapshot store. See snapstore.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapstore.h"
+
+static uint64_t *arena_alloc(size_t nvals)
+{
+	size_t bytes = (nvals * sizeof(uint64_t) + SNAP_ALIGN - 1) &
+		       ~(size_t)(SNAP_ALIGN - 1);
+	uint64_t *a = aligned_alloc(SNAP_ALIGN, bytes);
+
+	if (a)
+		memset(a, 0, bytes);
+	return a;
+}
+
+int snapstore_init(struct snapstore *s, uint32_t cap)
+{
+	int i;
+
+	memset(s, 0, sizeof(*s));
+	s->stride = (cap < 8 ? 8 : cap + 7) & ~7u;
+	for (i = 0; i < 2; i++) {
+		s->ep[i].arena = arena_alloc((size_t)SNAP_NCOLS * s->stride);
+		if (!s->ep[i].arena)
+			goto fail;
+	}
+	s->scratch = arena_alloc((size_t)SNAP_NSCRATCH * s->stride);
+	s->parent = malloc(s->stride * sizeof(uint32_t));
+	if (!s->scratch || !s->parent)
+		goto fail;
+	memset(s->parent, 0xff, s->stride * sizeof(uint32_t));
+	return 0;
+fail:
+	snapstore_destroy(s);
+	return -1;
+}
+
+void snapstore_destroy(struct snapstore *s)
+{
+	free(s->ep[0].arena);
+	free(s->ep[1].arena);
+	free(s->scratch);
+	free(s->parent);
+	memset(s, 0, sizeof(*s));
+}
+
+int snapstore_reserve(struct snapstore *s, uint32_t n)
+{
+	uint64_t *arena[2], *scratch;
+	uint32_t stride, *parent, c;
+	int i;
+
+	if (n <= s->stride) {
+		if (n > s->n)
+			s->n = n;
+		return 0;
+	}
+
+	stride = s->stride * 2;
+	if (stride < n)
+		stride = (n + 7) & ~7u;
+	arena[0] = arena_alloc((size_t)SNAP_NCOLS * stride);
+	arena[1] = arena_alloc((size_t)SNAP_NCOLS * stride);
+	scratch = arena_alloc((size_t)SNAP_NSCRATCH * stride);
+	parent = realloc(s->parent, stride * sizeof(uint32_t));
+	if (!arena[0] || !arena[1] || !scratch || !parent) {
+		free(arena[0]);
+		free(arena[1]);
+		free(scratch);
+		if (parent)
+			s->parent = parent;
+		return -1;
+	}
+	memset(parent + s->stride, 0xff,
+	       (stride - s->stride) * sizeof(uint32_t));
+	s->parent = parent;
+
+	for (i = 0; i < 2; i++) {
+		for (c = 0; c < SNAP_NCOLS; c++)
+			memcpy(arena[i] + (size_t)c * stride,
+			       s->ep[i].arena + (size_t)c * s->stride,
+			       s->stride * sizeof(uint64_t));
+		free(s->ep[i].arena);
+		s->ep[i].arena = arena[i];
+	}
+	free(s->scratch);
+	s->scratch = scratch;
+	s->stride = stride;
+	s->n = n;
+	return 0;
+}
+
+void snapstore_begin(struct snapstore *s, uint64_t ts_ns)
+{
+	struct snap_epoch *cur, *prev;
+
+	s->cur ^= 1;
+	cur = &s->ep[s->cur];
+	prev = &s->ep[s->cur ^ 1];
+	memcpy(cur->arena, prev->arena,
+	       (size_t)SNAP_NCOLS * s->stride * sizeof(uint64_t));
+	cur->seq = ++s->ticks;
+	cur->ts_ns = ts_ns;
+}
+
+void snapstore_put(struct snapstore *s, uint32_t id,
+		   const struct stat_sample *smp, uint64_t ts_ns)
+{
+	uint64_t *a = s->ep[s->cur].arena + id;
+	uint32_t i;
+
+	/* a key missing from this read must not keep its old value */
+	for (i = 0; i < STAT_KEY_NR; i++)
+		a[(size_t)i * s->stride] = 0;
+	for (i = 0; i < smp->n; i++) {
+		const struct stat_entry *e = &smp->e[i];
+
+		if (e->key < STAT_KEY_NR && e->node == STATPARSE_NODE_NONE)
+			a[(size_t)e->key * s->stride] = e->value;
+	}
+	a[(size_t)SNAP_COL_READ_NS * s->stride] = ts_ns;
+}
+
+void snapstore_clear(struct snapstore *s, uint32_t id)
+{
+	uint32_t c;
+	int i;
+
+	for (i = 0; i < 2; i++)
+		for (c = 0; c < SNAP_NCOLS; c++)
+			s->ep[i].arena[(size_t)c * s->stride + id] = 0;
+	s->parent[id] = SNAP_NO_PARENT;
+}
+
+/*
+ * The kernels take n as a multiple of 8 (one cache line of u64) and aligned
+ * columns, which lets gcc vectorize them without a scalar tail.
+ */
+uint64_t snap_sum(const uint64_t *col, uint32_t n)
+{
+	const uint64_t *c = __builtin_assume_aligned(col, SNAP_ALIGN);
+	uint64_t sum = 0;
+	uint32_t i;
+
+	n &= ~7u;
+	for (i = 0; i < n; i++)
+		sum += c[i];
+	return sum;
+}
+
+uint64_t snap_max(const uint64_t *col, uint32_t n)
+{
+	const uint64_t *c = __builtin_assume_aligned(col, SNAP_ALIGN);
+	uint64_t max = 0;
+	uint32_t i;
+
+	n &= ~7u;
+	for (i = 0; i < n; i++)
+		max = c[i] > max ? c[i] : max;
+	return max;
+}
+
+void snap_delta(const uint64_t *restrict cur, const uint64_t *restrict prev,
+		uint64_t *restrict out, uint32_t n)
+{
+	const uint64_t *c = __builtin_assume_aligned(cur, SNAP_ALIGN);
+	const uint64_t *p = __builtin_assume_aligned(prev, SNAP_ALIGN);
+	uint64_t *o = __builtin_assume_aligned(out, SNAP_ALIGN);
+	uint32_t i;
+
+	n &= ~7u;
+	for (i = 0; i < n; i++)
+		o[i] = c[i] >= p[i] ? c[i] - p[i] : 0;
+}
+
+void snapstore_sum_children(const struct snapstore *s, const uint64_t *col,
+			    uint64_t *out)
+{
+	uint32_t i;
+
+	memset(out, 0, s->stride * sizeof(uint64_t));
+	for (i = 0; i < s->n; i++)
+		if (s->parent[i] != SNAP_NO_PARENT)
+			out[s->parent[i]] += col[i];
+}
@@ -0,0 +1,126 @@
+/*
+ * Structure-of-arrays snapshot store for many cgroups.
+ *
+ * Each epoch is one 64-byte aligned arena holding SNAP_NCOLS columns of
+ * `stride` u64 values: column c, cgroup id i is arena[c * stride + i]. So
+ * "anon of every cgroup" is one contiguous, aligned array that the
+ * aggregation kernels below can stream through (and gcc can vectorize).
+ * Columns 0..STAT_KEY_NR-1 are the SK_* keys of memory.stat; extra columns
+ * hold memory.current/max/high and the time the cgroup was last read.
+ *
+ * Two epochs are kept: current and previous. snapstore_begin() flips them
+ * and starts the new current as a copy of the previous one, so a cgroup not
+ * read this tick carries its last values (and its last read time). Ids are
+ * the caller's (e.g. fdcache ids). Nothing is allocated per tick; arenas
+ * only grow in snapstore_reserve() when ids exceed the capacity.
+ */
+#ifndef SNAPSTORE_H
+#define SNAPSTORE_H
+
+#include <stdint.h>
+
+#include "stat_keys.h"
+#include "statparse.h"
+
+#define SNAP_ALIGN	64
+#define SNAP_NO_PARENT	UINT32_MAX
+#define SNAP_NSCRATCH	4
+
+enum snap_col {
+	/* 0 .. STAT_KEY_NR-1: SK_* */
+	SNAP_COL_CURRENT = STAT_KEY_NR,	/* memory.current */
+	SNAP_COL_MAX,			/* memory.max, UINT64_MAX = "max" */
+	SNAP_COL_HIGH,			/* memory.high, UINT64_MAX = "max" */
+	SNAP_COL_READ_NS,		/* time of last snapstore_put(), 0 = never */
+	SNAP_NCOLS,
+};
+
+struct snap_epoch {
+	uint64_t *arena;		/* SNAP_NCOLS * stride values */
+	uint64_t seq;			/* tick number, 0 = empty */
+	uint64_t ts_ns;			/* snapstore_begin() time */
+};
+
+struct snapstore {
+	struct snap_epoch ep[2];
+	uint32_t cur;			/* ep[cur] is the current epoch */
+	uint32_t n;			/* ids in use are 0 .. n-1 */
+	uint32_t stride;		/* column length, multiple of 8 */
+	uint32_t *parent;		/* SNAP_NO_PARENT for roots */
+	uint64_t *scratch;		/* SNAP_NSCRATCH columns for results */
+	uint64_t ticks;
+};
+
+int snapstore_init(struct snapstore *s, uint32_t cap);
+void snapstore_destroy(struct snapstore *s);
+
+/* Make ids < n usable; grows (and copies) the arenas if needed. */
+int snapstore_reserve(struct snapstore *s, uint32_t n);
+
+/* Start a tick: previous = old current, current = copy of it. */
+void snapstore_begin(struct snapstore *s, uint64_t ts_ns);
+
+/*
+ * Replace cgroup id's memory.stat columns in the current epoch with a parsed
+ * sample. Entries with a node (numa_stat) or a non-SK_* key are skipped.
+ */
+void snapstore_put(struct snapstore *s, uint32_t id,
+		   const struct stat_sample *smp, uint64_t ts_ns);
+
+/* Zero every column of id in both epochs (cgroup removed, id recycled). */
+void snapstore_clear(struct snapstore *s, uint32_t id);
+
+static inline uint64_t *snapstore_col(const struct snapstore *s, int prev,
+				      uint32_t col)
+{
+	const struct snap_epoch *ep = &s->ep[s->cur ^ (prev ? 1 : 0)];
+
+	return __builtin_assume_aligned(ep->arena + (size_t)col * s->stride,
+					SNAP_ALIGN);
+}
+
+/* False on the first tick, when the previous epoch is all zeroes. */
+static inline int snapstore_has_prev(const struct snapstore *s)
+{
+	return s->ep[s->cur ^ 1].seq != 0;
+}
+
+static inline uint64_t *snapstore_scratch(const struct snapstore *s, int i)
+{
+	return __builtin_assume_aligned(s->scratch + (size_t)i * s->stride,
+					SNAP_ALIGN);
+}
+
+static inline void snapstore_set(struct snapstore *s, uint32_t id,
+				 uint32_t col, uint64_t v)
+{
+	s->ep[s->cur].arena[(size_t)col * s->stride + id] = v;
+}
+
+static inline void snapstore_set_parent(struct snapstore *s, uint32_t id,
+					uint32_t parent)
+{
+	s->parent[id] = parent;
+}
+
+/* Number of values the kernels below should run over (n rounded up to 8). */
+static inline uint32_t snapstore_len(const struct snapstore *s)
+{
+	return (s->n + 7) & ~7u;
+}
+
+/*
+ * Aggregation kernels over aligned columns of n values, n a multiple of 8.
+ * Unused ids are zero in every column, so padding does not change results.
+ */
+uint64_t snap_sum(const uint64_t *col, uint32_t n);
+uint64_t snap_max(const uint64_t *col, uint32_t n);
+/* out = cur - prev, or 0 where the counter went backwards (reset) */
+void snap_delta(const uint64_t *restrict cur, const uint64_t *restrict prev,
+		uint64_t *restrict out, uint32_t n);
+
+/* out[p] = sum of col[i] over direct children i of p; out has stride values. */
+void snapstore_sum_children(const struct snapstore *s, const uint64_t *col,
+			    uint64_t *out);
+
+#endif /* SNAPSTORE_H */
@@ -0,0 +1,135 @@
+/*
+ * Per-tick cost of the snapstore on a synthetic fleet: ingest of one parsed
+ * memory.stat sample per cgroup, then the aggregations an agent runs every
+ * tick (total anon, anon per parent, worst refault rate). Also checks that
+ * ticks do not touch the heap.
+ *
+ * Usage:
+ *   snapstore_bench [-n cgroups] [-f fanout] [-t ticks]
+ */
+#define _GNU_SOURCE
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "snapstore.h"
+#include "util.h"
+
+static struct stat_sample sample;
+
+/* Deterministic counters: grow with the tick, differ per cgroup. */
+static void fill_sample(uint32_t id, uint64_t tick)
+{
+	uint32_t k;
+
+	sample.n = 0;
+	for (k = 0; k < STAT_KEY_NR; k++) {
+		struct stat_entry *e = &sample.e[sample.n++];
+
+		e->key = k;
+		e->node = STATPARSE_NODE_NONE;
+		e->value = (uint64_t)(id + 1) * 4096 * (k + 1) +
+			   tick * ((id * 7 + k) % 13);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t ncg = 10000, fanout = 8, id, n;
+	long ticks = 100, t;
+	uint64_t t0, t_begin = 0, t_put = 0, t_sum = 0, t_children = 0;
+	uint64_t t_delta = 0, total_anon = 0, worst = 0;
+	size_t heap_before, heap_after;
+	struct snapstore s;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:f:t:")) != -1) {
+		switch (opt) {
+		case 'n':
+			ncg = (uint32_t)atoi(optarg);
+			break;
+		case 'f':
+			fanout = (uint32_t)atoi(optarg);
+			break;
+		case 't':
+			ticks = atol(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (ncg == 0 || fanout == 0 || ticks <= 0)
+		goto usage;
+
+	/* start small so the first reserve() exercises the grow path */
+	if (snapstore_init(&s, 64) < 0 || snapstore_reserve(&s, ncg) < 0) {
+		perror("snapstore");
+		return 1;
+	}
+	/* breadth-first tree: id 0 is the root */
+	for (id = 1; id < ncg; id++)
+		snapstore_set_parent(&s, id, (id - 1) / fanout);
+	n = snapstore_len(&s);
+
+	heap_before = mallinfo2().uordblks;
+	for (t = 1; t <= ticks; t++) {
+		uint64_t *anon, *sums, *delta;
+
+		t0 = now_ns();
+		snapstore_begin(&s, t0);
+		t_begin += now_ns() - t0;
+
+		t0 = now_ns();
+		for (id = 0; id < ncg; id++) {
+			fill_sample(id, (uint64_t)t);
+			snapstore_put(&s, id, &sample, t0);
+		}
+		t_put += now_ns() - t0;
+
+		anon = snapstore_col(&s, 0, SK_anon);
+		t0 = now_ns();
+		total_anon = snap_sum(anon, n);
+		t_sum += now_ns() - t0;
+
+		sums = snapstore_scratch(&s, 0);
+		t0 = now_ns();
+		snapstore_sum_children(&s, anon, sums);
+		t_children += now_ns() - t0;
+
+		delta = snapstore_scratch(&s, 1);
+		t0 = now_ns();
+		snap_delta(snapstore_col(&s, 0, SK_workingset_refault_file),
+			   snapstore_col(&s, 1, SK_workingset_refault_file),
+			   delta, n);
+		worst = snap_max(delta, n);
+		t_delta += now_ns() - t0;
+	}
+	heap_after = mallinfo2().uordblks;
+
+	printf("=== snapstore: %u cgroups, fan-out %u, %ld ticks ===\n",
+	       ncg, fanout, ticks);
+	printf("columns:            %d x %u values (%.1f MiB per epoch)\n",
+	       SNAP_NCOLS, s.stride,
+	       (double)SNAP_NCOLS * s.stride * 8 / (1 << 20));
+	printf("begin (epoch copy): %.1f us/tick\n", (double)t_begin / ticks / 1e3);
+	printf("put:                %.1f ns/cgroup (incl. sample fill)\n",
+	       (double)t_put / ticks / ncg);
+	printf("sum anon:           %.2f ns/cgroup\n",
+	       (double)t_sum / ticks / ncg);
+	printf("anon per parent:    %.2f ns/cgroup\n",
+	       (double)t_children / ticks / ncg);
+	printf("max refault delta:  %.2f ns/cgroup\n",
+	       (double)t_delta / ticks / ncg);
+	printf("heap growth:        %zd bytes over %ld ticks\n",
+	       (ssize_t)(heap_after - heap_before), ticks);
+	printf("last: total anon %llu, worst refault delta %llu\n",
+	       (unsigned long long)total_anon, (unsigned long long)worst);
+	snapstore_destroy(&s);
+	return 0;
+
+usage:
+	fprintf(stderr, "USAGE: %s [-n cgroups] [-f fanout] [-t ticks]\n",
+		argv[0]);
+	return 1;
+}
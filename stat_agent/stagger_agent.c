@@ -0,0 +1,247 @@
+/*
+ * Phase-staggered sampler for every cgroup below ROOT.
+ *
+ * Each cgroup gets a phase in the interval (phase.h): with the default 1 s
+ * interval and 10 ms slots, 500 cgroups are read 5 per slot, spread over
+ * the second, instead of 500 flushes at its top. Wakeups come from one
+ * timerfd on absolute deadlines, so the schedule does not drift; cgroups
+ * sharing a slot are read in the same wakeup. A read is memory.stat plus
+ * memory.numa_stat through one fdcache.
+ *
+ * Every report period it prints wakeups and reads per second, the largest
+ * batch, wakeup lateness and read latency percentiles. -B puts every cgroup
+ * in slot 0, the unstaggered burst, for comparison.
+ *
+ * Usage:
+ *   stagger_agent [-i interval_ms] [-g slot_ms] [-B] [-r report_s]
+ *                 [-n duration_s] [-d depth] [-b fd_budget] [-s rescan_s] ROOT
+ *   stagger_agent -n 60 /sys/fs/cgroup
+ *   stagger_agent -B -n 60 /sys/fs/cgroup         # same, all at once
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fdcache.h"
+#include "phase.h"
+#include "util.h"
+
+#define BUF_SIZE	65536
+
+static char buf[BUF_SIZE];
+
+struct samples {
+	uint64_t *v;
+	size_t n, cap;
+};
+
+static void push(struct samples *s, uint64_t v)
+{
+	if (s->n == s->cap) {
+		s->cap = s->cap ? s->cap * 2 : 1024;
+		s->v = realloc(s->v, s->cap * sizeof(*s->v));
+		if (!s->v) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	s->v[s->n++] = v;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* p50 p99 max of s in us, then empty it */
+static void print_pct(const char *label, struct samples *s)
+{
+	if (!s->n) {
+		printf("  %-8s -\n", label);
+		return;
+	}
+	qsort(s->v, s->n, sizeof(*s->v), cmp_u64);
+	printf("  %-8s p50 %8.1f us  p99 %8.1f us  max %8.1f us  (%zu)\n", label,
+	       (double)s->v[s->n / 2] / 1e3, (double)s->v[s->n * 99 / 100] / 1e3,
+	       (double)s->v[s->n - 1] / 1e3, s->n);
+	s->n = 0;
+}
+
+/* One read of a cgroup. Returns 0, or -ENOENT if it is gone. */
+static int read_cgroup(struct fdcache *c, uint32_t id)
+{
+	ssize_t n = fdcache_read(c, id, CGF_MEMORY_STAT, buf, sizeof(buf));
+
+	if (n == -ENOENT)
+		return -ENOENT;
+	n = fdcache_read(c, id, CGF_NUMA_STAT, buf, sizeof(buf));
+	return n == -ENOENT ? -ENOENT : 0;
+}
+
+static void sync_tree(struct fdcache *c, struct phase *p)
+{
+	uint32_t id;
+
+	if (phase_reserve(p, c->nentries) < 0) {
+		perror("phase_reserve");
+		exit(1);
+	}
+	for (id = 0; id < c->nentries; id++) {
+		if (fdcache_live(c, id))
+			phase_add(p, id);
+		else
+			phase_remove(p, id);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	long interval_ms = 1000, slot_ms = 10, report_s = 10, duration_s = 0;
+	long rescan_s = 30;
+	int depth = 8, stagger = 1, opt;
+	uint32_t fd_budget = 0, *ids = NULL, ncap = 0, i;
+	uint64_t start, next_report, next_rescan, win_start;
+	struct samples late = { 0 }, lat = { 0 };
+	struct phase_stats win;
+	struct fdcache c;
+	struct phase p;
+
+	while ((opt = getopt(argc, argv, "i:g:Br:n:d:b:s:")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval_ms = atol(optarg);
+			break;
+		case 'g':
+			slot_ms = atol(optarg);
+			break;
+		case 'B':
+			stagger = 0;
+			break;
+		case 'r':
+			report_s = atol(optarg);
+			break;
+		case 'n':
+			duration_s = atol(optarg);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'b':
+			fd_budget = (uint32_t)atoi(optarg);
+			break;
+		case 's':
+			rescan_s = atol(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || interval_ms <= 0 || slot_ms <= 0 ||
+	    interval_ms % slot_ms || report_s <= 0 || duration_s < 0 ||
+	    rescan_s < 0 || depth < 0)
+		goto usage;
+
+	if (fdcache_init(&c, fd_budget) < 0 ||
+	    phase_init(&p, (uint64_t)interval_ms * 1000000,
+		       (uint64_t)slot_ms * 1000000, stagger, 0) < 0) {
+		perror("init");
+		return 1;
+	}
+	if (fdcache_scan(&c, argv[optind], depth) <= 0) {
+		fprintf(stderr, "no cgroups with memory.stat below %s\n",
+			argv[optind]);
+		return 1;
+	}
+	sync_tree(&c, &p);
+
+	printf("=== stagger_agent: %s, %u cgroups every %ld ms, %u slots of %ld ms, %s, "
+	       "at most %u per slot ===\n", argv[optind], p.live, interval_ms,
+	       p.nslots, slot_ms, stagger ? "staggered" : "burst",
+	       phase_max_load(&p));
+	start = now_ns();
+	next_report = start + (uint64_t)report_s * 1000000000;
+	next_rescan = start + (uint64_t)rescan_s * 1000000000;
+	win_start = start;
+	win = p.stats;
+	phase_start(&p, start);
+
+	for (;;) {
+		struct phase_tick t;
+		uint64_t now;
+		int n;
+
+		if (ncap < p.cap) {
+			ncap = p.cap;
+			ids = realloc(ids, ncap * sizeof(*ids));
+			if (!ids) {
+				perror("realloc");
+				return 1;
+			}
+		}
+		n = phase_wait(&p, ids, ncap, &t);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("phase_wait");
+			return 1;
+		}
+		push(&late, t.late_ns);
+		for (i = 0; i < (uint32_t)n; i++) {
+			uint64_t t0 = now_ns();
+
+			if (read_cgroup(&c, ids[i]) < 0) {
+				phase_remove(&p, ids[i]);
+				continue;
+			}
+			push(&lat, now_ns() - t0);
+		}
+
+		now = now_ns();
+		if (rescan_s && now >= next_rescan) {
+			fdcache_scan(&c, argv[optind], depth);
+			sync_tree(&c, &p);
+			next_rescan = now + (uint64_t)rescan_s * 1000000000;
+		}
+		if (now >= next_report || (duration_s &&
+		    now - start >= (uint64_t)duration_s * 1000000000)) {
+			double s = (double)(now - win_start) / 1e9;
+
+			printf("%.1f wakeups/s, %.1f reads/s, batch max %u, "
+			       "%llu catch-up slots, %llu resyncs, %u cgroups\n",
+			       (double)(p.stats.wakeups - win.wakeups) / s,
+			       (double)(p.stats.ids_run - win.ids_run) / s,
+			       p.stats.batch_max,
+			       (unsigned long long)(p.stats.catchup_slots -
+						    win.catchup_slots),
+			       (unsigned long long)(p.stats.resyncs - win.resyncs),
+			       p.live);
+			print_pct("late", &late);
+			print_pct("read", &lat);
+			fflush(stdout);
+			p.stats.batch_max = 0;
+			win = p.stats;
+			win_start = now;
+			next_report += (uint64_t)report_s * 1000000000;
+			if (duration_s && now - start >= (uint64_t)duration_s * 1000000000)
+				break;
+		}
+	}
+
+	free(ids);
+	free(late.v);
+	free(lat.v);
+	phase_destroy(&p);
+	fdcache_destroy(&c);
+	return 0;
+
+usage:
+	fprintf(stderr, "USAGE: %s [-i interval_ms] [-g slot_ms] [-B] [-r report_s] "
+		"[-n duration_s] [-d depth] [-b fd_budget] [-s rescan_s] ROOT\n",
+		argv[0]);
+	return 1;
+}
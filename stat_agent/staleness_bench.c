@@ -0,0 +1,493 @@
+/*
+ * Staleness vs. cost of memcg stat interfaces.
+ *
+ * A helper child is moved into a leaf cgroup and, on command, touches exactly
+ * X MiB of anonymous memory (or writes X MiB into a file, for "file"). The
+ * parent knows the true increase, reads each interface after a configurable
+ * delay and records how far anon/file lag the truth, plus the cost of the
+ * read itself. Sweeping the delay gives a staleness/cost curve per interface:
+ *
+ *   legacy      memory.stat                         (always flushes)
+ *   ks-flush    memory.stat.ks, filter "flush,A,F"  (needs -K)
+ *   ks-noflush  memory.stat.ks, filter "A,F"        (needs -K)
+ *   bin         memory.stat_bin                     (needs -B)
+ *
+ * The kernel counter mode (RSTAT / ATOMIC) is read from /boot/config-* and
+ * printed with the results, so runs on both kernel builds can be compared.
+ *
+ * Usage:
+ *   staleness_bench [-s MiB] [-m anon|file] [-t trials] [-D delays_us]
+ *                   [-K anon_field,file_field] [-B anon_idx,file_idx]
+ *                   [-u ks_unit] [-U bin_unit] [-d file_dir] LEAF_CGROUP
+ *   staleness_bench -s 64 -K 'vmstats.state[14],vmstats.state[16]' \
+ *                   /sys/fs/cgroup/a/b/c/0
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "statparse.h"
+#include "util.h"
+
+#define READ_BUF_SIZE	65536
+#define MAX_DELAYS	32
+#define COST_READS	1000
+#define MAX_TRIALS	256
+
+enum iface_id {
+	IF_LEGACY,
+	IF_KS_FLUSH,
+	IF_KS_NOFLUSH,
+	IF_BIN,
+	IF_NR,
+};
+
+static const char *const iface_names[IF_NR] = {
+	[IF_LEGACY]     = "legacy",
+	[IF_KS_FLUSH]   = "ks-flush",
+	[IF_KS_NOFLUSH] = "ks-noflush",
+	[IF_BIN]        = "bin",
+};
+
+enum child_op {
+	OP_TOUCH,
+	OP_RELEASE,
+	OP_EXIT,
+};
+
+struct child {
+	pid_t pid;
+	int cmd_fd, ack_fd;
+};
+
+struct config {
+	const char *leaf;
+	const char *file_dir;
+	size_t bytes;
+	int file_mode;
+	int trials;
+	int ndelays;
+	long delays_us[MAX_DELAYS];
+	char ks_anon[64], ks_file[64];
+	int bin_anon, bin_file;
+	uint64_t ks_unit, bin_unit;
+};
+
+static char g_buf[READ_BUF_SIZE];
+static struct stat_sample g_sample;
+
+/* ---- child: lives in the leaf, charges memory on command ---- */
+
+static void child_loop(const struct config *cfg, int cmd_fd, int ack_fd)
+{
+	char path[512];
+	char *mem = NULL;
+	int op, fd = -1;
+	size_t off;
+
+	snprintf(path, sizeof(path), "%s/staleness_bench.%d", cfg->file_dir,
+		 (int)getpid());
+	while (read(cmd_fd, &op, sizeof(op)) == sizeof(op)) {
+		if (op == OP_TOUCH && !cfg->file_mode) {
+			mem = mmap(NULL, cfg->bytes, PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mem == MAP_FAILED)
+				_exit(1);
+			for (off = 0; off < cfg->bytes; off += 4096)
+				mem[off] = 1;
+		} else if (op == OP_TOUCH) {
+			static char chunk[1 << 16];
+
+			memset(chunk, 1, sizeof(chunk));
+			fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+			if (fd < 0)
+				_exit(1);
+			for (off = 0; off < cfg->bytes; off += sizeof(chunk))
+				if (write(fd, chunk, sizeof(chunk)) != sizeof(chunk))
+					_exit(1);
+		} else if (op == OP_RELEASE) {
+			if (mem && mem != MAP_FAILED)
+				munmap(mem, cfg->bytes);
+			mem = NULL;
+			if (fd >= 0) {
+				close(fd);
+				unlink(path);
+				fd = -1;
+			}
+		} else {
+			break;
+		}
+		if (write(ack_fd, &op, sizeof(op)) != sizeof(op))
+			break;
+	}
+	if (fd >= 0)
+		unlink(path);
+	_exit(0);
+}
+
+static int join_cgroup(const char *leaf)
+{
+	char path[512];
+	int fd, ret;
+
+	snprintf(path, sizeof(path), "%s/cgroup.procs", leaf);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, "0", 1) == 1 ? 0 : -1;
+	close(fd);
+	return ret;
+}
+
+static int start_child(const struct config *cfg, struct child *c)
+{
+	int cmd[2], ack[2];
+
+	if (pipe(cmd) < 0 || pipe(ack) < 0)
+		return -1;
+	c->pid = fork();
+	if (c->pid < 0)
+		return -1;
+	if (c->pid == 0) {
+		close(cmd[1]);
+		close(ack[0]);
+		if (join_cgroup(cfg->leaf) < 0) {
+			perror("join cgroup.procs");
+			_exit(1);
+		}
+		child_loop(cfg, cmd[0], ack[1]);
+	}
+	close(cmd[0]);
+	close(ack[1]);
+	c->cmd_fd = cmd[1];
+	c->ack_fd = ack[0];
+	return 0;
+}
+
+static int child_do(struct child *c, int op)
+{
+	int ack;
+
+	if (write(c->cmd_fd, &op, sizeof(op)) != sizeof(op))
+		return -1;
+	if (op == OP_EXIT)
+		return 0;
+	return read(c->ack_fd, &ack, sizeof(ack)) == sizeof(ack) ? 0 : -1;
+}
+
+/* ---- parent: interfaces ---- */
+
+static int write_str(const char *path, const char *s)
+{
+	int fd = open(path, O_WRONLY);
+	ssize_t n;
+
+	if (fd < 0)
+		return -1;
+	n = write(fd, s, strlen(s));
+	close(fd);
+	return n == (ssize_t)strlen(s) ? 0 : -1;
+}
+
+static int iface_open(const struct config *cfg, enum iface_id id)
+{
+	char path[512], filter[160];
+
+	switch (id) {
+	case IF_LEGACY:
+		snprintf(path, sizeof(path), "%s/memory.stat", cfg->leaf);
+		break;
+	case IF_KS_FLUSH:
+	case IF_KS_NOFLUSH:
+		snprintf(path, sizeof(path), "%s/memory.stat.ks", cfg->leaf);
+		snprintf(filter, sizeof(filter), "%s%s,%s",
+			 id == IF_KS_FLUSH ? "flush," : "",
+			 cfg->ks_anon, cfg->ks_file);
+		if (write_str(path, filter) < 0) {
+			fprintf(stderr, "set filter on %s: %s\n", path,
+				strerror(errno));
+			return -1;
+		}
+		break;
+	case IF_BIN:
+		snprintf(path, sizeof(path), "%s/memory.stat_bin", cfg->leaf);
+		break;
+	default:
+		return -1;
+	}
+	return open(path, O_RDONLY);
+}
+
+/* Read one interface; returns the tracked value (anon or file) in bytes. */
+static int iface_read(const struct config *cfg, enum iface_id id, int fd,
+		      uint64_t *out)
+{
+	ssize_t n = read_whole(fd, g_buf, sizeof(g_buf));
+	uint32_t want, i;
+	uint64_t unit = 1;
+
+	if (n < 0)
+		return -1;
+	if (id == IF_BIN) {
+		if (statparse_bin((const uint8_t *)g_buf, (size_t)n, &g_sample) < 0)
+			return -1;
+		want = STATPARSE_BIN_KEY(0, (uint32_t)(cfg->file_mode ?
+				cfg->bin_file : cfg->bin_anon));
+		unit = cfg->bin_unit;
+	} else {
+		const char *name;
+
+		statparse_text(g_buf, (size_t)n, &g_sample);
+		if (id == IF_LEGACY) {
+			name = cfg->file_mode ? "file" : "anon";
+		} else {
+			name = cfg->file_mode ? cfg->ks_file : cfg->ks_anon;
+			unit = cfg->ks_unit;
+		}
+		want = statparse_key(name, strlen(name));
+	}
+	for (i = 0; i < g_sample.n; i++) {
+		if (g_sample.e[i].key == want) {
+			*out = g_sample.e[i].value * unit;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static void sleep_us(long us)
+{
+	struct timespec ts = ns_to_ts((uint64_t)us * 1000);
+
+	while (us > 0 && nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+}
+
+static const char *kernel_mode(void)
+{
+	static char mode[16] = "UNKNOWN";
+	char path[300], line[256];
+	struct utsname u;
+	FILE *fp;
+
+	if (uname(&u) < 0)
+		return mode;
+	snprintf(path, sizeof(path), "/boot/config-%s", u.release);
+	fp = fopen(path, "r");
+	if (!fp)
+		return mode;
+	while (fgets(line, sizeof(line), fp)) {
+		if (strncmp(line, "CONFIG_MEMCG_RSTAT_COUNTER=y", 28) == 0)
+			strcpy(mode, "RSTAT");
+		else if (strncmp(line, "CONFIG_MEMCG_ATOMIC_COUNTER=y", 29) == 0)
+			strcpy(mode, "ATOMIC");
+	}
+	fclose(fp);
+	return mode;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Mean cost of back-to-back reads, with the workload idle. */
+static double read_cost_ns(const struct config *cfg, enum iface_id id, int fd)
+{
+	uint64_t v, t0 = now_ns();
+	int i;
+
+	for (i = 0; i < COST_READS; i++)
+		iface_read(cfg, id, fd, &v);
+	return (double)(now_ns() - t0) / COST_READS;
+}
+
+static int run_iface(const struct config *cfg, enum iface_id id,
+		     struct child *c, int legacy_fd)
+{
+	int64_t lag[MAX_TRIALS];
+	double cost;
+	int fd, d, t;
+
+	fd = iface_open(cfg, id);
+	if (fd < 0) {
+		fprintf(stderr, "%s: not available, skipped\n", iface_names[id]);
+		return -1;
+	}
+	cost = read_cost_ns(cfg, id, fd);
+
+	for (d = 0; d < cfg->ndelays; d++) {
+		int64_t sum = 0, worst = 0;
+		int ok = 0;
+
+		for (t = 0; t < cfg->trials; t++) {
+			uint64_t before, seen;
+
+			/* legacy read flushes, so it is the settled baseline */
+			if (iface_read(cfg, IF_LEGACY, legacy_fd, &before) < 0) {
+				fprintf(stderr, "baseline: memory.stat has no %s\n",
+					cfg->file_mode ? "file" : "anon");
+				goto fail;
+			}
+			if (child_do(c, OP_TOUCH) < 0)
+				goto fail;
+			sleep_us(cfg->delays_us[d]);
+			if (iface_read(cfg, id, fd, &seen) < 0) {
+				fprintf(stderr, "%s: tracked field missing\n",
+					iface_names[id]);
+				goto fail;
+			}
+			lag[ok] = (int64_t)(before + cfg->bytes) - (int64_t)seen;
+			sum += lag[ok];
+			if (llabs(lag[ok]) > llabs(worst))
+				worst = lag[ok];
+			ok++;
+			if (child_do(c, OP_RELEASE) < 0)
+				goto fail;
+			/* let the release settle before the next baseline */
+			sleep_us(10000);
+		}
+		qsort(lag, (size_t)ok, sizeof(lag[0]), cmp_i64);
+		printf("%-11s %10ld %6d %14.1f %14.1f %14.1f %9.2f %10.0f\n",
+		       iface_names[id], cfg->delays_us[d], ok,
+		       (double)sum / ok / 1024, (double)lag[ok / 2] / 1024,
+		       (double)worst / 1024,
+		       (double)llabs(worst) * 100 / cfg->bytes, cost);
+		fflush(stdout);
+	}
+	close(fd);
+	return 0;
+fail:
+	close(fd);
+	return -1;
+}
+
+static int parse_delays(const char *s, struct config *cfg)
+{
+	char *dup = strdup(s), *save, *tok;
+
+	cfg->ndelays = 0;
+	for (tok = strtok_r(dup, ",", &save); tok && cfg->ndelays < MAX_DELAYS;
+	     tok = strtok_r(NULL, ",", &save))
+		cfg->delays_us[cfg->ndelays++] = atol(tok);
+	free(dup);
+	return cfg->ndelays > 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	struct config cfg = {
+		.file_dir = ".",
+		.bytes = 64ull << 20,
+		.trials = 5,
+		.bin_anon = -1,
+		.bin_file = -1,
+		.ks_unit = (uint64_t)sysconf(_SC_PAGESIZE),
+		.bin_unit = 1,
+	};
+	int use_ks = 0, opt, legacy_fd, status;
+	struct child c;
+	enum iface_id id;
+	char path[512];
+
+	parse_delays("0,100,1000,10000,100000,1000000,2500000", &cfg);
+	while ((opt = getopt(argc, argv, "s:m:t:D:K:B:u:U:d:")) != -1) {
+		switch (opt) {
+		case 's':
+			cfg.bytes = (size_t)atol(optarg) << 20;
+			break;
+		case 'm':
+			cfg.file_mode = strcmp(optarg, "file") == 0;
+			break;
+		case 't':
+			cfg.trials = atoi(optarg);
+			break;
+		case 'D':
+			if (parse_delays(optarg, &cfg) < 0)
+				goto usage;
+			break;
+		case 'K':
+			if (sscanf(optarg, "%63[^,],%63s", cfg.ks_anon,
+				   cfg.ks_file) != 2)
+				goto usage;
+			use_ks = 1;
+			break;
+		case 'B':
+			if (sscanf(optarg, "%d,%d", &cfg.bin_anon, &cfg.bin_file) != 2)
+				goto usage;
+			break;
+		case 'u':
+			cfg.ks_unit = strtoull(optarg, NULL, 10);
+			break;
+		case 'U':
+			cfg.bin_unit = strtoull(optarg, NULL, 10);
+			break;
+		case 'd':
+			cfg.file_dir = optarg;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || cfg.bytes == 0 || cfg.trials <= 0 ||
+	    cfg.trials > MAX_TRIALS)
+		goto usage;
+	cfg.leaf = argv[optind];
+
+	snprintf(path, sizeof(path), "%s/memory.stat", cfg.leaf);
+	legacy_fd = open(path, O_RDONLY);
+	if (legacy_fd < 0) {
+		perror(path);
+		return 1;
+	}
+	/* a child that failed to join the leaf must not kill us via SIGPIPE */
+	signal(SIGPIPE, SIG_IGN);
+	if (start_child(&cfg, &c) < 0) {
+		perror("start child");
+		return 1;
+	}
+
+	printf("=== Staleness vs cost: %s ===\n", cfg.leaf);
+	printf("Kernel mode: %s, tracked: %s, step: %zu MiB, trials: %d\n",
+	       kernel_mode(), cfg.file_mode ? "file" : "anon", cfg.bytes >> 20,
+	       cfg.trials);
+	printf("lag = truth - reported (KiB); err%% = worst |lag| / step\n\n");
+	printf("%-11s %10s %6s %14s %14s %14s %9s %10s\n", "interface",
+	       "delay_us", "trials", "mean_lag_KiB", "p50_lag_KiB",
+	       "worst_lag_KiB", "err%", "read_ns");
+
+	for (id = 0; id < IF_NR; id++) {
+		if ((id == IF_KS_FLUSH || id == IF_KS_NOFLUSH) && !use_ks)
+			continue;
+		if (id == IF_BIN && cfg.bin_anon < 0)
+			continue;
+		if (run_iface(&cfg, id, &c, legacy_fd) < 0 && id == IF_LEGACY) {
+			fprintf(stderr, "legacy interface failed, stopping\n");
+			break;
+		}
+	}
+
+	child_do(&c, OP_EXIT);
+	waitpid(c.pid, &status, 0);
+	close(legacy_fd);
+	return 0;
+
+usage:
+	fprintf(stderr,
+		"USAGE: %s [-s MiB] [-m anon|file] [-t trials] [-D delays_us]\n"
+		"          [-K anon_field,file_field] [-B anon_idx,file_idx]\n"
+		"          [-u ks_unit] [-U bin_unit] [-d file_dir] LEAF_CGROUP\n"
+		"  trials <= %d\n",
+		argv[0], MAX_TRIALS);
+	return 1;
+}
@@ -0,0 +1,48 @@
+/*
+ * Perfect-hash lookup of memory.stat key names. See stat_keys.h.
+ */
+#include "stat_keys.h"
+#include "stat_keys_gen.h"
+
+static const char *const unit_names[] = {
+	[STAT_UNIT_BYTES]   = "bytes",
+	[STAT_UNIT_PAGES]   = "pages",
+	[STAT_UNIT_EVENTS]  = "events",
+	[STAT_UNIT_UNKNOWN] = "?",
+};
+
+uint32_t stat_key_lookup(const char *name, size_t len)
+{
+	uint64_t a, b, h;
+	uint32_t k;
+
+	if (len == 0 || len > STAT_KEY_NAME_MAX)
+		return STAT_KEY_UNKNOWN;
+	stat_key_words(name, len, &a, &b);
+	h = stat_key_hash(a, b, len, STAT_KEY_HASH_MUL);
+	k = stat_key_slot[((uint32_t)(h >> 32) ^
+			   stat_key_disp[h >> (64 - STAT_KEY_DISP_BITS)]) &
+			  ((1u << STAT_KEY_SLOT_BITS) - 1)];
+	if (k == STAT_KEY_UNKNOWN || stat_key_info[k].len != len ||
+	    stat_key_info[k].w0 != a || stat_key_info[k].w1 != b)
+		return STAT_KEY_UNKNOWN;
+	if (len > 16 && memcmp(stat_key_info[k].name + 8, name + 8, len - 16))
+		return STAT_KEY_UNKNOWN;
+	return k;
+}
+
+const char *stat_key_name(uint32_t key)
+{
+	return key < STAT_KEY_NR ? stat_key_info[key].name : NULL;
+}
+
+enum stat_unit stat_key_unit(uint32_t key)
+{
+	return key < STAT_KEY_NR ? (enum stat_unit)stat_key_info[key].unit :
+				   STAT_UNIT_UNKNOWN;
+}
+
+const char *stat_unit_name(enum stat_unit unit)
+{
+	return unit <= STAT_UNIT_UNKNOWN ? unit_names[unit] : "?";
+}
@@ -0,0 +1,67 @@
+/*
+ * Known memory.stat / memory.numa_stat key names as a stable enum.
+ *
+ * The list lives in stat_keys.def. gen_stat_keys builds a perfect hash over
+ * it at build time (stat_keys_gen.h): one 64-bit hash of the first and last
+ * 8 bytes and the length, one displacement lookup, one slot lookup, then a
+ * compare of those words (plus memcmp of the middle for names over 16
+ * bytes) so names from newer kernels fall into STAT_KEY_UNKNOWN instead of
+ * aliasing a known key.
+ */
+#ifndef STAT_KEYS_H
+#define STAT_KEYS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+enum stat_key {
+#define STAT_KEY(name, unit)	SK_##name,
+#include "stat_keys.def"
+#undef STAT_KEY
+	STAT_KEY_NR,
+	STAT_KEY_UNKNOWN = STAT_KEY_NR,		/* fallback slot */
+};
+
+enum stat_unit {
+	STAT_UNIT_BYTES,
+	STAT_UNIT_PAGES,
+	STAT_UNIT_EVENTS,
+	STAT_UNIT_UNKNOWN,
+};
+
+/* SK_* for a known name, STAT_KEY_UNKNOWN otherwise. */
+uint32_t stat_key_lookup(const char *name, size_t len);
+/* Name / unit of a key; NULL / STAT_UNIT_UNKNOWN for STAT_KEY_UNKNOWN. */
+const char *stat_key_name(uint32_t key);
+enum stat_unit stat_key_unit(uint32_t key);
+const char *stat_unit_name(enum stat_unit unit);
+
+/*
+ * First and last 8 bytes of a name (zero padded below 8); together with the
+ * length they identify names of up to 16 bytes.
+ */
+static inline void stat_key_words(const char *s, size_t len, uint64_t *a,
+				  uint64_t *b)
+{
+	*a = 0;
+	*b = 0;
+	if (len >= 8) {
+		memcpy(a, s, 8);
+		memcpy(b, s + len - 8, 8);
+	} else {
+		memcpy(a, s, len);
+	}
+}
+
+/* Shared by the generator and stat_key_lookup(); only the top 32 bits are used. */
+static inline uint64_t stat_key_hash(uint64_t a, uint64_t b, size_t len,
+				     uint64_t mul)
+{
+	uint64_t h = (a ^ len) * mul ^ b;
+
+	h ^= h >> 32;
+	return h * mul;
+}
+
+#endif /* STAT_KEYS_H */
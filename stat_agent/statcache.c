@@ -0,0 +1,242 @@
+/*
+ * Single-flight memory.stat cache. See statcache.h.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "statcache.h"
+#include "util.h"
+
+#define COPY_TRIES	4
+
+int statcache_init(struct statcache *c, uint32_t cap, size_t buf_size)
+{
+	memset(c, 0, sizeof(*c));
+	c->buf_size = buf_size ? buf_size : STATCACHE_BUF_SIZE;
+	c->cap = cap ? cap : 64;
+	c->e = calloc(c->cap, sizeof(*c->e));
+	return c->e ? 0 : -1;
+}
+
+void statcache_destroy(struct statcache *c)
+{
+	uint32_t i;
+
+	for (i = 0; i < c->n; i++) {
+		struct statcache_entry *e = &c->e[i];
+
+		close(e->fd);
+		pthread_mutex_destroy(&e->lock);
+		pthread_cond_destroy(&e->done);
+		free(e->data);
+		free(e->stage);
+		free(e->path);
+	}
+	free(c->e);
+	memset(c, 0, sizeof(*c));
+}
+
+uint32_t statcache_add(struct statcache *c, const char *dir)
+{
+	struct statcache_entry *e;
+	char path[4096];
+
+	if (c->n == c->cap ||
+	    snprintf(path, sizeof(path), "%s/memory.stat", dir) >= (int)sizeof(path))
+		return STATCACHE_NONE;
+	e = &c->e[c->n];
+	e->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (e->fd < 0)
+		return STATCACHE_NONE;
+	e->data = malloc((c->buf_size + 7) & ~(size_t)7);
+	e->stage = malloc(c->buf_size);
+	e->path = strdup(dir);
+	if (!e->data || !e->stage || !e->path) {
+		close(e->fd);
+		free(e->data);
+		free(e->stage);
+		free(e->path);
+		return STATCACHE_NONE;
+	}
+	atomic_init(&e->seq, 0);
+	atomic_init(&e->ts_ns, 0);
+	atomic_init(&e->len, 0);
+	pthread_mutex_init(&e->lock, NULL);
+	pthread_cond_init(&e->done, NULL);
+	return c->n++;
+}
+
+static inline void count(atomic_uint_fast64_t *ctr)
+{
+	atomic_fetch_add_explicit(ctr, 1, memory_order_relaxed);
+}
+
+/* len bytes out of the snapshot words; they may be torn, seq tells. */
+static void load_words(char *out, _Atomic uint64_t *data, size_t len)
+{
+	size_t i;
+	uint64_t w;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		w = atomic_load_explicit(&data[i / 8], memory_order_relaxed);
+		memcpy(out + i, &w, 8);
+	}
+	if (i < len) {
+		w = atomic_load_explicit(&data[i / 8], memory_order_relaxed);
+		memcpy(out + i, &w, len - i);
+	}
+}
+
+static void store_words(_Atomic uint64_t *data, const char *buf, size_t len)
+{
+	size_t i;
+	uint64_t w;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		memcpy(&w, buf + i, 8);
+		atomic_store_explicit(&data[i / 8], w, memory_order_relaxed);
+	}
+	if (i < len) {
+		w = 0;
+		memcpy(&w, buf + i, len - i);
+		atomic_store_explicit(&data[i / 8], w, memory_order_relaxed);
+	}
+}
+
+/*
+ * Lock-free copy of the snapshot if it started at or after oldest. The copy
+ * may race a publish; the sequence check throws such a copy away. Returns
+ * the length, -ESTALE if too old, -EAGAIN if it kept racing.
+ */
+static ssize_t copy_fresh(struct statcache *c, struct statcache_entry *e,
+			  uint64_t oldest, char *out, size_t cap, uint64_t *ts)
+{
+	int tries;
+
+	for (tries = 0; tries < COPY_TRIES; tries++) {
+		unsigned s = atomic_load_explicit(&e->seq, memory_order_acquire);
+		uint64_t t;
+		size_t len;
+
+		if (s & 1) {
+			count(&c->retries);
+			continue;
+		}
+		t = atomic_load_explicit(&e->ts_ns, memory_order_relaxed);
+		if (!t || t < oldest)
+			return -ESTALE;
+		len = atomic_load_explicit(&e->len, memory_order_relaxed);
+		if (len > cap)
+			len = cap;
+		load_words(out, e->data, len);
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&e->seq, memory_order_relaxed) == s) {
+			if (ts)
+				*ts = t;
+			return (ssize_t)len;
+		}
+		count(&c->retries);
+	}
+	return -EAGAIN;
+}
+
+/* Only the flight holder publishes, so seq needs no read-modify-write. */
+static void publish(struct statcache_entry *e, const char *buf, size_t len,
+		    uint64_t ts)
+{
+	unsigned s = atomic_load_explicit(&e->seq, memory_order_relaxed);
+
+	atomic_store_explicit(&e->seq, s + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	store_words(e->data, buf, len);
+	atomic_store_explicit(&e->len, len, memory_order_relaxed);
+	atomic_store_explicit(&e->ts_ns, ts, memory_order_relaxed);
+	atomic_store_explicit(&e->seq, s + 2, memory_order_release);
+}
+
+ssize_t statcache_get(struct statcache *c, uint32_t id, uint64_t max_age_ns,
+		      char *out, size_t cap, uint64_t *ts_ns)
+{
+	uint64_t call = now_ns(), oldest, t0;
+	struct statcache_entry *e;
+	int waited = 0;
+	ssize_t n;
+
+	if (id >= c->n)
+		return -EINVAL;
+	e = &c->e[id];
+	oldest = max_age_ns < call ? call - max_age_ns : 1;
+
+	n = copy_fresh(c, e, oldest, out, cap, ts_ns);
+	if (n >= 0) {
+		count(&c->hits);
+		return n;
+	}
+
+	pthread_mutex_lock(&e->lock);
+	while (e->inflight) {
+		/* the flight may be too old for us; then read after it */
+		uint64_t gen = e->gen;
+
+		while (e->gen == gen)
+			pthread_cond_wait(&e->done, &e->lock);
+		waited = 1;
+		if (e->inflight)
+			continue;
+		/* no flight: nobody publishes while we hold the lock */
+		n = atomic_load_explicit(&e->ts_ns, memory_order_relaxed) >= oldest ?
+		    copy_fresh(c, e, oldest, out, cap, ts_ns) : -ESTALE;
+		if (n >= 0) {
+			pthread_mutex_unlock(&e->lock);
+			count(&c->coalesced);
+			return n;
+		}
+	}
+	if (!waited) {
+		/* published between the fast path and the lock */
+		n = copy_fresh(c, e, oldest, out, cap, ts_ns);
+		if (n >= 0) {
+			pthread_mutex_unlock(&e->lock);
+			count(&c->hits);
+			return n;
+		}
+	}
+	e->inflight = 1;
+	pthread_mutex_unlock(&e->lock);
+
+	t0 = now_ns();
+	n = read_whole(e->fd, e->stage, c->buf_size);
+	if (n < 0) {
+		n = -errno;
+		count(&c->errors);
+	} else {
+		publish(e, e->stage, (size_t)n, t0);
+		if ((size_t)n > cap)
+			n = (ssize_t)cap;
+		memcpy(out, e->stage, (size_t)n);
+		if (ts_ns)
+			*ts_ns = t0;
+		count(&c->misses);
+	}
+
+	pthread_mutex_lock(&e->lock);
+	e->inflight = 0;
+	e->gen++;
+	pthread_cond_broadcast(&e->done);
+	pthread_mutex_unlock(&e->lock);
+	return n;
+}
+
+void statcache_stats(const struct statcache *c, struct statcache_stats *s)
+{
+	s->hits = atomic_load_explicit(&c->hits, memory_order_relaxed);
+	s->coalesced = atomic_load_explicit(&c->coalesced, memory_order_relaxed);
+	s->misses = atomic_load_explicit(&c->misses, memory_order_relaxed);
+	s->retries = atomic_load_explicit(&c->retries, memory_order_relaxed);
+	s->errors = atomic_load_explicit(&c->errors, memory_order_relaxed);
+}
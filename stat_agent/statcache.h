@@ -0,0 +1,91 @@
+/*
+ * In-process cache of memory.stat reads, shared by threads.
+ *
+ * Several subsystems of one agent (alerting, export, autoscaling hooks)
+ * each want memory.stat of the same cgroups at slightly different times;
+ * every read of theirs is a kernel flush. Through the cache each caller
+ * states how stale an answer it accepts, max_age_ns, and
+ *   - hit:       the last snapshot is fresh enough. It is copied out under
+ *                a sequence counter, with no lock and no write to shared
+ *                state but a relaxed counter;
+ *   - coalesce:  a read is in flight; the caller waits for it and takes its
+ *                result if that read started recently enough;
+ *   - miss:      the caller becomes the one reader (single flight), reads
+ *                the file, publishes the snapshot and wakes the waiters.
+ * So however many threads ask, there is at most one read per cgroup in
+ * flight and none while the last one is fresh enough for the asker.
+ *
+ * Freshness is measured from the start of the read to the start of the
+ * call: a snapshot read at t is good for a call at c if t + max_age_ns >= c.
+ * max_age_ns 0 accepts only a read that started during the call.
+ *
+ * Cgroups are added before the threads start; the entry array is sized
+ * once (cap) and never moves. Each entry owns its memory.stat fd, used only
+ * by the thread holding the flight.
+ */
+#ifndef STATCACHE_H
+#define STATCACHE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define STATCACHE_NONE		UINT32_MAX
+#define STATCACHE_BUF_SIZE	16384	/* memory.stat is ~4 KiB */
+
+struct statcache_stats {
+	uint64_t hits;
+	uint64_t coalesced;
+	uint64_t misses;		/* = kernel reads */
+	uint64_t retries;		/* lock-free copy raced a publish */
+	uint64_t errors;
+};
+
+struct statcache_entry {
+	/*
+	 * snapshot, written only with seq odd. The bytes are stored as relaxed
+	 * atomic words: readers copy them without the lock while a publish may
+	 * be under way, and a plain memcpy there would be a data race.
+	 */
+	atomic_uint seq;
+	atomic_uint_fast64_t ts_ns;	/* start of the read, 0 = none yet */
+	atomic_size_t len;
+	_Atomic uint64_t *data;		/* buf_size rounded up to words */
+
+	/* single flight; stage and fd belong to the flight holder */
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+	int inflight;
+	uint64_t gen;			/* flights finished */
+	char *stage;
+	int fd;
+	char *path;
+};
+
+struct statcache {
+	struct statcache_entry *e;
+	uint32_t n, cap;
+	size_t buf_size;
+	/* relaxed counters, summed by statcache_stats() */
+	atomic_uint_fast64_t hits, coalesced, misses, retries, errors;
+};
+
+int statcache_init(struct statcache *c, uint32_t cap, size_t buf_size);
+void statcache_destroy(struct statcache *c);
+
+/* Open dir/memory.stat and return its id, or STATCACHE_NONE. Not thread-safe. */
+uint32_t statcache_add(struct statcache *c, const char *dir);
+
+/*
+ * memory.stat of id, read no more than max_age_ns before this call, copied
+ * to out (up to cap bytes). Returns the length or -errno; *ts_ns gets the
+ * start of the read that produced it if not NULL. Thread-safe.
+ */
+ssize_t statcache_get(struct statcache *c, uint32_t id, uint64_t max_age_ns,
+		      char *out, size_t cap, uint64_t *ts_ns);
+
+void statcache_stats(const struct statcache *c, struct statcache_stats *s);
+
+#endif /* STATCACHE_H */
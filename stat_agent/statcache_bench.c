@@ -0,0 +1,260 @@
+/*
+ * Several in-process consumers of memory.stat, with and without statcache.
+ *
+ * Each of -t threads stands for one subsystem of an agent: every period
+ * (-p, plus up to half a period of random phase per round, so they do not
+ * line up) it wants memory.stat of every cgroup below ROOT, accepting data
+ * up to its own max age (-a, one value per thread in turn). Through the
+ * cache, fresh snapshots are hits, concurrent requests coalesce on one read
+ * and only the rest reach the kernel. With -u every request reads the file
+ * itself, as independent subsystems do today.
+ *
+ * At the end it prints requests and kernel reads per second, the
+ * hit/coalesce/miss split, and request latency percentiles.
+ *
+ * Usage:
+ *   statcache_bench [-t threads] [-a age_ms[,age_ms...]] [-p period_ms]
+ *                   [-n seconds] [-d depth] [-u] ROOT
+ *   statcache_bench -t 4 -a 0,100,500,1000 -p 100 -n 10 /sys/fs/cgroup
+ *   statcache_bench -t 4 -p 100 -n 10 -u /sys/fs/cgroup     # no cache
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fdcache.h"
+#include "statcache.h"
+#include "util.h"
+
+#define MAX_THREADS	64
+#define MAX_AGES	16
+
+struct worker {
+	pthread_t tid;
+	int idx;
+	uint64_t max_age_ns;
+	uint64_t requests, reads, errors;
+	uint64_t *lat;			/* request latencies */
+	size_t nlat, cap;
+	int *fds;			/* -u: own fd per cgroup */
+	char buf[STATCACHE_BUF_SIZE];
+};
+
+static struct statcache cache;
+static int uncached;
+static uint64_t period_ns, end_ns;
+
+static void push(struct worker *w, uint64_t v)
+{
+	if (w->nlat == w->cap) {
+		w->cap = w->cap ? w->cap * 2 : 4096;
+		w->lat = realloc(w->lat, w->cap * sizeof(*w->lat));
+		if (!w->lat) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	w->lat[w->nlat++] = v;
+}
+
+static void *run(void *arg)
+{
+	struct worker *w = arg;
+	unsigned seed = (unsigned)w->idx * 2654435761u + 1;
+	uint64_t round = now_ns();
+	uint32_t id;
+
+	for (;;) {
+		uint64_t at = round + (uint64_t)rand_r(&seed) % (period_ns / 2 + 1);
+		struct timespec ts = ns_to_ts(at);
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+			;
+		if (now_ns() >= end_ns)
+			break;
+		for (id = 0; id < cache.n; id++) {
+			uint64_t t0 = now_ns();
+			ssize_t n;
+
+			if (uncached) {
+				n = read_whole(w->fds[id], w->buf, sizeof(w->buf));
+				w->reads++;
+			} else {
+				n = statcache_get(&cache, id, w->max_age_ns, w->buf,
+						  sizeof(w->buf), NULL);
+			}
+			push(w, now_ns() - t0);
+			w->requests++;
+			if (n < 0)
+				w->errors++;
+		}
+		round += period_ns;
+	}
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[])
+{
+	long threads = 4, period_ms = 100, seconds = 10, ages[MAX_AGES] = { 0, 100, 500, 1000 };
+	int depth = 8, nages = 4, opt, i;
+	uint64_t requests = 0, reads = 0, errors = 0, *all, start;
+	size_t nall = 0;
+	struct statcache_stats st;
+	struct worker *w;
+	struct fdcache c;
+	uint32_t id;
+	double s;
+
+	while ((opt = getopt(argc, argv, "t:a:p:n:d:u")) != -1) {
+		switch (opt) {
+		case 't':
+			threads = atol(optarg);
+			break;
+		case 'a': {
+			char *p = optarg, *end;
+
+			for (nages = 0; *p && nages < MAX_AGES; nages++) {
+				ages[nages] = strtol(p, &end, 10);
+				if (end == p || ages[nages] < 0)
+					goto usage;
+				p = *end == ',' ? end + 1 : end;
+			}
+			if (*p || !nages)
+				goto usage;
+			break;
+		}
+		case 'p':
+			period_ms = atol(optarg);
+			break;
+		case 'n':
+			seconds = atol(optarg);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'u':
+			uncached = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || threads <= 0 || threads > MAX_THREADS ||
+	    period_ms <= 0 || seconds <= 0 || depth < 0)
+		goto usage;
+
+	/* the fdcache only lists the cgroups; statcache owns the fds */
+	if (fdcache_init(&c, 0) < 0 || fdcache_scan(&c, argv[optind], depth) <= 0 ||
+	    statcache_init(&cache, c.nentries, 0) < 0) {
+		fprintf(stderr, "no cgroups with memory.stat below %s\n", argv[optind]);
+		return 1;
+	}
+	for (id = 0; id < c.nentries; id++)
+		if (fdcache_live(&c, id) &&
+		    statcache_add(&cache, fdcache_path(&c, id)) == STATCACHE_NONE)
+			fprintf(stderr, "skipping %s: %s\n", fdcache_path(&c, id),
+				strerror(errno));
+
+	w = calloc((size_t)threads, sizeof(*w));
+	if (!w) {
+		perror("calloc");
+		return 1;
+	}
+	period_ns = (uint64_t)period_ms * 1000000;
+	start = now_ns();
+	end_ns = start + (uint64_t)seconds * 1000000000;
+	for (i = 0; i < threads; i++) {
+		w[i].idx = i;
+		w[i].max_age_ns = (uint64_t)ages[i % nages] * 1000000;
+		if (uncached) {
+			w[i].fds = malloc(cache.n * sizeof(int));
+			if (!w[i].fds) {
+				perror("malloc");
+				return 1;
+			}
+			for (id = 0; id < cache.n; id++) {
+				char path[4096];
+
+				snprintf(path, sizeof(path), "%s/memory.stat",
+					 cache.e[id].path);
+				w[i].fds[id] = open(path, O_RDONLY | O_CLOEXEC);
+			}
+		}
+		if (pthread_create(&w[i].tid, NULL, run, &w[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	for (i = 0; i < threads; i++) {
+		pthread_join(w[i].tid, NULL);
+		requests += w[i].requests;
+		reads += w[i].reads;
+		errors += w[i].errors;
+		nall += w[i].nlat;
+	}
+	s = (double)(now_ns() - start) / 1e9;
+	all = malloc((nall + 1) * sizeof(*all));
+	if (!all) {
+		perror("malloc");
+		return 1;
+	}
+	for (nall = 0, i = 0; i < threads; i++) {
+		memcpy(all + nall, w[i].lat, w[i].nlat * sizeof(*all));
+		nall += w[i].nlat;
+	}
+	qsort(all, nall, sizeof(*all), cmp_u64);
+	statcache_stats(&cache, &st);
+	if (!uncached)
+		reads = st.misses;
+
+	printf("=== statcache_bench: %s, %u cgroups, %ld threads every %ld ms, %s ===\n",
+	       argv[optind], cache.n, threads, period_ms,
+	       uncached ? "uncached" : "statcache");
+	printf("max age per thread (ms):");
+	for (i = 0; i < threads; i++)
+		printf(" %ld", ages[i % nages]);
+	printf("\n");
+	printf("requests %.1f/s, kernel reads %.1f/s (%.1f%% of requests), %llu errors\n",
+	       (double)requests / s, (double)reads / s,
+	       requests ? (double)reads * 100 / (double)requests : 0.0,
+	       (unsigned long long)errors);
+	if (!uncached)
+		printf("hits %llu, coalesced %llu, misses %llu, copy retries %llu\n",
+		       (unsigned long long)st.hits, (unsigned long long)st.coalesced,
+		       (unsigned long long)st.misses, (unsigned long long)st.retries);
+	if (nall)
+		printf("request latency: p50 %.2f us, p99 %.2f us, max %.2f us\n",
+		       (double)all[nall / 2] / 1e3, (double)all[nall * 99 / 100] / 1e3,
+		       (double)all[nall - 1] / 1e3);
+
+	for (i = 0; i < threads; i++) {
+		if (w[i].fds)
+			for (id = 0; id < cache.n; id++)
+				close(w[i].fds[id]);
+		free(w[i].fds);
+		free(w[i].lat);
+	}
+	free(w);
+	free(all);
+	statcache_destroy(&cache);
+	fdcache_destroy(&c);
+	return 0;
+
+usage:
+	fprintf(stderr, "USAGE: %s [-t threads] [-a age_ms[,age_ms...]] [-p period_ms] "
+		"[-n seconds] [-d depth] [-u] ROOT\n", argv[0]);
+	return 1;
+}
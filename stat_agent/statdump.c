@@ -0,0 +1,297 @@
+/*
+ * Dump every counter of every cgroup below ROOT, once per interval, as
+ * human-readable text, CSV or JSON lines.
+ *
+ * Stats are read through one fdcache and parsed with statparse. Output goes
+ * through statout: one buffer per snapshot, rendered with a table itoa and
+ * preformatted key tokens, then written with a single writev(). -p writes
+ * the same text with fprintf() per value instead, for comparison. At the
+ * end, stderr gets the time per snapshot spent reading + parsing and spent
+ * formatting + writing, so the two output paths can be weighed against the
+ * kernel read.
+ *
+ * Usage:
+ *   statdump [-f human|csv|json] [-i interval_ms] [-n snapshots] [-d depth]
+ *            [-N] [-p] [-o file] ROOT
+ *   statdump -f json -N /sys/fs/cgroup > dump.jsonl
+ *   statdump -f csv -i 0 -n 100 -o /dev/null /sys/fs/cgroup      # benchmark
+ *   statdump -f csv -i 0 -n 100 -o /dev/null -p /sys/fs/cgroup   # stdio
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fdcache.h"
+#include "statout.h"
+#include "statparse.h"
+#include "util.h"
+
+#define BUF_SIZE	65536
+
+static char buf[BUF_SIZE];
+static struct stat_sample sample, numa;
+
+/* memory.stat, plus memory.numa_stat entries appended if with_numa. */
+static int read_cgroup(struct fdcache *c, uint32_t id, int with_numa)
+{
+	ssize_t n = fdcache_read(c, id, CGF_MEMORY_STAT, buf, sizeof(buf));
+	uint32_t i;
+
+	if (n < 0)
+		return (int)n;
+	statparse_text(buf, (size_t)n, &sample);
+	if (!with_numa)
+		return 0;
+	n = fdcache_read(c, id, CGF_NUMA_STAT, buf, sizeof(buf));
+	if (n <= 0)
+		return 0;
+	statparse(STAT_KIND_NUMA, buf, (size_t)n, &numa);
+	for (i = 0; i < numa.n && sample.n < STATPARSE_MAX_ENTRIES; i++)
+		sample.e[sample.n++] = numa.e[i];
+	return 0;
+}
+
+/* Path quoted and escaped as statout does it, for JSON and CSV. */
+static void print_json_str(FILE *fp, const char *s)
+{
+	fputc('"', fp);
+	for (; *s; s++) {
+		unsigned char c = (unsigned char)*s;
+
+		if (c == '"' || c == '\\')
+			fprintf(fp, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(fp, "\\u%04x", c);
+		else
+			fputc(c, fp);
+	}
+	fputc('"', fp);
+}
+
+static void print_csv_str(FILE *fp, const char *s)
+{
+	if (!strpbrk(s, ",\"\n\r")) {
+		fputs(s, fp);
+		return;
+	}
+	fputc('"', fp);
+	for (; *s; s++) {
+		if (*s == '"')
+			fputc('"', fp);
+		fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+
+/* The stdio path: the same formats, one fprintf() per value. */
+static void print_sample(FILE *fp, enum statout_fmt fmt, uint64_t ts,
+			 const char *cgroup, const struct stat_sample *s)
+{
+	char tmp[32], name[96];
+	uint32_t i;
+
+	if (fmt == STATOUT_HUMAN) {
+		fprintf(fp, "%s\n", cgroup);
+	} else if (fmt == STATOUT_JSON) {
+		fprintf(fp, "{\"ts\":%llu,\"cgroup\":", (unsigned long long)ts);
+		print_json_str(fp, cgroup);
+	}
+	for (i = 0; i < s->n; i++) {
+		const struct stat_entry *e = &s->e[i];
+		const char *key = statparse_key_label(e->key, tmp, sizeof(tmp));
+		int node = e->node != STATPARSE_NODE_NONE;
+
+		switch (fmt) {
+		case STATOUT_HUMAN:
+			if (node)
+				snprintf(name, sizeof(name), "%s N%u", key, e->node);
+			else
+				snprintf(name, sizeof(name), "%s", key);
+			if (e->key < STAT_KEY_NR &&
+			    stat_key_unit(e->key) == STAT_UNIT_BYTES &&
+			    e->value >= 1024) {
+				static const char *const units[] = {
+					"KiB", "MiB", "GiB", "TiB" };
+				double v = (double)e->value / 1024;
+				int u = 0;
+
+				while (v >= 1024 && u < 3) {
+					v /= 1024;
+					u++;
+				}
+				fprintf(fp, "  %-27s %.1f %s\n", name, v, units[u]);
+			} else if (e->key < STAT_KEY_NR &&
+				   stat_key_unit(e->key) == STAT_UNIT_BYTES) {
+				fprintf(fp, "  %-27s %llu B\n", name,
+					(unsigned long long)e->value);
+			} else {
+				fprintf(fp, "  %-27s %llu\n", name,
+					(unsigned long long)e->value);
+			}
+			break;
+		case STATOUT_CSV:
+			fprintf(fp, "%llu,", (unsigned long long)ts);
+			print_csv_str(fp, cgroup);
+			if (node)
+				fprintf(fp, ",%s,%u,%llu\n", key, e->node,
+					(unsigned long long)e->value);
+			else
+				fprintf(fp, ",%s,,%llu\n", key,
+					(unsigned long long)e->value);
+			break;
+		default:
+			if (node)
+				fprintf(fp, ",\"%s.N%u\":%llu", key, e->node,
+					(unsigned long long)e->value);
+			else
+				fprintf(fp, ",\"%s\":%llu", key,
+					(unsigned long long)e->value);
+			break;
+		}
+	}
+	if (fmt == STATOUT_JSON)
+		fprintf(fp, "}\n");
+}
+
+int main(int argc, char *argv[])
+{
+	enum statout_fmt fmt = STATOUT_HUMAN;
+	long interval_ms = 1000, snapshots = 0, snap;
+	int depth = 8, with_numa = 0, use_stdio = 0, fd = STDOUT_FILENO, opt;
+	const char *out_path = NULL;
+	uint64_t t_read = 0, t_out = 0, values = 0, next;
+	struct statout o;
+	struct fdcache c;
+	FILE *fp = NULL;
+
+	while ((opt = getopt(argc, argv, "f:i:n:d:Npo:")) != -1) {
+		switch (opt) {
+		case 'f':
+			if (statout_parse_fmt(optarg) < 0)
+				goto usage;
+			fmt = (enum statout_fmt)statout_parse_fmt(optarg);
+			break;
+		case 'i':
+			interval_ms = atol(optarg);
+			break;
+		case 'n':
+			snapshots = atol(optarg);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'N':
+			with_numa = 1;
+			break;
+		case 'p':
+			use_stdio = 1;
+			break;
+		case 'o':
+			out_path = optarg;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || interval_ms < 0 || snapshots < 0 || depth < 0)
+		goto usage;
+
+	if (out_path) {
+		fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			perror(out_path);
+			return 1;
+		}
+	}
+	if (use_stdio) {
+		fp = fdopen(fd, "w");
+		if (fp && fmt == STATOUT_CSV)
+			fprintf(fp, "ts_ns,cgroup,key,node,value\n");
+	}
+	if ((use_stdio && !fp) || statout_init(&o, fmt, fd) < 0 ||
+	    fdcache_init(&c, 0) < 0) {
+		perror("init");
+		return 1;
+	}
+	if (fdcache_scan(&c, argv[optind], depth) <= 0) {
+		fprintf(stderr, "no cgroups with memory.stat below %s\n",
+			argv[optind]);
+		return 1;
+	}
+
+	next = now_ns();
+	for (snap = 0; !snapshots || snap < snapshots; snap++) {
+		uint64_t ts = now_ns(), t0, tr = 0;
+		uint32_t id;
+
+		if (snap && snap % 10 == 0)
+			fdcache_scan(&c, argv[optind], depth);
+		t0 = now_ns();
+		if (!use_stdio)
+			statout_begin(&o, ts);
+		for (id = 0; id < c.nentries; id++) {
+			uint64_t r0;
+
+			if (!fdcache_live(&c, id))
+				continue;
+			r0 = now_ns();
+			if (read_cgroup(&c, id, with_numa) < 0) {
+				tr += now_ns() - r0;
+				continue;
+			}
+			tr += now_ns() - r0;
+			values += sample.n;
+			if (use_stdio)
+				print_sample(fp, fmt, ts, fdcache_path(&c, id), &sample);
+			else if (statout_sample(&o, fdcache_path(&c, id), &sample) < 0)
+				perror("statout_sample");
+		}
+		if (use_stdio ? fflush(fp) : statout_flush(&o)) {
+			perror("write");
+			return 1;
+		}
+		t_read += tr;
+		t_out += now_ns() - t0 - tr;
+
+		if (interval_ms) {
+			struct timespec tsl;
+
+			next += (uint64_t)interval_ms * 1000000;
+			if (next < now_ns())
+				next = now_ns();
+			tsl = ns_to_ts(next);
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					       &tsl, NULL) == EINTR)
+				;
+		}
+	}
+
+	fprintf(stderr, "statdump: %ld snapshots, %.0f values each, %s via %s\n",
+		snap, snap ? (double)values / snap : 0.0, statout_fmt_name(fmt),
+		use_stdio ? "stdio" : "statout");
+	if (snap)
+		fprintf(stderr, "  read+parse %.1f us/snapshot, format+write %.1f us/snapshot "
+			"(%.1f ns/value)\n", (double)t_read / snap / 1e3,
+			(double)t_out / snap / 1e3,
+			values ? (double)t_out / values : 0.0);
+	if (!use_stdio && o.stats.snapshots)
+		fprintf(stderr, "  %.0f bytes and %.2f write syscalls per snapshot\n",
+			(double)o.stats.bytes / o.stats.snapshots,
+			(double)o.stats.syscalls / o.stats.snapshots);
+	if (fp)
+		fclose(fp);
+	else if (out_path)
+		close(fd);
+	statout_destroy(&o);
+	fdcache_destroy(&c);
+	return 0;
+
+usage:
+	fprintf(stderr, "USAGE: %s [-f human|csv|json] [-i interval_ms] [-n snapshots] "
+		"[-d depth] [-N] [-p] [-o file] ROOT\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,441 @@
+/*
+ * Batched stat output. See statout.h.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "statout.h"
+
+#define HUMAN_KEY_COL	30	/* value column of the human format */
+
+static const char digits2[201] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static const char *const fmt_names[STATOUT_FMT_NR] = {
+	[STATOUT_HUMAN] = "human",
+	[STATOUT_CSV]   = "csv",
+	[STATOUT_JSON]  = "json",
+};
+
+size_t statout_utoa(char *p, uint64_t v)
+{
+	char tmp[20], *end = tmp + sizeof(tmp), *q = end;
+
+	while (v >= 100) {
+		const char *d = digits2 + (v % 100) * 2;
+
+		v /= 100;
+		q -= 2;
+		q[0] = d[0];
+		q[1] = d[1];
+	}
+	if (v >= 10) {
+		q -= 2;
+		q[0] = digits2[v * 2];
+		q[1] = digits2[v * 2 + 1];
+	} else {
+		*--q = (char)('0' + v);
+	}
+	memcpy(p, q, (size_t)(end - q));
+	return (size_t)(end - q);
+}
+
+int statout_parse_fmt(const char *name)
+{
+	int f;
+
+	for (f = 0; f < STATOUT_FMT_NR; f++)
+		if (!strcmp(name, fmt_names[f]))
+			return f;
+	return -1;
+}
+
+const char *statout_fmt_name(enum statout_fmt fmt)
+{
+	return fmt < STATOUT_FMT_NR ? fmt_names[fmt] : "?";
+}
+
+int statout_init(struct statout *o, enum statout_fmt fmt, int fd)
+{
+	memset(o, 0, sizeof(*o));
+	o->fmt = fmt;
+	o->fd = fd;
+	o->cap = 64 * 1024;
+	o->buf = malloc(o->cap);
+	o->seg_cap = 256;
+	o->seg = malloc(o->seg_cap * sizeof(*o->seg));
+	o->iov = malloc(o->seg_cap * sizeof(*o->iov));
+	o->tok_off = malloc(STATPARSE_MAX_KEYS * sizeof(*o->tok_off));
+	o->tok_size = malloc(STATPARSE_MAX_KEYS);
+	if (!o->buf || !o->seg || !o->iov || !o->tok_off || !o->tok_size) {
+		statout_destroy(o);
+		return -1;
+	}
+	memset(o->tok_off, 0xff, STATPARSE_MAX_KEYS * sizeof(*o->tok_off));
+	return 0;
+}
+
+void statout_destroy(struct statout *o)
+{
+	free(o->buf);
+	free(o->seg);
+	free(o->iov);
+	free(o->tok);
+	free(o->tok_off);
+	free(o->tok_size);
+	memset(o, 0, sizeof(*o));
+}
+
+/* Room for n more bytes in the snapshot buffer. */
+static int reserve(struct statout *o, size_t n)
+{
+	size_t cap = o->cap;
+	char *buf;
+
+	if (o->len + n <= o->cap)
+		return 0;
+	while (cap < o->len + n)
+		cap *= 2;
+	buf = realloc(o->buf, cap);
+	if (!buf)
+		return -1;
+	o->buf = buf;
+	o->cap = cap;
+	return 0;
+}
+
+static inline void put(struct statout *o, const char *s, size_t n)
+{
+	memcpy(o->buf + o->len, s, n);
+	o->len += n;
+}
+
+static inline void put_u64(struct statout *o, uint64_t v)
+{
+	o->len += statout_utoa(o->buf + o->len, v);
+}
+
+static int push_seg(struct statout *o, const char *ptr, size_t off, size_t len)
+{
+	if (o->nseg == o->seg_cap) {
+		uint32_t cap = o->seg_cap * 2;
+		struct statout_seg *seg = realloc(o->seg, cap * sizeof(*seg));
+		struct iovec *iov;
+
+		if (!seg)
+			return -1;
+		o->seg = seg;
+		iov = realloc(o->iov, cap * sizeof(*iov));
+		if (!iov)
+			return -1;
+		o->iov = iov;
+		o->seg_cap = cap;
+	}
+	o->seg[o->nseg].ptr = ptr;
+	o->seg[o->nseg].off = off;
+	o->seg[o->nseg].len = len;
+	o->nseg++;
+	return 0;
+}
+
+/* End the open buffer segment, then reference the caller's bytes. */
+static int put_external(struct statout *o, const char *s, size_t n)
+{
+	if (o->len > o->seg_start &&
+	    push_seg(o, NULL, o->seg_start, o->len - o->seg_start) < 0)
+		return -1;
+	if (push_seg(o, s, 0, n) < 0)
+		return -1;
+	o->seg_start = o->len;
+	return 0;
+}
+
+/* Key token of the current format, rendered on first use. */
+static int key_token(struct statout *o, uint32_t key, const char **tok,
+		     size_t *len)
+{
+	static char tmp[96];
+	char name_tmp[32];
+	const char *name;
+	int n;
+
+	if (!STATPARSE_IS_BIN_KEY(key) && key < STATPARSE_MAX_KEYS &&
+	    o->tok_off[key] != UINT32_MAX) {
+		*tok = o->tok + o->tok_off[key];
+		*len = o->tok_size[key];
+		return 0;
+	}
+	name = statparse_key_label(key, name_tmp, sizeof(name_tmp));
+	switch (o->fmt) {
+	case STATOUT_HUMAN:
+		n = snprintf(tmp, sizeof(tmp), "  %s", name);
+		break;
+	case STATOUT_CSV:
+		n = snprintf(tmp, sizeof(tmp), ",%s,", name);
+		break;
+	default:
+		n = snprintf(tmp, sizeof(tmp), ",\"%s", name);
+		break;
+	}
+	if (n < 0 || n >= (int)sizeof(tmp))
+		n = sizeof(tmp) - 1;
+	*tok = tmp;
+	*len = (size_t)n;
+	if (STATPARSE_IS_BIN_KEY(key) || key >= STATPARSE_MAX_KEYS)
+		return 0;
+
+	if (o->tok_len + (size_t)n > o->tok_cap) {
+		size_t cap = o->tok_cap ? o->tok_cap * 2 : 4096;
+		char *t = realloc(o->tok, cap);
+
+		if (!t)
+			return -1;
+		o->tok = t;
+		o->tok_cap = cap;
+	}
+	memcpy(o->tok + o->tok_len, tmp, (size_t)n);
+	o->tok_off[key] = (uint32_t)o->tok_len;
+	o->tok_size[key] = (uint8_t)n;
+	o->tok_len += (size_t)n;
+	*tok = o->tok + o->tok_off[key];
+	return 0;
+}
+
+/*
+ * Bytes as "12.3 MiB", small values as "512 B". Rounded like %.1f of the
+ * exact quotient: to nearest, ties (x.25, x.75) to even.
+ */
+static void put_bytes(struct statout *o, uint64_t v)
+{
+	static const char *const units[] = { " KiB", " MiB", " GiB", " TiB" };
+	uint64_t whole, tenth, rem, half;
+	int u = -1, shift = 0;
+
+	while (u < 3 && v >> (shift + 10)) {
+		shift += 10;
+		u++;
+	}
+	if (u < 0) {
+		put_u64(o, v);
+		put(o, " B", 2);
+		return;
+	}
+	whole = v >> shift;
+	tenth = (v & ((1ull << shift) - 1)) * 10;
+	rem = tenth & ((1ull << shift) - 1);
+	half = 1ull << (shift - 1);
+	tenth >>= shift;
+	if (rem > half || (rem == half && (tenth & 1)))
+		tenth++;
+	if (tenth == 10) {
+		whole++;
+		tenth = 0;
+	}
+	put_u64(o, whole);
+	o->buf[o->len++] = '.';
+	o->buf[o->len++] = (char)('0' + tenth);
+	put(o, units[u], 4);
+}
+
+static int is_bytes(uint32_t key)
+{
+	return !STATPARSE_IS_BIN_KEY(key) && key < STAT_KEY_NR &&
+	       stat_key_unit(key) == STAT_UNIT_BYTES;
+}
+
+/* Path as a quoted, escaped JSON string; worst case 6 bytes per char. */
+static void put_json_str(struct statout *o, const char *s)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	o->buf[o->len++] = '"';
+	for (; *s; s++) {
+		unsigned char c = (unsigned char)*s;
+
+		if (c == '"' || c == '\\') {
+			o->buf[o->len++] = '\\';
+			o->buf[o->len++] = (char)c;
+		} else if (c < 0x20) {
+			put(o, "\\u00", 4);
+			o->buf[o->len++] = hex[c >> 4];
+			o->buf[o->len++] = hex[c & 15];
+		} else {
+			o->buf[o->len++] = (char)c;
+		}
+	}
+	o->buf[o->len++] = '"';
+}
+
+/* CSV field, quoted only if it has to be. */
+static void put_csv_str(struct statout *o, const char *s)
+{
+	if (!strpbrk(s, ",\"\n\r")) {
+		put(o, s, strlen(s));
+		return;
+	}
+	o->buf[o->len++] = '"';
+	for (; *s; s++) {
+		if (*s == '"')
+			o->buf[o->len++] = '"';
+		o->buf[o->len++] = *s;
+	}
+	o->buf[o->len++] = '"';
+}
+
+void statout_begin(struct statout *o, uint64_t ts_ns)
+{
+	o->ts_ns = ts_ns;
+	o->len = 0;
+	o->seg_start = 0;
+	o->nseg = 0;
+	if (o->fmt == STATOUT_CSV && !o->header_done) {
+		static const char hdr[] = "ts_ns,cgroup,key,node,value\n";
+
+		put(o, hdr, sizeof(hdr) - 1);	/* cap >= 64 KiB */
+		o->header_done = 1;
+	}
+}
+
+int statout_sample(struct statout *o, const char *cgroup,
+		   const struct stat_sample *s)
+{
+	size_t plen = strlen(cgroup), prefix_off = 0, prefix_len = 0;
+	uint32_t i;
+
+	/*
+	 * Per entry: token (< 96) + node + value + separators < 160 bytes,
+	 * plus the CSV prefix (ts + quoted path) on every line.
+	 */
+	if (reserve(o, 6 * plen + 64 + (size_t)s->n * (160 + 2 * plen + 24)) < 0)
+		return -1;
+
+	switch (o->fmt) {
+	case STATOUT_HUMAN:
+		if (put_external(o, cgroup, plen) < 0)
+			return -1;
+		o->buf[o->len++] = '\n';
+		break;
+	case STATOUT_CSV:
+		/* "ts,cgroup" is rendered once and copied to every line */
+		prefix_off = o->len;
+		put_u64(o, o->ts_ns);
+		o->buf[o->len++] = ',';
+		put_csv_str(o, cgroup);
+		prefix_len = o->len - prefix_off;
+		o->len = prefix_off;
+		break;
+	case STATOUT_JSON:
+	default:
+		put(o, "{\"ts\":", 6);
+		put_u64(o, o->ts_ns);
+		put(o, ",\"cgroup\":", 10);
+		put_json_str(o, cgroup);
+		break;
+	}
+
+	for (i = 0; i < s->n; i++) {
+		const struct stat_entry *e = &s->e[i];
+		const char *tok;
+		size_t tlen, start = o->len;
+
+		if (key_token(o, e->key, &tok, &tlen) < 0)
+			return -1;
+		switch (o->fmt) {
+		case STATOUT_HUMAN:
+			put(o, tok, tlen);
+			if (e->node != STATPARSE_NODE_NONE) {
+				put(o, " N", 2);
+				put_u64(o, e->node);
+			}
+			do
+				o->buf[o->len++] = ' ';
+			while (o->len - start < HUMAN_KEY_COL);
+			if (is_bytes(e->key))
+				put_bytes(o, e->value);
+			else
+				put_u64(o, e->value);
+			o->buf[o->len++] = '\n';
+			break;
+		case STATOUT_CSV:
+			/* the prefix sits at prefix_off; copy it forward */
+			if (o->len != prefix_off)
+				memmove(o->buf + o->len, o->buf + prefix_off,
+					prefix_len);
+			o->len += prefix_len;
+			put(o, tok, tlen);
+			if (e->node != STATPARSE_NODE_NONE)
+				put_u64(o, e->node);
+			o->buf[o->len++] = ',';
+			put_u64(o, e->value);
+			o->buf[o->len++] = '\n';
+			break;
+		case STATOUT_JSON:
+		default:
+			put(o, tok, tlen);
+			if (e->node != STATPARSE_NODE_NONE) {
+				put(o, ".N", 2);
+				put_u64(o, e->node);
+			}
+			put(o, "\":", 2);
+			put_u64(o, e->value);
+			break;
+		}
+	}
+	if (o->fmt == STATOUT_JSON)
+		put(o, "}\n", 2);
+	o->stats.values += s->n;
+	return 0;
+}
+
+int statout_flush(struct statout *o)
+{
+	uint32_t i, first = 0;
+
+	if (o->len > o->seg_start &&
+	    push_seg(o, NULL, o->seg_start, o->len - o->seg_start) < 0)
+		return -1;
+	o->seg_start = o->len;
+	for (i = 0; i < o->nseg; i++) {
+		o->iov[i].iov_base = (void *)(o->seg[i].ptr ? o->seg[i].ptr :
+					      o->buf + o->seg[i].off);
+		o->iov[i].iov_len = o->seg[i].len;
+		o->stats.bytes += o->seg[i].len;
+	}
+
+	while (first < o->nseg) {
+		int cnt = o->nseg - first > IOV_MAX ? IOV_MAX : (int)(o->nseg - first);
+		ssize_t n = writev(o->fd, o->iov + first, cnt);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		o->stats.syscalls++;
+		/* skip what was written; a partial iovec is advanced in place */
+		while (n > 0 && first < o->nseg) {
+			if ((size_t)n >= o->iov[first].iov_len) {
+				n -= (ssize_t)o->iov[first].iov_len;
+				first++;
+			} else {
+				o->iov[first].iov_base = (char *)o->iov[first].iov_base + n;
+				o->iov[first].iov_len -= (size_t)n;
+				n = 0;
+			}
+		}
+	}
+	o->nseg = 0;
+	o->len = 0;
+	o->seg_start = 0;
+	o->stats.snapshots++;
+	return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * Batched output of parsed stat samples: human, CSV or JSON lines.
+ *
+ * A snapshot (statout_begin() .. statout_flush()) is rendered into one
+ * reusable buffer and written with a single writev(). Nothing goes through
+ * stdio: integers use a two-digits-per-step table itoa, and the key tokens
+ * of each format ("anon ", ",anon,", "\"anon\":") are rendered once and
+ * then copied. Cgroup paths in the human format are not copied at all;
+ * they are separate iovecs pointing at the caller's string, which must stay
+ * valid until statout_flush().
+ *
+ *   human  <path>\n  <key> [N<node>]  <value>      bytes as B/KiB/MiB/GiB
+ *   csv    ts_ns,cgroup,key,node,value             node is empty for totals
+ *   json   {"ts":N,"cgroup":"<path>","<key>":N,"<key>.N<node>":N,...}
+ *
+ * The buffer and iovec array only grow, so steady-state snapshots do not
+ * allocate.
+ */
+#ifndef STATOUT_H
+#define STATOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "statparse.h"
+
+enum statout_fmt {
+	STATOUT_HUMAN,
+	STATOUT_CSV,
+	STATOUT_JSON,
+	STATOUT_FMT_NR,
+};
+
+/* One piece of output: a buffer range (ptr == NULL) or the caller's bytes. */
+struct statout_seg {
+	const char *ptr;
+	size_t off, len;
+};
+
+struct statout_stats {
+	uint64_t snapshots;
+	uint64_t values;
+	uint64_t bytes;
+	uint64_t syscalls;
+};
+
+struct statout {
+	enum statout_fmt fmt;
+	int fd;
+	uint64_t ts_ns;
+	int header_done;
+
+	char *buf;			/* rendered text of the snapshot */
+	size_t len, cap;
+	size_t seg_start;		/* start of the open buffer segment */
+	struct statout_seg *seg;
+	struct iovec *iov;		/* seg resolved at flush time */
+	uint32_t nseg, seg_cap;
+
+	char *tok;			/* preformatted key tokens */
+	size_t tok_len, tok_cap;
+	uint32_t *tok_off;		/* per key id, UINT32_MAX = not yet */
+	uint8_t *tok_size;
+
+	struct statout_stats stats;
+};
+
+/* Returns the format for "human", "csv" or "json", or -1. */
+int statout_parse_fmt(const char *name);
+const char *statout_fmt_name(enum statout_fmt fmt);
+
+int statout_init(struct statout *o, enum statout_fmt fmt, int fd);
+void statout_destroy(struct statout *o);
+
+void statout_begin(struct statout *o, uint64_t ts_ns);
+/* Append every entry of s for one cgroup. Returns 0 or -1 (no memory). */
+int statout_sample(struct statout *o, const char *cgroup,
+		   const struct stat_sample *s);
+/* Write the snapshot with one writev() (more only past IOV_MAX pieces). */
+int statout_flush(struct statout *o);
+
+/* Decimal digits of v at p (no NUL); returns the length, at most 20. */
+size_t statout_utoa(char *p, uint64_t v);
+
+#endif /* STATOUT_H */
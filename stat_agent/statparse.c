@@ -0,0 +1,240 @@
+/*
+ * Parsers for memory.stat / memory.numa_stat / stat_bin reads.
+ */
+#include <endian.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "statparse.h"
+
+#define MAX_EXTRA_KEYS	(STATPARSE_MAX_KEYS - STAT_KEY_NR)
+#define KEY_HASH_SIZE	(MAX_EXTRA_KEYS * 2)
+#define KEY_NAME_MAX	64
+
+/* Interned names of keys stat_key_lookup() does not know */
+static char key_names[MAX_EXTRA_KEYS][KEY_NAME_MAX];
+static uint8_t key_lens[MAX_EXTRA_KEYS];
+static int16_t key_hash[KEY_HASH_SIZE];
+static uint32_t nkeys;
+static int key_hash_ready;
+
+struct memcg_stat_bin_header {
+	uint32_t magic;
+	uint8_t version;
+	uint16_t stat_count;
+	uint16_t event_count;
+	uint16_t numa_stat_count;
+} __attribute__((packed));
+
+struct memcg_stat_bin_entry {
+	uint16_t idx;
+	uint64_t value;
+} __attribute__((packed));
+
+static const char *const kind_names[STAT_KIND_NR] = {
+	[STAT_KIND_TEXT] = "text",
+	[STAT_KIND_NUMA] = "numa",
+	[STAT_KIND_BIN]  = "bin",
+};
+
+enum stat_kind statparse_kind(const char *path)
+{
+	const char *base = strrchr(path, '/');
+
+	base = base ? base + 1 : path;
+	if (strstr(base, "_bin"))
+		return STAT_KIND_BIN;
+	if (strstr(base, "numa_stat"))
+		return STAT_KIND_NUMA;
+	return STAT_KIND_TEXT;
+}
+
+const char *statparse_kind_name(enum stat_kind kind)
+{
+	return kind < STAT_KIND_NR ? kind_names[kind] : "?";
+}
+
+static uint32_t hash_bytes(const char *s, size_t len)
+{
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ (uint8_t)s[i]) * 16777619u;
+	return h;
+}
+
+uint32_t statparse_key(const char *name, size_t len)
+{
+	uint32_t id = stat_key_lookup(name, len), h;
+
+	if (id != STAT_KEY_UNKNOWN)
+		return id;
+
+	/* not in stat_keys.def (newer kernel, cgroup.stat, .ks names) */
+	if (!key_hash_ready) {
+		memset(key_hash, -1, sizeof(key_hash));
+		key_hash_ready = 1;
+	}
+	if (len >= KEY_NAME_MAX)
+		len = KEY_NAME_MAX - 1;
+
+	h = hash_bytes(name, len) % KEY_HASH_SIZE;
+	while (key_hash[h] >= 0) {
+		id = (uint32_t)key_hash[h];
+		if (key_lens[id] == len && memcmp(key_names[id], name, len) == 0)
+			return STAT_KEY_NR + id;
+		h = (h + 1) % KEY_HASH_SIZE;
+	}
+	if (nkeys == MAX_EXTRA_KEYS)
+		return STATPARSE_MAX_KEYS;
+	memcpy(key_names[nkeys], name, len);
+	key_names[nkeys][len] = '\0';
+	key_lens[nkeys] = (uint8_t)len;
+	key_hash[h] = (int16_t)nkeys;
+	return STAT_KEY_NR + nkeys++;
+}
+
+const char *statparse_key_name(uint32_t key)
+{
+	if (key < STAT_KEY_NR)
+		return stat_key_name(key);
+	key -= STAT_KEY_NR;
+	return key < nkeys ? key_names[key] : NULL;
+}
+
+const char *statparse_key_label(uint32_t key, char *tmp, size_t len)
+{
+	const char *name;
+
+	if (STATPARSE_IS_BIN_KEY(key)) {
+		snprintf(tmp, len, "bin%u.%u", (key >> 16) & 0x7fff, key & 0xffff);
+		return tmp;
+	}
+	name = statparse_key_name(key);
+	return name ? name : "?";
+}
+
+static inline int push(struct stat_sample *out, uint32_t key, uint16_t node,
+		       uint64_t value)
+{
+	if (out->n == STATPARSE_MAX_ENTRIES) {
+		out->truncated = 1;
+		return -1;
+	}
+	out->e[out->n].key = key;
+	out->e[out->n].node = node;
+	out->e[out->n].value = value;
+	out->n++;
+	return 0;
+}
+
+static inline const char *parse_u64(const char *p, const char *end,
+				    uint64_t *v)
+{
+	uint64_t x = 0;
+
+	while (p < end && (unsigned)(*p - '0') < 10)
+		x = x * 10 + (uint64_t)(*p++ - '0');
+	*v = x;
+	return p;
+}
+
+int statparse_text(const char *buf, size_t len, struct stat_sample *out)
+{
+	const char *p = buf, *end = buf + len;
+
+	out->n = 0;
+	out->truncated = 0;
+	while (p < end) {
+		const char *name = p, *eol;
+		uint32_t key;
+		uint64_t v;
+
+		eol = memchr(p, '\n', (size_t)(end - p));
+		if (!eol)
+			eol = end;
+		while (p < eol && *p != ' ')
+			p++;
+		if (p == name || p == eol) {
+			p = eol + 1;
+			continue;
+		}
+		key = statparse_key(name, (size_t)(p - name));
+		p++;
+		if (p < eol && *p == 'N') {
+			/* numa_stat: N<node>=<value> pairs */
+			while (p < eol) {
+				uint64_t node;
+
+				if (*p != 'N')
+					break;
+				p = parse_u64(p + 1, eol, &node);
+				if (p >= eol || *p != '=')
+					break;
+				p = parse_u64(p + 1, eol, &v);
+				if (push(out, key, (uint16_t)node, v) < 0)
+					return (int)out->n;
+				while (p < eol && *p == ' ')
+					p++;
+			}
+		} else {
+			parse_u64(p, eol, &v);
+			if (push(out, key, STATPARSE_NODE_NONE, v) < 0)
+				return (int)out->n;
+		}
+		p = eol + 1;
+	}
+	return (int)out->n;
+}
+
+int statparse_bin(const uint8_t *buf, size_t len, struct stat_sample *out)
+{
+	struct memcg_stat_bin_header hdr;
+	uint32_t counts[3], section, i;
+	const uint8_t *p = buf + sizeof(hdr), *end = buf + len;
+
+	out->n = 0;
+	out->truncated = 0;
+	if (len < sizeof(hdr))
+		return -1;
+	memcpy(&hdr, buf, sizeof(hdr));
+	if (le32toh(hdr.magic) != MEMCG_STAT_BIN_MAGIC)
+		return -1;
+	counts[0] = le16toh(hdr.stat_count);
+	counts[1] = le16toh(hdr.event_count);
+	counts[2] = le16toh(hdr.numa_stat_count);
+
+	for (section = 0; section < 3; section++) {
+		for (i = 0; i < counts[section]; i++) {
+			struct memcg_stat_bin_entry e;
+
+			if (p + sizeof(e) > end)
+				return (int)out->n;
+			memcpy(&e, p, sizeof(e));
+			p += sizeof(e);
+			if (push(out, STATPARSE_BIN_KEY(section, le16toh(e.idx)),
+				 STATPARSE_NODE_NONE, le64toh(e.value)) < 0)
+				return (int)out->n;
+		}
+	}
+	return (int)out->n;
+}
+
+int statparse(enum stat_kind kind, const char *buf, size_t len,
+	      struct stat_sample *out)
+{
+	if (kind == STAT_KIND_BIN)
+		return statparse_bin((const uint8_t *)buf, len, out);
+	return statparse_text(buf, len, out);
+}
+
+uint64_t statparse_single(const char *buf, size_t len)
+{
+	uint64_t v;
+
+	if (len >= 3 && memcmp(buf, "max", 3) == 0)
+		return UINT64_MAX;
+	parse_u64(buf, buf + len, &v);
+	return v;
+}
@@ -0,0 +1,76 @@
+/*
+ * Parsers for the memcg stat interfaces.
+ *
+ *   memory.stat, memory.stat.ks, cgroup.stat:  "name value" lines
+ *   memory.numa_stat(.ks):                     "name N0=v N1=v ..." lines
+ *   memory.stat_bin, memory.numa_stat_bin:     memcg_stat_bin_header + entries
+ *
+ * All of them produce a flat list of (key, node, value). Known text keys
+ * map to their stable SK_* index (stat_keys.h); other names are interned to
+ * dense ids from STAT_KEY_NR up. Binary entries use STATPARSE_BIN_KEY() so
+ * the namespaces never collide.
+ */
+#ifndef STATPARSE_H
+#define STATPARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stat_keys.h"
+
+#define STATPARSE_MAX_ENTRIES	2048
+#define STATPARSE_MAX_KEYS	1024
+#define STATPARSE_NODE_NONE	0xffff
+
+/* Binary entries: section 0 = stats, 1 = events, 2 = numa stats */
+#define STATPARSE_BIN_KEY(section, idx)	(0x80000000u | ((section) << 16) | (idx))
+#define STATPARSE_IS_BIN_KEY(key)	((key) & 0x80000000u)
+
+#define MEMCG_STAT_BIN_MAGIC	0x4D454D43	/* "MEMC" */
+
+enum stat_kind {
+	STAT_KIND_TEXT,		/* memory.stat, *.ks, cgroup.stat */
+	STAT_KIND_NUMA,		/* memory.numa_stat */
+	STAT_KIND_BIN,		/* memory.stat_bin, memory.numa_stat_bin */
+	STAT_KIND_NR,
+};
+
+struct stat_entry {
+	uint32_t key;
+	uint16_t node;
+	uint64_t value;
+};
+
+struct stat_sample {
+	uint32_t n;
+	int truncated;		/* more entries than STATPARSE_MAX_ENTRIES */
+	struct stat_entry e[STATPARSE_MAX_ENTRIES];
+};
+
+/* Guess the kind from a file name such as "memory.numa_stat.ks". */
+enum stat_kind statparse_kind(const char *path);
+const char *statparse_kind_name(enum stat_kind kind);
+
+/*
+ * Key id of a name: SK_* if known, else an interned id >= STAT_KEY_NR, or
+ * STATPARSE_MAX_KEYS when the intern table is full.
+ */
+uint32_t statparse_key(const char *name, size_t len);
+/* Name of a key id, or NULL. */
+const char *statparse_key_name(uint32_t key);
+/*
+ * Name of any key for output: bin keys as "bin<section>.<idx>", rendered
+ * into tmp, ids without a name as "?".
+ */
+const char *statparse_key_label(uint32_t key, char *tmp, size_t len);
+
+/* Parse one read of a file of the given kind. Returns entry count or -1. */
+int statparse(enum stat_kind kind, const char *buf, size_t len,
+	      struct stat_sample *out);
+int statparse_text(const char *buf, size_t len, struct stat_sample *out);
+int statparse_bin(const uint8_t *buf, size_t len, struct stat_sample *out);
+
+/* Single-value files (memory.current, memory.max): "max" -> UINT64_MAX. */
+uint64_t statparse_single(const char *buf, size_t len);
+
+#endif /* STATPARSE_H */
@@ -0,0 +1,221 @@
+/*
+ * Capture file writer and mmap-based reader. See statrec.h for the format.
+ */
+#include <endian.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "statrec.h"
+
+static int put(struct statrec_writer *w, const void *p, size_t n)
+{
+	return fwrite(p, 1, n, w->fp) == n ? 0 : -1;
+}
+
+static int put_u8(struct statrec_writer *w, uint8_t v)
+{
+	return put(w, &v, 1);
+}
+
+static int put_le16(struct statrec_writer *w, uint16_t v)
+{
+	v = htole16(v);
+	return put(w, &v, 2);
+}
+
+static int put_le32(struct statrec_writer *w, uint32_t v)
+{
+	v = htole32(v);
+	return put(w, &v, 4);
+}
+
+static int put_le64(struct statrec_writer *w, uint64_t v)
+{
+	v = htole64(v);
+	return put(w, &v, 8);
+}
+
+int statrec_create(struct statrec_writer *w, const char *path)
+{
+	w->fp = fopen(path, "wb");
+	w->nsources = 0;
+	if (!w->fp)
+		return -1;
+	setvbuf(w->fp, NULL, _IOFBF, 1 << 20);
+	if (put_le32(w, STATREC_MAGIC) || put_le16(w, STATREC_VERSION) ||
+	    put_le16(w, 0)) {
+		fclose(w->fp);
+		w->fp = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+int statrec_add_source(struct statrec_writer *w, uint8_t kind,
+		       const char *path)
+{
+	size_t len = strlen(path);
+	uint16_t id = w->nsources;
+
+	if (w->nsources == STATREC_MAX_SOURCES || len > UINT16_MAX)
+		return -1;
+	if (put_u8(w, STATREC_SOURCE) || put_le16(w, id) || put_u8(w, kind) ||
+	    put_le16(w, (uint16_t)len) || put(w, path, len))
+		return -1;
+	w->nsources++;
+	return id;
+}
+
+int statrec_write_read(struct statrec_writer *w, uint16_t source,
+		       uint64_t ts_ns, uint32_t read_ns, const void *data,
+		       uint32_t len)
+{
+	if (put_u8(w, STATREC_READ) || put_le16(w, source) ||
+	    put_le64(w, ts_ns) || put_le32(w, read_ns) || put_le32(w, len) ||
+	    put(w, data, len))
+		return -1;
+	return 0;
+}
+
+int statrec_close(struct statrec_writer *w)
+{
+	int ret = fclose(w->fp);
+
+	w->fp = NULL;
+	return ret;
+}
+
+static uint16_t get_le16(const uint8_t *p)
+{
+	uint16_t v;
+
+	memcpy(&v, p, 2);
+	return le16toh(v);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+	return le32toh(v);
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, 8);
+	return le64toh(v);
+}
+
+/* Walk all records; with index set, fill f->reads, otherwise just count. */
+static int scan(struct statrec_file *f, int index)
+{
+	const uint8_t *p = f->map + 8, *end = f->map + f->size;
+	size_t nreads = 0;
+
+	while (p < end) {
+		uint8_t type;
+		uint16_t src;
+
+		if (end - p < 3)
+			return -1;
+		type = p[0];
+		src = get_le16(p + 1);
+		p += 3;
+		if (type == STATREC_SOURCE) {
+			uint16_t len;
+
+			if (end - p < 3)
+				return -1;
+			len = get_le16(p + 1);
+			if (end - p < 3 + len || src >= STATREC_MAX_SOURCES)
+				return -1;
+			if (index) {
+				struct statrec_source *s = &f->sources[src];
+
+				/* a repeated source record replaces the first */
+				s->kind = p[0];
+				free(s->path);
+				s->path = strndup((const char *)p + 3, len);
+				if (!s->path)
+					return -1;
+				if (src >= f->nsources)
+					f->nsources = src + 1u;
+			}
+			p += 3 + len;
+		} else if (type == STATREC_READ) {
+			uint32_t len;
+
+			if (end - p < 16)
+				return -1;
+			len = get_le32(p + 12);
+			if ((size_t)(end - p - 16) < len)
+				return -1;
+			if (index) {
+				struct statrec_read *r = &f->reads[nreads];
+
+				r->source = src;
+				r->ts_ns = get_le64(p);
+				r->read_ns = get_le32(p + 8);
+				r->len = len;
+				r->data = p + 16;
+			}
+			nreads++;
+			p += 16 + len;
+		} else {
+			return -1;
+		}
+	}
+	f->nreads = nreads;
+	return 0;
+}
+
+int statrec_open(struct statrec_file *f, const char *path)
+{
+	struct stat st;
+	int fd;
+
+	memset(f, 0, sizeof(*f));
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) < 0 || st.st_size < 8) {
+		close(fd);
+		return -1;
+	}
+	f->size = (size_t)st.st_size;
+	f->map = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	close(fd);
+	if (f->map == MAP_FAILED) {
+		f->map = NULL;
+		return -1;
+	}
+	if (get_le32(f->map) != STATREC_MAGIC ||
+	    get_le16(f->map + 4) != STATREC_VERSION || scan(f, 0) < 0)
+		goto fail;
+	f->reads = calloc(f->nreads ? f->nreads : 1, sizeof(*f->reads));
+	if (!f->reads || scan(f, 1) < 0)
+		goto fail;
+	return 0;
+fail:
+	statrec_free(f);
+	return -1;
+}
+
+void statrec_free(struct statrec_file *f)
+{
+	uint32_t i;
+
+	for (i = 0; i < f->nsources; i++)
+		free(f->sources[i].path);
+	free(f->reads);
+	if (f->map)
+		munmap((void *)f->map, f->size);
+	memset(f, 0, sizeof(*f));
+}
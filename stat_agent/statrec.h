@@ -0,0 +1,72 @@
+/*
+ * Capture file of raw stat reads, for deterministic replay.
+ *
+ * File:   magic(4) "MSRC", version(2), reserved(2), then records.
+ * Record: type(1), source(2), then
+ *   STATREC_SOURCE: kind(1) path_len(2) path      -- declares a source id
+ *   STATREC_READ:   ts_ns(8) read_ns(4) len(4) bytes
+ *
+ * ts_ns is CLOCK_MONOTONIC at the start of the read, read_ns how long the
+ * read syscalls took. All integers are little-endian. The raw bytes are
+ * exactly what read() returned, so parsers see the same input on replay.
+ */
+#ifndef STATREC_H
+#define STATREC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define STATREC_MAGIC		0x4352534D	/* "MSRC" */
+#define STATREC_VERSION		1
+#define STATREC_MAX_SOURCES	4096
+
+enum statrec_type {
+	STATREC_SOURCE = 1,
+	STATREC_READ = 2,
+};
+
+struct statrec_source {
+	uint8_t kind;		/* enum stat_kind */
+	char *path;
+};
+
+struct statrec_read {
+	uint16_t source;
+	uint64_t ts_ns;
+	uint32_t read_ns;
+	uint32_t len;
+	const uint8_t *data;	/* points into the mapped file */
+};
+
+struct statrec_writer {
+	FILE *fp;
+	uint16_t nsources;
+};
+
+int statrec_create(struct statrec_writer *w, const char *path);
+/* Returns the new source id, or -1. */
+int statrec_add_source(struct statrec_writer *w, uint8_t kind,
+		       const char *path);
+int statrec_write_read(struct statrec_writer *w, uint16_t source,
+		       uint64_t ts_ns, uint32_t read_ns, const void *data,
+		       uint32_t len);
+int statrec_close(struct statrec_writer *w);
+
+/*
+ * Reader: the whole file is mapped and indexed up front so replay touches
+ * no I/O and no allocator in its timed loop.
+ */
+struct statrec_file {
+	const uint8_t *map;
+	size_t size;
+	uint32_t nsources;
+	struct statrec_source sources[STATREC_MAX_SOURCES];
+	size_t nreads;
+	struct statrec_read *reads;
+};
+
+int statrec_open(struct statrec_file *f, const char *path);
+void statrec_free(struct statrec_file *f);
+
+#endif /* STATREC_H */
@@ -0,0 +1,138 @@
+/*
+ * Record raw reads of memcg stat files for later replay (statrec_replay).
+ * Every file is opened once; each tick does lseek(0) + read() on each file in
+ * the order given and stores the bytes with a timestamp and the read time.
+ *
+ * Usage:
+ *   statrec_capture -o out.rec [-n count] [-i interval_ms] FILE...
+ *   statrec_capture -o a.rec -n 600 -i 1000 \
+ *       /sys/fs/cgroup/a/memory.stat /sys/fs/cgroup/a/memory.numa_stat
+ *   count 0 = until Ctrl-C; interval 0 = back to back
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "statparse.h"
+#include "statrec.h"
+#include "util.h"
+
+#define READ_BUF_SIZE	(1 << 20)
+
+static volatile sig_atomic_t g_stop;
+static void on_sigint(int signo) { (void)signo; g_stop = 1; }
+
+int main(int argc, char *argv[])
+{
+	const char *out = NULL;
+	long count = 0, interval_ms = 1000, i;
+	struct statrec_writer w;
+	struct sigaction sa = { 0 };
+	uint64_t deadline, bytes = 0, reads = 0;
+	char *buf;
+	int *fds, nfiles, opt, f;
+
+	while ((opt = getopt(argc, argv, "o:n:i:")) != -1) {
+		switch (opt) {
+		case 'o':
+			out = optarg;
+			break;
+		case 'n':
+			count = atol(optarg);
+			break;
+		case 'i':
+			interval_ms = atol(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (!out || optind >= argc || count < 0 || interval_ms < 0)
+		goto usage;
+
+	nfiles = argc - optind;
+	fds = calloc((size_t)nfiles, sizeof(int));
+	buf = malloc(READ_BUF_SIZE);
+	if (!fds || !buf) {
+		perror("malloc");
+		return 1;
+	}
+	if (statrec_create(&w, out) < 0) {
+		perror(out);
+		return 1;
+	}
+	for (f = 0; f < nfiles; f++) {
+		const char *path = argv[optind + f];
+
+		fds[f] = open(path, O_RDONLY);
+		if (fds[f] < 0) {
+			perror(path);
+			return 1;
+		}
+		if (statrec_add_source(&w, (uint8_t)statparse_kind(path), path) < 0) {
+			perror("statrec_add_source");
+			return 1;
+		}
+	}
+
+	sa.sa_handler = on_sigint;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	deadline = now_ns();
+	for (i = 0; (count == 0 || i < count) && !g_stop; i++) {
+		for (f = 0; f < nfiles; f++) {
+			uint64_t t0 = now_ns();
+			ssize_t n = read_whole(fds[f], buf, READ_BUF_SIZE);
+			uint64_t t1 = now_ns();
+
+			if (n < 0) {
+				fprintf(stderr, "read %s: %s\n", argv[optind + f],
+					strerror(errno));
+				g_stop = 1;
+				break;
+			}
+			if (statrec_write_read(&w, (uint16_t)f, t0,
+					       (uint32_t)(t1 - t0), buf,
+					       (uint32_t)n) < 0) {
+				perror("write");
+				return 1;
+			}
+			bytes += (uint64_t)n;
+			reads++;
+		}
+		if (interval_ms > 0 && (count == 0 || i != count - 1)) {
+			struct timespec ts;
+
+			deadline += (uint64_t)interval_ms * 1000000ull;
+			ts = ns_to_ts(deadline);
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					       &ts, NULL) == EINTR && !g_stop)
+				;
+		}
+	}
+
+	if (statrec_close(&w) != 0) {
+		perror(out);
+		return 1;
+	}
+	printf("Captured %llu reads (%llu bytes) from %d files into %s\n",
+	       (unsigned long long)reads, (unsigned long long)bytes, nfiles, out);
+	for (f = 0; f < nfiles; f++)
+		close(fds[f]);
+	free(fds);
+	free(buf);
+	return 0;
+
+usage:
+	fprintf(stderr, "USAGE: %s -o out.rec [-n count] [-i interval_ms] FILE...\n",
+		argv[0]);
+	fprintf(stderr, "  count 0: until Ctrl-C; interval_ms 0: back to back\n");
+	return 1;
+}
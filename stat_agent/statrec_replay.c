@@ -0,0 +1,294 @@
+/*
+ * Replay a statrec capture through the user-space pipeline:
+ *   parse (statparse) -> delta vs. previous read of the same source -> format
+ * The kernel is not involved, so runs are comparable across machines and
+ * across parser/pipeline changes.
+ *
+ * Default mode runs every record back to back for several rounds and reports
+ * the spread between rounds plus an output checksum (identical output is
+ * required for the numbers to be comparable). -p replays at the original
+ * pacing and reports per-record processing latency instead.
+ *
+ * Usage:
+ *   statrec_replay [-r rounds] [-c cpu] [-o out.txt] capture.rec
+ *   statrec_replay -p [-x speed] capture.rec
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "statparse.h"
+#include "statrec.h"
+#include "util.h"
+
+#define OUT_BUF_SIZE	(256 * 1024)
+
+struct pipeline {
+	struct stat_sample cur;
+	struct stat_sample *prev[STATREC_MAX_SOURCES];
+	char out[OUT_BUF_SIZE];
+	size_t out_len;
+	uint64_t checksum;
+	FILE *sink;
+};
+
+static uint64_t fnv1a(uint64_t h, const void *p, size_t n)
+{
+	const uint8_t *b = p;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		h = (h ^ b[i]) * 0x100000001b3ull;
+	return h;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* One record through all stages. */
+static void process(struct pipeline *pl, const struct statrec_file *f,
+		    const struct statrec_read *r)
+{
+	struct stat_sample *cur = &pl->cur, *prev = pl->prev[r->source];
+	char tmp[32];
+	uint32_t i;
+
+	statparse(f->sources[r->source].kind, (const char *)r->data, r->len, cur);
+
+	pl->out_len = 0;
+	for (i = 0; i < cur->n; i++) {
+		const struct stat_entry *e = &cur->e[i];
+		int64_t delta = 0;
+
+		/* reads of one file keep their line order, so match by position */
+		if (i < prev->n && prev->e[i].key == e->key &&
+		    prev->e[i].node == e->node)
+			delta = (int64_t)(e->value - prev->e[i].value);
+		if (OUT_BUF_SIZE - pl->out_len < 128)
+			break;
+		pl->out_len += (size_t)snprintf(pl->out + pl->out_len,
+				OUT_BUF_SIZE - pl->out_len, "%u %s %d %llu %lld\n",
+				r->source, statparse_key_label(e->key, tmp, sizeof(tmp)),
+				e->node == STATPARSE_NODE_NONE ? -1 : e->node,
+				(unsigned long long)e->value, (long long)delta);
+	}
+	memcpy(prev, cur, offsetof(struct stat_sample, e) +
+	       cur->n * sizeof(cur->e[0]));
+
+	pl->checksum = fnv1a(pl->checksum, pl->out, pl->out_len);
+	if (pl->sink)
+		fwrite(pl->out, 1, pl->out_len, pl->sink);
+}
+
+static void reset(struct pipeline *pl, const struct statrec_file *f)
+{
+	uint32_t s;
+
+	for (s = 0; s < f->nsources; s++)
+		pl->prev[s]->n = 0;
+	pl->checksum = 0xcbf29ce484222325ull;
+}
+
+static uint64_t run_round(struct pipeline *pl, const struct statrec_file *f)
+{
+	uint64_t t0;
+	size_t i;
+
+	reset(pl, f);
+	t0 = now_ns();
+	for (i = 0; i < f->nreads; i++)
+		process(pl, f, &f->reads[i]);
+	return now_ns() - t0;
+}
+
+static void run_paced(struct pipeline *pl, const struct statrec_file *f,
+		      double speed)
+{
+	uint64_t *lat, start, ts0, late_max = 0;
+	size_t i;
+
+	lat = malloc(f->nreads * sizeof(uint64_t));
+	if (!lat) {
+		perror("malloc");
+		exit(1);
+	}
+	reset(pl, f);
+	ts0 = f->reads[0].ts_ns;
+	start = now_ns();
+	for (i = 0; i < f->nreads; i++) {
+		const struct statrec_read *r = &f->reads[i];
+		uint64_t due = start + (uint64_t)((double)(r->ts_ns - ts0) / speed);
+		struct timespec ts = ns_to_ts(due);
+		uint64_t t0;
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+				       NULL) == EINTR)
+			;
+		t0 = now_ns();
+		if (t0 - due > late_max)
+			late_max = t0 - due;
+		process(pl, f, r);
+		lat[i] = now_ns() - t0;
+	}
+	qsort(lat, f->nreads, sizeof(uint64_t), cmp_u64);
+	printf("Paced replay (speed %.2fx): %zu records\n", speed, f->nreads);
+	printf("  process ns: p50=%llu p90=%llu p99=%llu max=%llu\n",
+	       (unsigned long long)lat[f->nreads / 2],
+	       (unsigned long long)lat[f->nreads * 9 / 10],
+	       (unsigned long long)lat[f->nreads * 99 / 100],
+	       (unsigned long long)lat[f->nreads - 1]);
+	printf("  max wakeup lateness: %llu ns\n", (unsigned long long)late_max);
+	printf("  output checksum: %016llx\n", (unsigned long long)pl->checksum);
+	free(lat);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct pipeline pl;
+	struct statrec_file f;
+	const char *out = NULL;
+	int rounds = 10, paced = 0, cpu = -1, opt, r;
+	double speed = 1.0;
+	uint64_t *round_ns, checksum = 0, captured_ns = 0;
+	size_t i, bytes = 0;
+	uint32_t s;
+
+	while ((opt = getopt(argc, argv, "r:c:o:px:")) != -1) {
+		switch (opt) {
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		case 'p':
+			paced = 1;
+			break;
+		case 'x':
+			speed = atof(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || rounds <= 0 || speed <= 0)
+		goto usage;
+
+	if (statrec_open(&f, argv[optind]) < 0) {
+		fprintf(stderr, "%s: cannot open or malformed capture\n",
+			argv[optind]);
+		return 1;
+	}
+	if (f.nreads == 0) {
+		fprintf(stderr, "%s: no reads recorded\n", argv[optind]);
+		return 1;
+	}
+	for (s = 0; s < f.nsources; s++) {
+		pl.prev[s] = calloc(1, sizeof(struct stat_sample));
+		if (!pl.prev[s]) {
+			perror("calloc");
+			return 1;
+		}
+	}
+	for (i = 0; i < f.nreads; i++) {
+		if (f.reads[i].source >= f.nsources) {
+			fprintf(stderr, "record %zu: unknown source %u\n", i,
+				f.reads[i].source);
+			return 1;
+		}
+		bytes += f.reads[i].len;
+		captured_ns += f.reads[i].read_ns;
+	}
+	if (cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) < 0)
+			perror("sched_setaffinity");
+	}
+
+	printf("=== Replay of %s ===\n", argv[optind]);
+	printf("Sources: %u, records: %zu, bytes: %zu\n", f.nsources, f.nreads,
+	       bytes);
+	for (s = 0; s < f.nsources; s++)
+		if (f.sources[s].path)	/* ids need not be dense */
+			printf("  [%u] %-5s %s\n", s,
+			       statparse_kind_name((enum stat_kind)f.sources[s].kind),
+			       f.sources[s].path);
+	printf("Captured kernel read time: %.1f ns/record (for reference)\n",
+	       (double)captured_ns / f.nreads);
+
+	if (out) {
+		pl.sink = fopen(out, "w");
+		if (!pl.sink) {
+			perror(out);
+			return 1;
+		}
+	}
+	if (paced) {
+		run_paced(&pl, &f, speed);
+		goto done;
+	}
+
+	/* Warm-up round also fixes key ids, so every timed round is identical */
+	run_round(&pl, &f);
+	checksum = pl.checksum;
+	if (pl.sink) {
+		fclose(pl.sink);
+		pl.sink = NULL;
+	}
+
+	round_ns = malloc((size_t)rounds * sizeof(uint64_t));
+	if (!round_ns) {
+		perror("malloc");
+		return 1;
+	}
+	for (r = 0; r < rounds; r++) {
+		round_ns[r] = run_round(&pl, &f);
+		if (pl.checksum != checksum) {
+			fprintf(stderr, "round %d: output differs from warm-up\n", r);
+			return 1;
+		}
+	}
+	qsort(round_ns, (size_t)rounds, sizeof(uint64_t), cmp_u64);
+	{
+		double med = (double)round_ns[rounds / 2] / f.nreads;
+		double lo = (double)round_ns[0] / f.nreads;
+		double hi = (double)round_ns[rounds - 1] / f.nreads;
+
+		printf("Max-speed replay, %d rounds:\n", rounds);
+		printf("  ns/record: median=%.1f min=%.1f max=%.1f\n", med, lo, hi);
+		printf("  spread (max-min)/median: %.2f%%\n", (hi - lo) / med * 100);
+		printf("  throughput: %.1f MB/s\n",
+		       (double)bytes * 1000.0 / round_ns[rounds / 2]);
+		printf("  output checksum: %016llx\n", (unsigned long long)checksum);
+	}
+	free(round_ns);
+done:
+	if (pl.sink)
+		fclose(pl.sink);
+	for (s = 0; s < f.nsources; s++)
+		free(pl.prev[s]);
+	statrec_free(&f);
+	return 0;
+
+usage:
+	fprintf(stderr, "USAGE: %s [-r rounds] [-c cpu] [-o out.txt] capture.rec\n",
+		argv[0]);
+	fprintf(stderr, "       %s -p [-x speed] capture.rec\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,383 @@
+/*
+ * Columnar delta-of-delta block codec for counter time series.
+ * See tsenc.h for the block layout and residual prefix codes.
+ */
+#include <endian.h>
+#include <string.h>
+
+#include "tsenc.h"
+
+/* Bucket k: prefix code, prefix length and payload width. */
+static const uint8_t res_code[6]  = { 0x0, 0x2, 0x6, 0xe, 0x1e, 0x1f };
+static const uint8_t res_len[6]   = { 1, 2, 3, 4, 5, 5 };
+static const uint8_t res_width[6] = { 0, 4, 8, 16, 32, 64 };
+
+/* Significant bits of a residual -> bucket index. */
+static const uint8_t res_bucket[65] = {
+	[0] = 0,
+	[1 ... 4] = 1,
+	[5 ... 8] = 2,
+	[9 ... 16] = 3,
+	[17 ... 32] = 4,
+	[33 ... 64] = 5,
+};
+
+struct bitw {
+	uint8_t *p;
+	uint64_t acc;
+	unsigned n;		/* pending bits in the low end of acc, < 8 */
+};
+
+/* nb <= 57 */
+static inline void bw_put(struct bitw *w, uint64_t v, unsigned nb)
+{
+	w->acc = (w->acc << nb) | v;
+	w->n += nb;
+	while (w->n >= 8) {
+		w->n -= 8;
+		*w->p++ = (uint8_t)(w->acc >> w->n);
+	}
+}
+
+static inline void bw_flush(struct bitw *w)
+{
+	if (w->n) {
+		*w->p++ = (uint8_t)(w->acc << (8 - w->n));
+		w->n = 0;
+	}
+	w->acc = 0;
+}
+
+struct bitr {
+	const uint8_t *p, *end;
+	uint64_t acc;		/* MSB-aligned */
+	unsigned n;
+};
+
+static inline void br_init(struct bitr *r, const uint8_t *p, const uint8_t *end)
+{
+	r->p = p;
+	r->end = end;
+	r->acc = 0;
+	r->n = 0;
+}
+
+static inline void br_refill(struct bitr *r)
+{
+	while (r->n <= 56) {
+		uint64_t byte = r->p < r->end ? *r->p++ : 0;
+
+		r->acc |= byte << (56 - r->n);
+		r->n += 8;
+	}
+}
+
+/* 1 <= nb <= 32, caller guarantees nb bits are buffered */
+static inline uint64_t br_take(struct bitr *r, unsigned nb)
+{
+	uint64_t v = r->acc >> (64 - nb);
+
+	r->acc <<= nb;
+	r->n -= nb;
+	return v;
+}
+
+static inline uint64_t zigzag(uint64_t x)
+{
+	return (x << 1) ^ (uint64_t)((int64_t)x >> 63);
+}
+
+static inline uint64_t unzigzag(uint64_t z)
+{
+	return (z >> 1) ^ (0 - (z & 1));
+}
+
+static inline void put_residual(struct bitw *w, uint64_t zz)
+{
+	unsigned k = res_bucket[zz ? 64 - __builtin_clzll(zz) : 0];
+
+	if (k < 5) {
+		bw_put(w, ((uint64_t)res_code[k] << res_width[k]) | zz,
+		       res_len[k] + res_width[k]);
+	} else {
+		bw_put(w, res_code[5], res_len[5]);
+		bw_put(w, zz >> 32, 32);
+		bw_put(w, zz & 0xffffffffu, 32);
+	}
+}
+
+static inline uint64_t get_residual(struct bitr *r)
+{
+	uint64_t hi;
+	unsigned k, w;
+
+	br_refill(r);
+	/* count leading ones, capped at 5 */
+	k = __builtin_clzll(~r->acc | (1ull << 58));
+	r->acc <<= res_len[k];
+	r->n -= res_len[k];
+	w = res_width[k];
+	if (k < 5)
+		return w ? br_take(r, w) : 0;
+	hi = br_take(r, 32);
+	br_refill(r);
+	return (hi << 32) | br_take(r, 32);
+}
+
+static uint8_t *put_varint(uint8_t *p, uint64_t v)
+{
+	while (v >= 0x80) {
+		*p++ = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end,
+				 uint64_t *out)
+{
+	uint64_t v = 0;
+	unsigned shift = 0;
+
+	while (p < end && shift < 64) {
+		uint8_t b = *p++;
+
+		v |= (uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			*out = v;
+			return p;
+		}
+		shift += 7;
+	}
+	return NULL;
+}
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+	v = htole16(v);
+	memcpy(p, &v, 2);
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	v = htole32(v);
+	memcpy(p, &v, 4);
+}
+
+static void put_le64(uint8_t *p, uint64_t v)
+{
+	v = htole64(v);
+	memcpy(p, &v, 8);
+}
+
+static uint16_t get_le16(const uint8_t *p)
+{
+	uint16_t v;
+
+	memcpy(&v, p, 2);
+	return le16toh(v);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+	return le32toh(v);
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, 8);
+	return le64toh(v);
+}
+
+size_t tsenc_block_bound(uint32_t nsamples, uint32_t ncols)
+{
+	/* 5 + 64 bits per residual worst case, plus head and flush byte */
+	size_t col = 10 + 1 + ((size_t)nsamples * 69 + 7) / 8 + 1;
+
+	return TSENC_HDR_SIZE + 4 * ((size_t)ncols + 1) +
+	       col * ((size_t)ncols + 1);
+}
+
+/*
+ * Residuals of one series: dod of (delta >> shift). The first delta is
+ * coded against 0, so a constant-rate series costs one bit per sample
+ * after the second one.
+ */
+static void encode_series(struct bitw *w, const uint64_t *v, uint32_t n,
+			  unsigned shift)
+{
+	uint64_t prev_d = 0;
+	uint32_t i;
+
+	for (i = 1; i < n; i++) {
+		uint64_t d = (uint64_t)((int64_t)(v[i] - v[i - 1]) >> shift);
+
+		put_residual(w, zigzag(d - prev_d));
+		prev_d = d;
+	}
+}
+
+static void decode_series(struct bitr *r, uint64_t first, uint64_t *out,
+			  uint32_t n, unsigned shift)
+{
+	uint64_t prev_d = 0, cur = first;
+	uint32_t i;
+
+	out[0] = first;
+	for (i = 1; i < n; i++) {
+		prev_d += unzigzag(get_residual(r));
+		cur += prev_d << shift;
+		out[i] = cur;
+	}
+}
+
+static unsigned series_shift(const uint64_t *v, uint32_t n)
+{
+	uint64_t bits = 0;
+	uint32_t i;
+
+	for (i = 1; i < n; i++)
+		bits |= v[i] - v[i - 1];
+	return bits ? (unsigned)__builtin_ctzll(bits) : 0;
+}
+
+size_t tsenc_encode_block(const uint64_t *ts, const uint64_t *vals,
+			  uint32_t nsamples, uint32_t ncols, size_t stride,
+			  uint8_t *out)
+{
+	uint8_t *tab, *payload;
+	struct bitw w;
+	uint32_t c;
+
+	if (nsamples == 0 || nsamples > TSENC_BLOCK_MAX || ncols > UINT16_MAX ||
+	    (ncols && stride < nsamples))
+		return 0;
+
+	put_le32(out, TSENC_MAGIC);
+	put_le16(out + 4, (uint16_t)nsamples);
+	put_le16(out + 6, (uint16_t)ncols);
+	put_le64(out + 8, ts[0]);
+	tab = out + TSENC_HDR_SIZE;
+	payload = tab + 4 * ((size_t)ncols + 1);
+
+	w.p = payload;
+	w.acc = 0;
+	w.n = 0;
+	encode_series(&w, ts, nsamples, 0);
+	bw_flush(&w);
+	put_le32(tab, (uint32_t)(w.p - payload));
+
+	for (c = 0; c < ncols; c++) {
+		const uint64_t *v = vals + (size_t)c * stride;
+		unsigned shift = series_shift(v, nsamples);
+
+		w.p = put_varint(w.p, v[0]);
+		*w.p++ = (uint8_t)shift;
+		encode_series(&w, v, nsamples, shift);
+		bw_flush(&w);
+		put_le32(tab + 4 * ((size_t)c + 1), (uint32_t)(w.p - payload));
+	}
+	return (size_t)(w.p - out);
+}
+
+int tsenc_block_info(const uint8_t *in, size_t len,
+		     struct tsenc_block_info *info)
+{
+	size_t payload_off;
+	uint32_t ncols, c, prev = 0;
+
+	if (len < TSENC_HDR_SIZE || get_le32(in) != TSENC_MAGIC)
+		return -1;
+	info->nsamples = get_le16(in + 4);
+	ncols = get_le16(in + 6);
+	info->ncols = ncols;
+	info->t0 = get_le64(in + 8);
+	if (info->nsamples == 0 || info->nsamples > TSENC_BLOCK_MAX)
+		return -1;
+
+	payload_off = TSENC_HDR_SIZE + 4 * ((size_t)ncols + 1);
+	if (len < payload_off)
+		return -1;
+	for (c = 0; c <= ncols; c++) {
+		uint32_t end = get_le32(in + TSENC_HDR_SIZE + 4 * (size_t)c);
+
+		if (end < prev || payload_off + end > len)
+			return -1;
+		prev = end;
+	}
+	info->size = payload_off + prev;
+	return 0;
+}
+
+/* Locate column c (0 = timestamps) inside a validated block. */
+static void column_span(const uint8_t *in, const struct tsenc_block_info *info,
+			uint32_t c, const uint8_t **start, const uint8_t **end)
+{
+	const uint8_t *tab = in + TSENC_HDR_SIZE;
+	const uint8_t *payload = tab + 4 * ((size_t)info->ncols + 1);
+	uint32_t lo = c ? get_le32(tab + 4 * ((size_t)c - 1)) : 0;
+
+	*start = payload + lo;
+	*end = payload + get_le32(tab + 4 * (size_t)c);
+}
+
+static int decode_value_column(const uint8_t *in,
+			       const struct tsenc_block_info *info,
+			       uint32_t col, uint64_t *out)
+{
+	const uint8_t *p, *end;
+	struct bitr r;
+	uint64_t first;
+
+	column_span(in, info, col + 1, &p, &end);
+	p = get_varint(p, end, &first);
+	if (!p || p >= end || *p > 63)
+		return -1;
+	br_init(&r, p + 1, end);
+	decode_series(&r, first, out, info->nsamples, *p);
+	return 0;
+}
+
+int tsenc_decode_block(const uint8_t *in, size_t len, uint64_t *ts,
+		       uint64_t *vals, size_t stride)
+{
+	struct tsenc_block_info info;
+	uint32_t c;
+
+	if (tsenc_block_info(in, len, &info) < 0)
+		return -1;
+	if (vals && info.ncols && stride < info.nsamples)
+		return -1;
+
+	if (ts) {
+		const uint8_t *p, *end;
+		struct bitr r;
+
+		column_span(in, &info, 0, &p, &end);
+		br_init(&r, p, end);
+		decode_series(&r, info.t0, ts, info.nsamples, 0);
+	}
+	if (vals) {
+		for (c = 0; c < info.ncols; c++)
+			if (decode_value_column(in, &info, c,
+						vals + (size_t)c * stride) < 0)
+				return -1;
+	}
+	return 0;
+}
+
+int tsenc_decode_column(const uint8_t *in, size_t len, uint32_t col,
+			uint64_t *out)
+{
+	struct tsenc_block_info info;
+
+	if (tsenc_block_info(in, len, &info) < 0 || col >= info.ncols)
+		return -1;
+	return decode_value_column(in, &info, col, out);
+}
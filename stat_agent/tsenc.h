@@ -0,0 +1,72 @@
+/*
+ * Columnar block encoder for counter time series (Gorilla-style).
+ *
+ * One block holds up to TSENC_BLOCK_MAX samples of ncols counter series that
+ * share a timestamp column. Layout (little-endian):
+ *
+ *   magic(4) nsamples(2) ncols(2) t0(8) col_end[ncols + 1](4 each) payload
+ *
+ * col_end[c] is the byte offset just past column c in the payload; column 0
+ * is the timestamp column, columns 1..ncols are the counters, each starting
+ * on a byte boundary so a single series can be decoded without the others.
+ *
+ * Timestamps: delta-of-delta against t0. Counters: first value as LEB128,
+ * then a shift byte (common trailing zero bits of all deltas in the block,
+ * e.g. 12 for page-granular byte counters), then zig-zag delta-of-delta of
+ * the shifted deltas. Every residual is written with one prefix code:
+ *
+ *   0          -> residual 0         (1 bit: unchanged or constant rate)
+ *   10   + 4   -> residual < 2^4
+ *   110  + 8   -> residual < 2^8
+ *   1110 + 16  -> residual < 2^16
+ *   11110 + 32 -> residual < 2^32
+ *   11111 + 64 -> anything else
+ *
+ * Counters are integers, so XOR-of-float is not used; zig-zag deltas give
+ * the same "unchanged costs one bit" property without a float round trip.
+ */
+#ifndef TSENC_H
+#define TSENC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TSENC_MAGIC		0x31425354	/* "TSB1" */
+#define TSENC_BLOCK_MAX		1024
+#define TSENC_HDR_SIZE		16
+
+struct tsenc_block_info {
+	uint32_t nsamples;
+	uint32_t ncols;
+	uint64_t t0;
+	size_t size;		/* total encoded bytes of this block */
+};
+
+/* Worst-case encoded size; out buffers of at least this size never overflow. */
+size_t tsenc_block_bound(uint32_t nsamples, uint32_t ncols);
+
+/*
+ * Encode nsamples rows. vals is column-major: vals[c * stride + i] is
+ * counter c at sample i. Returns bytes written, or 0 on bad arguments.
+ * out must hold tsenc_block_bound(nsamples, ncols) bytes.
+ */
+size_t tsenc_encode_block(const uint64_t *ts, const uint64_t *vals,
+			  uint32_t nsamples, uint32_t ncols, size_t stride,
+			  uint8_t *out);
+
+/* Parse and validate a block header. Returns 0 or -1 on malformed input. */
+int tsenc_block_info(const uint8_t *in, size_t len,
+		     struct tsenc_block_info *info);
+
+/*
+ * Decode a whole block into ts[] and column-major vals[] (same layout as
+ * encode). Either output may be NULL to skip it. Returns 0 or -1.
+ */
+int tsenc_decode_block(const uint8_t *in, size_t len, uint64_t *ts,
+		       uint64_t *vals, size_t stride);
+
+/* Decode only counter column col (0-based) into out[nsamples]. */
+int tsenc_decode_column(const uint8_t *in, size_t len, uint32_t col,
+			uint64_t *out);
+
+#endif /* TSENC_H */
@@ -0,0 +1,64 @@
+/*
+ * Small helpers shared by the stat_agent programs.
+ */
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec;
+}
+
+/* CPU time of the calling thread. */
+static inline uint64_t thread_cpu_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return (uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec;
+}
+
+static inline uint64_t ts_to_ns(const struct timespec *t)
+{
+	return (uint64_t)t->tv_sec * 1000000000ull + (uint64_t)t->tv_nsec;
+}
+
+static inline struct timespec ns_to_ts(uint64_t ns)
+{
+	struct timespec t;
+
+	t.tv_sec = (time_t)(ns / 1000000000ull);
+	t.tv_nsec = (long)(ns % 1000000000ull);
+	return t;
+}
+
+/*
+ * lseek(0) + read() until EOF or buf is full, like the open-once readers.
+ * Returns bytes read or -1 with errno set.
+ */
+static inline ssize_t read_whole(int fd, char *buf, size_t cap)
+{
+	size_t n = 0;
+
+	if (lseek(fd, 0, SEEK_SET) < 0)
+		return -1;
+	while (n < cap) {
+		ssize_t r = read(fd, buf + n, cap - n);
+
+		if (r < 0)
+			return -1;
+		if (r == 0)
+			break;
+		n += (size_t)r;
+	}
+	return (ssize_t)n;
+}
+
+#endif /* UTIL_H */
@@ -0,0 +1,156 @@
+#!/bin/bash
+# Fleet simulator: one monitoring agent per leaf, each reading its own cgroup's stats,
+# running alongside the alloc workers. Measures per-agent latency and the host-wide
+# CPU the agents cost (their own user/sys time, /proc/stat, optionally perf).
+set -euo pipefail
+
+cgroup_dir="/sys/fs/cgroup"
+cgroup_top_dir="${cgroup_dir}/a"
+
+# Args: [num_agents] [mode] [interval_ms] [jitter_pct] [seconds] [size_per_worker]
+#   num_agents: leaves a/b/c/0 .. a/b/c/(num_agents-1), one agent (+ one alloc) each
+#   mode: cat | once | light (see cgroup_read_test/fleet_agent.c)
+#   interval_ms, jitter_pct: each agent ticks every interval +/- jitter%, random phase
+#   seconds: run time
+#   size_per_worker: alloc size per leaf, e.g. 20M
+# Env:
+#   WITH_ALLOC=0      agents only (no alloc workers)
+#   PERF=1            also record `perf record -a -g` and report memcg read-path symbols
+#   OUT_DIR=dir       per-agent output (default fleet_<date>)
+#   AGENT_BIN, ALLOC_BIN  binaries (default ./fleet_agent, ./alloc)
+NUM="${1:-100}"
+MODE="${2:-once}"
+INTERVAL_MS="${3:-1000}"
+JITTER="${4:-10}"
+SECS="${5:-60}"
+SIZE="${6:-20M}"
+
+AGENT="${AGENT_BIN:-./fleet_agent}"
+ALLOC="${ALLOC_BIN:-./alloc}"
+WITH_ALLOC="${WITH_ALLOC:-1}"
+PERF="${PERF:-0}"
+OUT_DIR="${OUT_DIR:-fleet_$(date +%Y%m%d_%H%M%S)}"
+
+case "${MODE}" in
+  cat|once|light) ;;
+  *) echo "Unknown mode ${MODE} (cat, once, light)" >&2; exit 1 ;;
+esac
+
+for bin in "${AGENT}" $([[ "${WITH_ALLOC}" == 1 ]] && echo "${ALLOC}"); do
+  if [[ ! -x "${bin}" ]]; then
+    echo "${bin} not found or not executable (make -C cgroup_read_test)." >&2
+    exit 1
+  fi
+done
+
+if ! command -v cgexec &>/dev/null; then
+  echo "cgexec not found. Install cgroup-tools package:" >&2
+  echo "  apt-get install cgroup-tools   # Debian/Ubuntu" >&2
+  echo "  yum install libcgroup-tools    # CentOS/RHEL" >&2
+  exit 1
+fi
+
+for i in $(seq 0 $((NUM-1))); do
+  leaf="${cgroup_top_dir}/b/c/${i}"
+  if [[ ! -d "${leaf}" ]]; then
+    echo "Missing leaf ${leaf}; create them with: N=${NUM} ./setup_mem.sh" >&2
+    exit 1
+  fi
+done
+
+AGENT_ABS=$(realpath "${AGENT}")
+ALLOC_ABS=$([[ "${WITH_ALLOC}" == 1 ]] && realpath "${ALLOC}" || echo "")
+rel_top="${cgroup_top_dir#${cgroup_dir}/}"
+mkdir -p "${OUT_DIR}"
+
+# /proc/stat "cpu" line: user nice system idle iowait irq softirq steal
+read_cpu() {
+  awk '/^cpu / { print $2+$3, $4+$7+$8, $2+$3+$4+$5+$6+$7+$8+$9 }' /proc/stat
+}
+
+pids=()
+if [[ "${WITH_ALLOC}" == 1 ]]; then
+  for i in $(seq 0 $((NUM-1))); do
+    # a little longer than the agents so memory stays charged for the whole run
+    cgexec -g "memory:${rel_top}/b/c/${i}" "${ALLOC_ABS}" "${SIZE}" "$((SECS + 5))" &
+    pids+=("$!")
+  done
+  echo "Started ${NUM} alloc workers (${SIZE} each); settling 2 s"
+  sleep 2
+fi
+
+read -r u0 s0 t0 < <(read_cpu)
+perf_pid=""
+if [[ "${PERF}" == 1 ]]; then
+  if command -v perf &>/dev/null; then
+    perf record -a -g -o "${OUT_DIR}/perf.data" -- sleep "${SECS}" >/dev/null 2>&1 &
+    perf_pid=$!
+  else
+    echo "perf not found; skipping profile" >&2
+  fi
+fi
+
+agents=()
+for i in $(seq 0 $((NUM-1))); do
+  cgexec -g "memory:${rel_top}/b/c/${i}" \
+    "${AGENT_ABS}" "${MODE}" "${INTERVAL_MS}" "${JITTER}" "${SECS}" \
+    > "${OUT_DIR}/agent_${i}.txt" &
+  agents+=("$!")
+done
+echo "Started ${NUM} agents: mode=${MODE} interval=${INTERVAL_MS}ms jitter=${JITTER}% for ${SECS}s"
+
+status=0
+for p in "${agents[@]}"; do
+  wait "$p" || status=1
+done
+read -r u1 s1 t1 < <(read_cpu)
+if [[ -n "${perf_pid}" ]]; then
+  wait "${perf_pid}" || true
+fi
+for p in "${pids[@]}"; do
+  kill "$p" 2>/dev/null || true
+  wait "$p" 2>/dev/null || true
+done
+
+ncpu=$(nproc)
+{
+  echo "=== Fleet: ${NUM} agents, mode=${MODE}, interval=${INTERVAL_MS}ms +/-${JITTER}%, ${SECS}s, alloc=$([[ "${WITH_ALLOC}" == 1 ]] && echo "${SIZE}" || echo none) ==="
+  cat "${OUT_DIR}"/agent_*.txt | awk -v secs="${SECS}" -v ncpu="${ncpu}" '
+    function isort(a, n,    i, j, x) {
+      for (i = 2; i <= n; i++) {
+        x = a[i]
+        for (j = i - 1; j > 0 && a[j] > x; j--) a[j + 1] = a[j]
+        a[j + 1] = x
+      }
+    }
+    {
+      for (i = 2; i <= NF; i++) { split($i, kv, "="); v[kv[1]] = kv[2] }
+      n++; ticks += v["ticks"]; errs += v["errors"]
+      # mean_us covers only the sampled ticks
+      sampled += v["sampled"]; mean += v["mean_us"] * v["sampled"]
+      p50[n] = v["p50_us"] + 0; p99[n] = v["p99_us"] + 0
+      if (v["max_us"] + 0 > max) max = v["max_us"] + 0
+      user += v["user_ms"]; sys += v["sys_ms"]
+    }
+    END {
+      if (!n) { print "no agent output"; exit 1 }
+      isort(p50, n); isort(p99, n)
+      printf "agents %d, ticks %d (%.1f/s host-wide), errors %d\n", n, ticks, ticks / secs, errs
+      printf "per-tick latency: mean %.1f us, median of agent p50 %.1f us, worst agent p99 %.1f us, max %.1f us\n",
+             sampled ? mean / sampled : 0, p50[int((n + 1) / 2)], p99[n], max
+      printf "agent CPU: user %.0f ms + sys %.0f ms = %.2f%% of one core, %.3f%% of the host (%d CPUs)\n",
+             user, sys, (user + sys) / (secs * 10), (user + sys) / (secs * 10 * ncpu), ncpu
+      printf "per agent: %.3f ms CPU per second\n", (user + sys) / secs / n
+    }'
+  awk -v u="$((u1 - u0))" -v s="$((s1 - s0))" -v t="$((t1 - t0))" 'BEGIN {
+    if (t > 0) printf "host /proc/stat during run: user %.2f%%, system %.2f%% (all tasks, incl. alloc)\n", u * 100 / t, s * 100 / t
+  }'
+  if [[ -n "${perf_pid}" && -f "${OUT_DIR}/perf.data" ]]; then
+    echo "perf (children %, memcg read path):"
+    perf report -i "${OUT_DIR}/perf.data" --children --sort sym --stdio -g none 2>/dev/null |
+      grep -E 'memory_stat_show|memory_numa_stat_show|mem_cgroup_flush_stats|cgroup_rstat_flush|css_rstat_flush|memcg_stat_format|seq_read_iter' |
+      head -12 || true
+  fi
+} | tee "${OUT_DIR}/summary.txt"
+
+exit "$status"